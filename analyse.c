@@ -40,13 +40,36 @@
 #include "analyse.h"
 
 
-/** global variables  **/
-int abs_flg; /* flag for absolute/relative cutoff  */
-int patch_flg; /* flag for using patch file  */
-double *pat; /* work area for patch  */
-int npat; /* # of data in pat[]  */
-double p0; /* maximum power  */
-double if0; /* freq point of maximum  */
+/* initialize struct WAON_analyse without patch
+ * INPUT
+ *  abs_flg   : 0 for relative, 1 for absolute cutoff
+ *  adj_pitch : pitch adjustment in half-notes
+ */
+struct WAON_analyse *
+WAON_analyse_init (int abs_flg, double adj_pitch)
+{
+  struct WAON_analyse *an
+    = (struct WAON_analyse *)malloc (sizeof (struct WAON_analyse));
+  CHECK_MALLOC (an, "WAON_analyse_init");
+
+  an->abs_flg = abs_flg;
+  an->adj_pitch = adj_pitch;
+  an->patch_flg = 0;
+  an->pat = NULL;
+  an->npat = 0;
+  an->p0 = 0.0;
+  an->if0 = 0.0;
+
+  return (an);
+}
+
+void
+WAON_analyse_free (struct WAON_analyse *an)
+{
+  if (an == NULL) return;
+  if (an->pat != NULL) free (an->pat);
+  free (an);
+}
 
 
 /** for stage 2 : note selection process **/
@@ -59,21 +82,19 @@ double if0; /* freq point of maximum  */
  *  cut_ratio        : log10 of cutoff ratio to scale velocity
  *  rel_cut_ratio    : log10 of cutoff ratio relative to average
  *                     0 means cutoff is equal to average
- *  (global)abs_flg  : 0 for relative, 1 for absolute
  *  i0, i1           : considering frequency range
- *  (global)patch_flg: whether patch is used or not.
+ *  an               : abs_flg (0 for relative, 1 for absolute),
+ *                     the patch, and adj_pitch for the note
  * OUTPUT
  *  intens[128]      : intensity [0,128) for each midi note
  */
 void
-note_intensity (double *p, double *fp,
+note_intensity (const struct WAON_analyse *an,
+		double *p, double *fp,
 		double cut_ratio, double rel_cut_ratio,
 		int i0, int i1,
 		double t0, char *intens)
 {
-  extern int patch_flg; /* flag for using patch file  */
-  extern int abs_flg; /* flag for absolute/relative cutoff  */
-
   int i;
   int imax;
   double max;
@@ -90,7 +111,7 @@ note_intensity (double *p, double *fp,
     }
 
   // calc average power
-  if (abs_flg == 0)
+  if (an->abs_flg == 0)
     {
       av = 0.0;
       for (i = i0; i < i1; i++)
@@ -108,7 +129,7 @@ note_intensity (double *p, double *fp,
     {
       // search peak
       // set the threshold to the average
-      if (abs_flg == 0)
+      if (an->abs_flg == 0)
 	{
 	  max = av * pow (10.0, rel_cut_ratio);
 	}
@@ -140,9 +161,11 @@ note_intensity (double *p, double *fp,
 	  freq = fp [imax];
 	  //fprintf (stderr, "freq = %f, %f\n", freq, (double)imax / t0);
 	}
-      in = get_note (freq); // midi note #
-      // check  the range of the note
-      if (in >= i0 && in <= i1)
+      in = get_note_adj (freq, an->adj_pitch); // midi note #
+      // check  the range of the note for intens[128]
+      // (i0 and i1 are FFT indices, not midi notes, so that the note
+      //  should not be compared with them)
+      if (in >= 0 && in < 128)
 	{
 	  // if second time on same note, skip
 	  if (intens[in] == 0)
@@ -163,7 +186,7 @@ note_intensity (double *p, double *fp,
 	}
 
       // subtract peak upto minimum in both sides
-      if (patch_flg == 0)
+      if (an->patch_flg == 0)
 	{
 	  p[imax] = 0.0;
 	  // right side
@@ -193,7 +216,7 @@ note_intensity (double *p, double *fp,
 		{
 		  f = fp [i];
 		}
-	      p[i] -= max * patch_power (f/freq);
+	      p[i] -= max * patch_power (an, f/freq);
 	      if (p[i] <0)
 		{
 		  p[i] = 0;
@@ -273,18 +296,17 @@ average_FFT_into_midi (int len, double samplerate,
  *  rel_cut_ratio   : log10 of cutoff ratio relative to average
  *                    0 means cutoff is equal to average
  *  i0, i1          : considering midi note range (NOT FREQUENCY INDEX!!)
- *  (global)abs_flg : 0 for relative, 1 for absolute
+ *  an->abs_flg     : 0 for relative, 1 for absolute
  * OUTPUT
  *  intens[]        : with 127 elements (# of notes)
  */
 void
-pickup_notes (double *amp2midi,
+pickup_notes (const struct WAON_analyse *an,
+	      double *amp2midi,
 	      double cut_ratio, double rel_cut_ratio,
 	      int i0, int i1,
 	      char *intens)
 {
-  extern int abs_flg; /* flag for absolute/relative cutoff  */
-
   //double oct_fac = 0.5; // octave harmonics factor
   double oct_fac = 0.0;
 
@@ -302,7 +324,7 @@ pickup_notes (double *amp2midi,
     }
 
   // calc average power
-  if (abs_flg == 0)
+  if (an->abs_flg == 0)
     {
       av = 0.0;
       for (i = i0; i < i1; i++)
@@ -320,7 +342,7 @@ pickup_notes (double *amp2midi,
     {
       // search peak
       // set the threshold to the average
-      if (abs_flg == 0)
+      if (an->abs_flg == 0)
 	{
 	  max = av * pow (10.0, rel_cut_ratio);
 	}
@@ -384,27 +406,22 @@ pickup_notes (double *amp2midi,
  * at the freqency where the ratio to the maximum is 'freq_ratio'
  */
 double
-patch_power (double freq_ratio)
+patch_power (const struct WAON_analyse *an, double freq_ratio)
 {
-  extern double *pat;
-  extern int npat; /* # of data in pat[]  */
-  extern double p0; /* maximum power  */
-  extern double if0; /* freq point of maximum  */
-  
   int i0, i1;
   double dpdf;
   double f;
   double p;
 
-  f = (double)if0 * freq_ratio;
+  f = (double)an->if0 * freq_ratio;
   i0 = (int)f;
   i1 = i0 + 1;
 
-  if (i0 < 1 || i1 > npat)
+  if (i0 < 1 || i1 > an->npat)
     return 0.0;
-  dpdf = pat[i1] - pat[i0];
-  p = pat[i0] + dpdf * (f - (double)i0);
-  return (p/p0);
+  dpdf = an->pat[i1] - an->pat[i0];
+  p = an->pat[i0] + dpdf * (f - (double)i0);
+  return (p/an->p0);
 }
 
 /* initialize patch
@@ -412,38 +429,33 @@ patch_power (double freq_ratio)
  *   file_patch : filename
  *   plen : # of data in patch (wav)
  *   nwin : index of window
- * OUTPUT (extern values)
- *   pat[] : power of pat
- *   npat : # of data in pat[] ( = plen/2 +1 )
- *   p0 : maximun of power
- *   if0 : freq point of maximum
+ * OUTPUT
+ *   an->patch_flg : 1 if the patch is used
+ *   an->pat[] : power of pat
+ *   an->npat : # of data in pat[] ( = plen/2 +1 )
+ *   an->p0 : maximun of power
+ *   an->if0 : freq point of maximum
  */
 void
-init_patch (char *file_patch, int plen, int nwin)
+init_patch (struct WAON_analyse *an, char *file_patch, int plen, int nwin)
 {
-  extern int patch_flg;
-  extern double *pat;
-  extern int npat; /* # of data in pat[]  */
-  extern double p0; /* maximum power  */
-  extern double if0; /* freq point of maximum  */
-  
   int i;
 
 
   /* prepare patch  */
   if (file_patch == NULL)
     {
-      patch_flg = 0;
+      an->patch_flg = 0;
       return;
     }
   else
     {
       /* allocate pat[]  */
-      pat = (double *)malloc (sizeof (double) * (plen/2+1));
-      if (pat == NULL)
+      an->pat = (double *)malloc (sizeof (double) * (plen/2+1));
+      if (an->pat == NULL)
 	{
 	  fprintf(stderr, "cannot allocate pat[%d]\n", (plen/2+1));
-	  patch_flg = 0;
+	  an->patch_flg = 0;
 	  return;
 	}
 
@@ -454,7 +466,7 @@ init_patch (char *file_patch, int plen, int nwin)
       if (x == NULL || xx == NULL)
 	{
 	  fprintf(stderr, "cannot allocate x[%d]\n", plen);
-	  patch_flg = 0;
+	  an->patch_flg = 0;
 	  return;
 	}
 
@@ -464,7 +476,7 @@ init_patch (char *file_patch, int plen, int nwin)
       if (y == NULL)
 	{
 	  fprintf(stderr, "cannot allocate y[%d]\n", plen);
-	  patch_flg = 0;
+	  an->patch_flg = 0;
 	  free (x);
 	  free (xx);
 	  return;
@@ -482,10 +494,10 @@ init_patch (char *file_patch, int plen, int nwin)
 	}
 
       /* read patch wav  */
-      if (sndfile_read (sf, sfinfo, x, xx, plen) != plen)
+      if (sndfile_read (sf, sfinfo, x, xx, plen, NULL) != plen)
 	{
 	  fprintf (stderr, "No Patch Data!\n");
-	  patch_flg = 0;
+	  an->patch_flg = 0;
 	  free (x);
 	  free (xx);
 	  free (y);
@@ -511,7 +523,7 @@ init_patch (char *file_patch, int plen, int nwin)
       plan = fftw_plan_r2r_1d (plen, x, y, FFTW_R2HC, FFTW_ESTIMATE);
 #endif /* FFTW2 */
 
-      power_spectrum_fftw (plen, x, y, pat, den, nwin, plan);
+      power_spectrum_fftw (plen, x, y, an->pat, den, nwin, plan);
       fftw_destroy_plan (plan);
 
       free (x);
@@ -520,20 +532,20 @@ init_patch (char *file_patch, int plen, int nwin)
       sf_close (sf);
 
       /* search maximum  */
-      p0 = 0.0;
-      if0 = -1;
+      an->p0 = 0.0;
+      an->if0 = -1;
       for (i=0; i<plen/2; i++)
 	{
-	  if (pat[i] > p0)
+	  if (an->pat[i] > an->p0)
 	    {
-	      p0 = pat[i];
-	      if0 = i;
+	      an->p0 = an->pat[i];
+	      an->if0 = i;
 	    }
 	}
-      if (if0 == -1)
-	patch_flg = 0;
+      if (an->if0 == -1)
+	an->patch_flg = 0;
 
-      npat = plen/2;
-      patch_flg = 1;
+      an->npat = plen/2;
+      an->patch_flg = 1;
     }
 }
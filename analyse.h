@@ -20,13 +20,32 @@
 #define	_ANALYSE_H_
 
 
-/* global variables  */
-extern int abs_flg; /* flag for absolute/relative cutoff  */
-extern int patch_flg; /* flag for using patch file  */
-extern double *pat; /* work area for patch  */
-extern int npat; /* # of data in pat[]  */
-extern double p0; /* maximum power  */
-extern double if0; /* freq point of maximum  */
+/* settings of the note selection, which are read only
+ * during the analysis, so that one struct can be shared by the bands
+ * (and the analyses with different settings can run in parallel)
+ */
+struct WAON_analyse {
+  int abs_flg; /* flag for absolute/relative cutoff  */
+  double adj_pitch; /* pitch adjustment in half-notes  */
+
+  int patch_flg; /* flag for using patch file  */
+  double *pat; /* work area for patch  */
+  int npat; /* # of data in pat[]  */
+  double p0; /* maximum power  */
+  double if0; /* freq point of maximum  */
+};
+
+
+/* initialize struct WAON_analyse without patch
+ * INPUT
+ *  abs_flg   : 0 for relative, 1 for absolute cutoff
+ *  adj_pitch : pitch adjustment in half-notes
+ */
+struct WAON_analyse *
+WAON_analyse_init (int abs_flg, double adj_pitch);
+
+void
+WAON_analyse_free (struct WAON_analyse *an);
 
 
 /** for stage 2 : note selection process **/
@@ -39,14 +58,15 @@ extern double if0; /* freq point of maximum  */
  *  cut_ratio        : log10 of cutoff ratio to scale velocity
  *  rel_cut_ratio    : log10 of cutoff ratio relative to average
  *                     0 means cutoff is equal to average
- *  (global)abs_flg  : 0 for relative, 1 for absolute
  *  i0, i1           : considering frequency range
- *  (global)patch_flg: whether patch is used or not.
+ *  an               : abs_flg (0 for relative, 1 for absolute),
+ *                     the patch, and adj_pitch for the note
  * OUTPUT
  *  intens[128]      : intensity [0,128) for each midi note
  */
 void
-note_intensity (double *p, double *fp,
+note_intensity (const struct WAON_analyse *an,
+		double *p, double *fp,
 		double cut_ratio, double rel_cut_ratio,
 		int i0, int i1,
 		double t0, char *intens);
@@ -73,19 +93,21 @@ average_FFT_into_midi (int len, double samplerate,
  *  rel_cut_ratio   : log10 of cutoff ratio relative to average
  *                    0 means cutoff is equal to average
  *  i0, i1          : considering midi note range (NOT FREQUENCY INDEX!!)
- *  (global)abs_flg : 0 for relative, 1 for absolute
+ *  an->abs_flg     : 0 for relative, 1 for absolute
  * OUTPUT
  *  intens[]        : with 127 elements (# of notes)
  */
 void
-pickup_notes (double *amp2midi,
+pickup_notes (const struct WAON_analyse *an,
+	      double *amp2midi,
 	      double cut_ratio, double rel_cut_ratio,
 	      int i0, int i1,
 	      char *intens);
 
 
-double patch_power (double freq_ratio);
-void init_patch (char *file_patch, int plen, int nwin);
+double patch_power (const struct WAON_analyse *an, double freq_ratio);
+void init_patch (struct WAON_analyse *an,
+		 char *file_patch, int plen, int nwin);
 
 
 #endif /* !_ANALYSE_H_ */
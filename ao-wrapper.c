@@ -15,14 +15,23 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
  */
+#include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h> // write()
 #include <string.h> // memset()
+#include <math.h> // ldexp()
+#include <pthread.h>
 
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 // ao device
 #include <ao/ao.h>
+#include "ao-wrapper.h"
+
+
+/* format for ao_out_open(), set by ao_out_set_format() */
+static int ao_out_bits = AO_OUT_BITS;
+static int ao_out_nbuf = AO_OUT_NBUF;
 
 
 static void
@@ -36,14 +45,54 @@ print_ao_info (const ao_info *info,
 }
 
 
-/* open ao device
- * the mode is 16-bits, stereo.
- * INPUT
- *  verbose : 0 == quiet
- *            1 == print info
- */
-ao_device *
-ao_init_16_stereo (int samplerate, int verbose)
+void
+ao_out_set_format (int bits, int nbuf)
+{
+  if (bits != 16 && bits != 24 && bits != 32)
+    {
+      fprintf (stderr, "invalid bits %d, 16 is taken.\n", bits);
+      bits = 16;
+    }
+  if (nbuf < 0) nbuf = 0;
+
+  ao_out_bits = bits;
+  ao_out_nbuf = nbuf;
+}
+
+/* thread to play the queued buffers */
+static void *
+ao_out_thread (void *arg)
+{
+  struct ao_out *out = (struct ao_out *)arg;
+
+  pthread_mutex_lock (&out->lock);
+  for (;;)
+    {
+      while (out->count == 0 && out->flag_exit == 0)
+	{
+	  pthread_cond_wait (&out->cond, &out->lock);
+	}
+      if (out->count == 0) break; // exit after the rest is played
+
+      int i = out->head;
+      pthread_mutex_unlock (&out->lock);
+
+      // buf[i] is not touched by ao_out_write() until count is reduced
+      int status = ao_play (out->device, out->buf [i], out->buf_len [i]);
+
+      pthread_mutex_lock (&out->lock);
+      if (status == 0) out->status = 0;
+      out->head = (out->head + 1) % out->nbuf;
+      out->count --;
+      pthread_cond_broadcast (&out->cond);
+    }
+  pthread_mutex_unlock (&out->lock);
+
+  return (NULL);
+}
+
+struct ao_out *
+ao_out_open (int samplerate, int verbose)
 {
   ao_device *device;
   ao_sample_format format;
@@ -54,12 +103,19 @@ ao_init_16_stereo (int samplerate, int verbose)
   default_driver = ao_default_driver_id ();
 
   memset(&format, 0, sizeof(format));
-  format.bits = 16;
+  format.bits = ao_out_bits;
   format.channels = 2;
   format.rate = samplerate;
   format.byte_format = AO_FMT_LITTLE;
 
   device = ao_open_live (default_driver, &format, NULL /* no options */);
+  if (device == NULL && format.bits != 16)
+    {
+      fprintf (stderr, "%d bits is not supported, 16 is taken.\n",
+	       format.bits);
+      format.bits = 16;
+      device = ao_open_live (default_driver, &format, NULL);
+    }
   if (device == NULL) {
     fprintf(stderr, "Error opening device.\n");
     return NULL;
@@ -71,9 +127,82 @@ ao_init_16_stereo (int samplerate, int verbose)
       ao_info *info;
       info = ao_driver_info (default_driver);
       print_ao_info (info, "[ao]");
+      fprintf (stdout, "[ao] bits : %d, buffers : %d\n",
+	       format.bits, ao_out_nbuf);
+    }
+
+  struct ao_out *out = (struct ao_out *)malloc (sizeof (struct ao_out));
+  CHECK_MALLOC (out, "ao_out_open");
+
+  out->device = device;
+  out->bits = format.bits;
+  out->bytes = format.bits / 8 * 2;
+
+  out->nbuf = ao_out_nbuf;
+  int n = (out->nbuf > 0 ? out->nbuf : 1);
+  out->buf      = (char **)malloc (sizeof (char *) * n);
+  out->buf_size = (int *)malloc (sizeof (int) * n);
+  out->buf_len  = (int *)malloc (sizeof (int) * n);
+  CHECK_MALLOC (out->buf,      "ao_out_open");
+  CHECK_MALLOC (out->buf_size, "ao_out_open");
+  CHECK_MALLOC (out->buf_len,  "ao_out_open");
+  int i;
+  for (i = 0; i < n; i ++)
+    {
+      out->buf [i] = NULL;
+      out->buf_size [i] = 0;
+      out->buf_len [i] = 0;
+    }
+
+  out->head = 0;
+  out->count = 0;
+  out->flag_exit = 0;
+  out->status = 1;
+
+  if (out->nbuf > 0)
+    {
+      pthread_mutex_init (&out->lock, NULL);
+      pthread_cond_init (&out->cond, NULL);
+      if (pthread_create (&out->thread, NULL, ao_out_thread, out) != 0)
+	{
+	  fprintf (stderr, "cannot create the output thread\n");
+	  exit (1);
+	}
+    }
+
+  return (out);
+}
+
+void
+ao_out_close (struct ao_out *out)
+{
+  if (out == NULL) return;
+
+  if (out->nbuf > 0)
+    {
+      pthread_mutex_lock (&out->lock);
+      out->flag_exit = 1;
+      pthread_cond_broadcast (&out->cond);
+      pthread_mutex_unlock (&out->lock);
+
+      pthread_join (out->thread, NULL);
+
+      pthread_cond_destroy (&out->cond);
+      pthread_mutex_destroy (&out->lock);
     }
 
-  return (device);
+  ao_close (out->device);
+
+  int n = (out->nbuf > 0 ? out->nbuf : 1);
+  int i;
+  for (i = 0; i < n; i ++)
+    {
+      if (out->buf [i] != NULL) free (out->buf [i]);
+    }
+  free (out->buf);
+  free (out->buf_size);
+  free (out->buf_len);
+  free (out);
 }
 
 void
@@ -94,36 +223,92 @@ print_ao_driver_info_list (void)
 }
 
 
+/* x in [-1, 1) into the little-endian integer of bits
+ * (clipped, and truncated as (short)(x * 32768.0) for 16 bits)
+ */
+static void
+ao_out_pack (char *b, double x, int bits)
+{
+  double s = ldexp (1.0, bits - 1);
+  double y = x * s;
+  long v;
+  if      (y >= s - 1.0) v = (long)(s - 1.0);
+  else if (y <= -s)      v = - (long)s;
+  else                   v = (long)y;
+
+  int i;
+  for (i = 0; i < bits / 8; i ++)
+    {
+      b [i] = (char)((v >> (8 * i)) & 0xff);
+    }
+}
+
 int
-ao_write (ao_device *device, double *left, double *right, int len)
+ao_out_write (struct ao_out *out, double *left, double *right, int len)
 {
   int i;
 
-  int status;
+  // take the buffer to fill
+  int ib = 0;
+  if (out->nbuf > 0)
+    {
+      pthread_mutex_lock (&out->lock);
+      while (out->count == out->nbuf)
+	{
+	  pthread_cond_wait (&out->cond, &out->lock);
+	}
+      ib = (out->head + out->count) % out->nbuf;
+      pthread_mutex_unlock (&out->lock);
+    }
 
-  char *buffer = NULL;
-  buffer = (char *)malloc (len * 4 * sizeof(char));
-  CHECK_MALLOC (buffer, "ao_write");
+  int nb = len * out->bytes;
+  if (nb > out->buf_size [ib])
+    {
+      out->buf [ib] = (char *)realloc (out->buf [ib], sizeof (char) * nb);
+      CHECK_MALLOC (out->buf [ib], "ao_out_write");
+      out->buf_size [ib] = nb;
+    }
 
-  short sl;
-  short sr;
+  char *buffer = out->buf [ib];
+  int bs = out->bits / 8;
   for (i = 0; i < len; i ++)
     {
-      sl = (short)(left  [i] * 32768.0);
-      sr = (short)(right [i] * 32768.0);
-      buffer [i*4+0] =  sl       & 0xff;
-      buffer [i*4+1] = (sl >> 8) & 0xff;
-      buffer [i*4+2] =  sr       & 0xff;
-      buffer [i*4+3] = (sr >> 8) & 0xff;
+      ao_out_pack (buffer + i * out->bytes,      left  [i], out->bits);
+      ao_out_pack (buffer + i * out->bytes + bs, right [i], out->bits);
     }
+  out->buf_len [ib] = nb;
 
-  status = ao_play (device, buffer, len * 4);
-  if (status != 0)
+  int status;
+  if (out->nbuf > 0)
     {
-      status = len * 4;
+      pthread_mutex_lock (&out->lock);
+      out->count ++;
+      pthread_cond_broadcast (&out->cond);
+      status = out->status;
+      pthread_mutex_unlock (&out->lock);
     }
+  else
+    {
+      status = ao_play (out->device, buffer, nb);
+    }
+
+  if (status == 0) return (0);
+  return (len);
+}
+
+long
+ao_out_get_queued (struct ao_out *out)
+{
+  if (out->nbuf == 0) return (0);
 
-  free (buffer);
+  long n = 0;
+  pthread_mutex_lock (&out->lock);
+  int i;
+  for (i = 0; i < out->count; i ++)
+    {
+      n += (long)out->buf_len [(out->head + i) % out->nbuf];
+    }
+  pthread_mutex_unlock (&out->lock);
 
-  return (status);
+  return (n / (long)out->bytes);
 }
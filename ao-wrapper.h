@@ -20,21 +20,77 @@
 #define	_AO_WRAPPER_H_
 
 
-/* open ao device
- * the mode is 16-bits, stereo.
+#include <pthread.h> // pthread_t, pthread_mutex_t, pthread_cond_t
+#include <ao/ao.h> // ao_device
+
+/* default format of ao_out_open() (see ao_out_set_format()) */
+#define AO_OUT_BITS (16)
+#define AO_OUT_NBUF (3)
+
+/* stereo output into the ao device.
+ * ao_out_write() converts the frames into one of the nbuf buffers
+ * and returns, while the thread plays the queued buffers by ao_play(),
+ * so that the caller is not blocked by the device unless all of the
+ * buffers are queued.
+ */
+struct ao_out {
+  ao_device *device;
+  int bits;  // bits per sample (16, 24 or 32)
+  int bytes; // bytes per frame (for 2 channels)
+
+  int nbuf;      // number of buffers (0 == ao_play() in the caller)
+  char **buf;    // [nbuf] (or [1] for nbuf == 0)
+  int *buf_size; // allocated bytes of buf[i]
+  int *buf_len;  // bytes to play in buf[i]
+
+  pthread_t thread;
+  pthread_mutex_t lock; // for the state below
+  pthread_cond_t cond;  // signalled on any change of them
+  int head;      // buffer to play next (by the thread)
+  int count;     // number of buffers queued
+  int flag_exit; // 1 == play the rest and stop the thread
+  int status;    // 0 once ao_play() failed
+};
+
+
+/* set the format for ao_out_open() afterwards
+ * INPUT
+ *  bits : 16, 24 or 32 (16 is taken if the driver does not accept it)
+ *  nbuf : number of buffers queued for the thread,
+ *         2 (double) or 3 (triple) buffering, or 0 for no thread
+ */
+void
+ao_out_set_format (int bits, int nbuf);
+
+/* open ao device in stereo
  * INPUT
  *  verbose : 0 == quiet
  *            1 == print info
+ * OUTPUT
+ *  returned value : struct ao_out, or NULL on error
  */
-ao_device *
-ao_init_16_stereo (int samplerate, int verbose);
+struct ao_out *
+ao_out_open (int samplerate, int verbose);
+
+/* play the rest in the buffers and close the device */
+void
+ao_out_close (struct ao_out *out);
 
 void
 print_ao_driver_info_list (void);
 
 
+/* queue left[len] and right[len] for the device
+ * OUTPUT
+ *  returned value : len, or 0 if ao_play() has failed
+ *                   (which is found at the next call for nbuf > 0)
+ */
 int
-ao_write (ao_device *device, double *left, double *right, int len);
+ao_out_write (struct ao_out *out, double *left, double *right, int len);
+
+/* number of frames queued and not played yet (0 for nbuf == 0) */
+long
+ao_out_get_queued (struct ao_out *out);
 
 
 #endif /* !_AO_WRAPPER_H_ */
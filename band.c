@@ -0,0 +1,482 @@
+/* spectrum analysis of one frequency band (FFT length and note range)
+ * Copyright (C) 1998-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <math.h>
+#include <stdio.h> /* fprintf()  */
+#include <stdlib.h> /* malloc(), free()  */
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+/* FFTW library  */
+#ifdef FFTW2
+#include <rfftw.h>
+#else // FFTW3
+#include <fftw3.h>
+#endif // FFTW2
+
+#include "fft.h" // FFT utility functions
+#include "hc.h" // HC array manipulation routines
+
+#include "midi.h" /* mid2freq[]  */
+#include "analyse.h" /* note_intensity()  */
+
+#include "band.h"
+
+
+/* initialize struct WAON_band
+ * INPUT
+ *  len              : FFT length
+ *  hop              : hop size between two analyses (used for the phase
+ *                     correction)
+ *  samplerate       :
+ *  notelow, notetop : note range to analyse
+ *  flag_window      : window type
+ *  flag_phase       : 0 == no phase correction
+ * OUTPUT
+ *  returned value : struct WAON_band, where the note selection parameters
+ *                   cut_ratio etc. are set to the defaults of waon.
+ */
+struct WAON_band *
+WAON_band_init (long len, long hop, double samplerate,
+		int notelow, int notetop,
+		int flag_window, int flag_phase)
+{
+  struct WAON_band *band
+    = (struct WAON_band *)malloc (sizeof (struct WAON_band));
+  CHECK_MALLOC (band, "WAON_band_init");
+
+  band->len = len;
+  band->hop = hop;
+  band->notelow = notelow;
+  band->notetop = notetop;
+  band->flag_window = flag_window;
+  band->flag_phase = flag_phase;
+  band->flag_fast_phase = 0;
+  band->samplerate = samplerate;
+
+  // default values
+  band->cut_ratio = -5.0;
+  band->rel_cut_ratio = 1.0;
+  band->psub_n = 0;
+  band->psub_f = 0.0;
+  band->oct_f = 0.0;
+  band->harm3_f = 0.0;
+  band->harm5_f = 0.0;
+  band->flux_th = 0.0;
+  band->silence = 0.0;
+  band->an = NULL; // to be set by the caller
+  band->stats = NULL;
+
+  // time-period for FFT (inverse of smallest frequency)
+  band->t0 = (double)len / samplerate;
+
+  // weight of window function for FFT
+  band->den = init_den (len, flag_window);
+
+  // table of window function
+  band->win = (double *)malloc (sizeof (double) * len);
+  CHECK_MALLOC (band->win, "WAON_band_init");
+  init_window (len, flag_window, band->win);
+
+  /* set range to analyse (search notes) */
+  /* -- after 't0' is calculated  */
+  band->i0 = (int)(mid2freq[notelow] * band->t0 - 0.5);
+  band->i1 = (int)(mid2freq[notetop] * band->t0 - 0.5)+1;
+  if (band->i0 <= 0)
+    {
+      band->i0 = 1; // i0=0 means DC component (frequency = 0)
+    }
+  if (band->i1 >= (len/2))
+    {
+      band->i1 = len/2 - 1;
+    }
+
+#ifdef WAON_FLOAT
+  band->x = (float *)fftwf_malloc (sizeof (float) * len);
+  band->y = (float *)fftwf_malloc (sizeof (float) * len);
+#elif defined(FFTW2)
+  band->x = (double *)malloc (sizeof (double) * len);
+  band->y = (double *)malloc (sizeof (double) * len);
+#else // FFTW3
+  band->x = (double *)fftw_malloc (sizeof (double) * len);
+  band->y = (double *)fftw_malloc (sizeof (double) * len);
+#endif // WAON_FLOAT
+  CHECK_MALLOC (band->x, "WAON_band_init");
+  CHECK_MALLOC (band->y, "WAON_band_init");
+
+  // initialization plan for FFTW
+#ifdef WAON_FLOAT
+  band->plan = fftwf_plan_r2r_1d (len, band->x, band->y,
+				  FFTW_R2HC, FFTW_ESTIMATE);
+#elif defined(FFTW2)
+  band->plan = rfftw_create_plan (len, FFTW_REAL_TO_COMPLEX, FFTW_ESTIMATE);
+#else // FFTW3
+  band->plan = fftw_plan_r2r_1d (len, band->x, band->y,
+				 FFTW_R2HC, FFTW_ESTIMATE);
+#endif
+
+  /* power spectrum  */
+  band->p = (double *)malloc (sizeof (double) * (len / 2 + 1));
+  CHECK_MALLOC (band->p, "WAON_band_init");
+
+  /* work area for power_subtract_ave()  */
+  band->ave = (double *)malloc (sizeof (double) * (len / 2 + 1));
+  CHECK_MALLOC (band->ave, "WAON_band_init");
+
+  band->harm = NULL;
+
+  /* reference spectrum for the spectral flux  */
+  band->p_ref = (double *)malloc (sizeof (double) * (len / 2 + 1));
+  CHECK_MALLOC (band->p_ref, "WAON_band_init");
+
+  band->p0   = NULL;
+  band->dphi = NULL;
+  band->ph0  = NULL;
+  band->ph1  = NULL;
+  if (flag_phase != 0)
+    {
+      band->p0 = (double *)malloc (sizeof (double) * (len / 2 + 1));
+      CHECK_MALLOC (band->p0, "WAON_band_init");
+
+      band->dphi = (double *)malloc (sizeof (double) * (len / 2 + 1));
+      CHECK_MALLOC (band->dphi, "WAON_band_init");
+
+      band->ph0 = (double *)malloc (sizeof (double) * (len/2+1));
+      band->ph1 = (double *)malloc (sizeof (double) * (len/2+1));
+      CHECK_MALLOC (band->ph0, "WAON_band_init");
+      CHECK_MALLOC (band->ph1, "WAON_band_init");
+    }
+
+  band->icnt = 0;
+
+  int i;
+  for (i = 0; i < 128; i ++)
+    {
+      band->vel[i] = 0;
+    }
+
+  return (band);
+}
+
+void
+WAON_band_free (struct WAON_band *band)
+{
+  if (band == NULL) return;
+
+#ifdef WAON_FLOAT
+  fftwf_destroy_plan (band->plan);
+  fftwf_free (band->x);
+  fftwf_free (band->y);
+#elif defined(FFTW2)
+  rfftw_destroy_plan (band->plan);
+  free (band->x);
+  free (band->y);
+#else
+  fftw_destroy_plan (band->plan);
+  fftw_free (band->x);
+  fftw_free (band->y);
+#endif /* WAON_FLOAT */
+
+  free (band->win);
+  free (band->p);
+  free (band->ave);
+  harmonic_remover_free (band->harm);
+  free (band->p_ref);
+  if (band->p0 != NULL) free (band->p0);
+  if (band->dphi != NULL) free (band->dphi);
+  if (band->ph0 != NULL) free (band->ph0);
+  if (band->ph1 != NULL) free (band->ph1);
+
+  free (band);
+}
+
+/* spectral flux between band->p[] and band->p_ref[]
+ * in the note range (FFT index from i0 to i1)
+ * OUTPUT
+ *  returned value : sum |sqrt(p) - sqrt(p_ref)| / sum sqrt(p_ref)
+ */
+static double
+WAON_band_flux (struct WAON_band *band)
+{
+  double diff = 0.0;
+  double ref = 0.0;
+  int i;
+  for (i = band->i0; i <= band->i1; i ++)
+    {
+      double a = sqrt (band->p [i]);
+      double b = sqrt (band->p_ref [i]);
+      diff += fabs (a - b);
+      ref += b;
+    }
+  if (ref <= 0.0)
+    {
+      // no reference, so notes should be picked up unless p[] is zero
+      return (diff > 0.0 ? HUGE_VAL : 0.0);
+    }
+  return (diff / ref);
+}
+
+/* analyse one step (stages 1 and 2)
+ * INPUT
+ *  left [band->len], right [band->len] : wave data of the step
+ *  channels : 1 (mono, right[] is not referred) or 2 (stereo)
+ * OUTPUT
+ *  band->vel [128] : velocity at this step, which is kept from the last
+ *                    step if the spectral flux is below band->flux_th
+ *                    and is zero for the silent step
+ */
+void
+WAON_band_analyse (struct WAON_band *band,
+		   const double *left, const double *right,
+		   int channels)
+{
+  long len = band->len;
+  long hop = band->hop;
+#ifdef WAON_FLOAT
+  float *x = band->x;
+  float *y = band->y;
+#else // !WAON_FLOAT
+  double *x = band->x;
+  double *y = band->y;
+#endif // WAON_FLOAT
+  double *p = band->p;
+  double *p0 = band->p0;
+  double *dphi = band->dphi;
+  double *ph0 = band->ph0;
+  double *ph1 = band->ph1;
+  int i;
+
+  struct WAON_stats *stats = band->stats;
+  double t = 0.0;
+  if (stats != NULL) t = WAON_stats_clock ();
+
+  // set table x[] for FFT, mixed down and windowed in one pass
+  const double *win = band->win;
+  double peak = 0.0;
+  for (i = 0; i < len; i ++)
+    {
+      double xi;
+      if (channels == 2) // stereo
+	{
+	  xi = 0.5 * (left [i] + right [i]);
+	}
+      else // mono
+	{
+	  xi = left [i];
+	}
+      if (fabs (xi) > peak) peak = fabs (xi);
+      x [i] = xi * win [i];
+    }
+
+  // silence gate -- no FFT nor note search
+  if (peak <= band->silence)
+    {
+      for (i = 0; i < 128; i ++)
+	{
+	  band->vel [i] = 0;
+	}
+      // the phase correction starts again after the silence
+      band->icnt = 0;
+      WAON_STATS_LAP (stats, WAON_STAT_WINDOW, &t);
+      return;
+    }
+  WAON_STATS_LAP (stats, WAON_STAT_WINDOW, &t);
+
+  /**
+   * stage 1: calc power spectrum
+   */
+#ifdef WAON_FLOAT
+  fftwf_execute (band->plan); // x[] -> y[]
+#else // !WAON_FLOAT
+  /* FFTW library  */
+#ifdef FFTW2
+  rfftw_one (band->plan, x, y);
+#else // FFTW3
+  fftw_execute (band->plan); // x[] -> y[]
+#endif
+#endif // WAON_FLOAT
+  WAON_STATS_LAP (stats, WAON_STAT_FFT, &t);
+
+  if (band->flag_phase == 0)
+    {
+      // no phase-vocoder correction
+#ifdef WAON_FLOAT
+      HC_to_amp2_f (len, y, band->den, p);
+#else
+      HC_to_amp2 (len, y, band->den, p);
+#endif
+      WAON_STATS_LAP (stats, WAON_STAT_POLAR, &t);
+    }
+  else
+    {
+      // with phase-vocoder correction
+#ifdef WAON_FLOAT
+      if (band->flag_fast_phase == 0)
+	HC_to_polar2_f (len, y, 0, band->den, p, ph1);
+      else
+	HC_to_polar2_f_fast (len, y, 0, band->den, p, ph1);
+#else
+      if (band->flag_fast_phase == 0)
+	HC_to_polar2 (len, y, 0, band->den, p, ph1);
+      else
+	HC_to_polar2_fast (len, y, 0, band->den, p, ph1);
+#endif
+      WAON_STATS_LAP (stats, WAON_STAT_POLAR, &t);
+
+      if (band->icnt == 0) // first step, so no ph0[] yet
+	{
+	  for (i = 0; i < (len/2+1); ++i) // full span
+	    {
+	      // no correction
+	      dphi[i] = 0.0;
+
+	      // backup the phase for the next step
+	      p0  [i] = p   [i];
+	      ph0 [i] = ph1 [i];
+	    }
+	}
+      else // icnt > 0
+	{
+	  // freq correction by phase difference
+	  for (i = 0; i < (len/2+1); ++i) // full span
+	    {
+	      double twopi = 2.0 * M_PI;
+	      //double dphi;
+	      dphi[i] = ph1[i] - ph0[i]
+		- twopi * (double)i / (double)len * (double)hop;
+	      dphi[i] = principal_argument (dphi[i]);
+
+	      // frequency correction
+	      // NOTE: freq is (i / len + dphi) * samplerate [Hz]
+	      dphi[i] = dphi[i] / twopi / (double)hop;
+
+	      // backup the phase for the next step
+	      p0  [i] = p   [i];
+	      ph0 [i] = ph1 [i];
+
+	      // then, average the power for the analysis
+	      p[i] = 0.5 *(sqrt (p[i]) + sqrt (p0[i]));
+	      p[i] = p[i] * p[i];
+	    }
+	}
+      WAON_STATS_LAP (stats, WAON_STAT_PHASE, &t);
+    }
+
+  // drum-removal process
+  if (band->psub_n != 0)
+    {
+      power_subtract_ave (len, p, band->psub_n, band->psub_f, band->ave);
+    }
+
+  // octave-removal process
+  if (band->oct_f != 0.0
+      || band->harm3_f != 0.0
+      || band->harm5_f != 0.0)
+    {
+      if (band->harm == NULL)
+	{
+	  int harm[3];
+	  double factor[3];
+	  int nh = 0;
+	  if (band->oct_f != 0.0)
+	    {
+	      harm [nh] = 2;
+	      factor [nh] = band->oct_f;
+	      nh ++;
+	    }
+	  if (band->harm3_f != 0.0)
+	    {
+	      harm [nh] = 3;
+	      factor [nh] = band->harm3_f;
+	      nh ++;
+	    }
+	  if (band->harm5_f != 0.0)
+	    {
+	      harm [nh] = 5;
+	      factor [nh] = band->harm5_f;
+	      nh ++;
+	    }
+	  band->harm = harmonic_remover_init (len, nh, harm, factor);
+	}
+      power_subtract_harmonics (band->harm, p);
+    }
+  WAON_STATS_LAP (stats, WAON_STAT_PSUB, &t);
+
+  /**
+   * stage 2: pickup notes
+   */
+  // skip it if the spectrum does not change from the last pickup,
+  // where vel[] is kept as it is
+  if (band->flux_th > 0.0)
+    {
+      if (band->icnt > 0
+	  && WAON_band_flux (band) < band->flux_th)
+	{
+	  band->icnt ++;
+	  WAON_STATS_LAP (stats, WAON_STAT_NOTES, &t);
+	  return;
+	}
+      for (i = 0; i < (len/2+1); ++i) // full span
+	{
+	  band->p_ref [i] = p [i];
+	}
+    }
+
+  /* new code
+  if (band->flag_phase == 0)
+    {
+      average_FFT_into_midi (len, band->samplerate,
+			     p, NULL,
+			     pmidi);
+    }
+  else
+    {
+      average_FFT_into_midi (len, band->samplerate,
+			     p, dphi,
+			     pmidi);
+    }
+  pickup_notes (band->an, pmidi,
+		band->cut_ratio, band->rel_cut_ratio,
+		band->notelow, band->notetop,
+		band->vel);
+  */
+
+  /* old code */
+  if (band->flag_phase == 0)
+    {
+      // no phase-vocoder correction
+      note_intensity (band->an, p, NULL,
+		      band->cut_ratio, band->rel_cut_ratio,
+		      band->i0, band->i1, band->t0, band->vel);
+    }
+  else
+    {
+      // with phase-vocoder correction
+      // make corrected frequency (i / len + dphi) * samplerate [Hz]
+      for (i = 0; i < (len/2+1); ++i) // full span
+	{
+	  dphi[i] = ((double)i / (double)len + dphi[i])
+	    * band->samplerate;
+	}
+      note_intensity (band->an, p, dphi,
+		      band->cut_ratio, band->rel_cut_ratio,
+		      band->i0, band->i1, band->t0, band->vel);
+    }
+  WAON_STATS_LAP (stats, WAON_STAT_NOTES, &t);
+
+  band->icnt ++;
+}
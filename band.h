@@ -0,0 +1,140 @@
+/* header file for band.c --
+ * spectrum analysis of one frequency band (FFT length and note range)
+ * Copyright (C) 1998-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_BAND_H_
+#define	_BAND_H_
+
+/* FFTW library  */
+#ifdef FFTW2
+#include <rfftw.h>
+#else // FFTW3
+#include <fftw3.h>
+#endif // FFTW2
+
+#include "fft.h" // struct harmonic_remover
+#include "analyse.h" // struct WAON_analyse
+#include "stats.h" // struct WAON_stats
+
+/* WAON_FLOAT : the FFT is done in single precision by fftwf
+ *              (the power spectrum and the later stages are in double)
+ */
+#if defined(WAON_FLOAT) && defined(FFTW2)
+#error "WAON_FLOAT is only supported with FFTW3"
+#endif
+
+
+struct WAON_band {
+  long len; // FFT length
+  long hop; // hop size between two analyses of this band
+
+  // note range handled by this band
+  int notelow;
+  int notetop;
+
+  int flag_window;
+  int flag_phase; // 1 = use the phase correction
+  int flag_fast_phase; // 1 = approximate atan2() for the phase (1.2e-5 rad)
+
+  double samplerate;
+  double t0;  // time-period for FFT (inverse of smallest frequency)
+  double den; // weight of window function for FFT
+  double *win; // window function [len]
+  int i0, i1; // range of FFT index to search notes
+
+  // parameters for the note selection (set them after init)
+  double cut_ratio;
+  double rel_cut_ratio;
+  int psub_n;
+  double psub_f;
+  double oct_f;   // factor for the octave removal
+  double harm3_f; // factor for the 3rd harmonic removal
+  double harm5_f; // factor for the 5th harmonic removal
+  double flux_th; // threshold of the spectral flux to pick up notes again
+                  // (0 == pick up notes at every step)
+  double silence; // peak amplitude at or below which the step is silent
+  const struct WAON_analyse *an; // cutoff mode and patch (shared, not owned)
+  struct WAON_stats *stats; // timing of the stages (NULL == off, not owned)
+
+#ifdef WAON_FLOAT
+  float *x; // wave data for FFT
+  float *y; // spectrum data for FFT
+  fftwf_plan plan;
+#else // !WAON_FLOAT
+  double *x; // wave data for FFT
+  double *y; // spectrum data for FFT
+#ifdef FFTW2
+  rfftw_plan plan;
+#else // FFTW3
+  fftw_plan plan;
+#endif // FFTW2
+#endif // WAON_FLOAT
+
+  double *p;    // power spectrum
+  double *p0;   // power spectrum at the last step
+  double *dphi; // freq correction by the phase difference
+  double *ph0;  // phase at the last step
+  double *ph1;  // phase at the current step
+  double *ave;  // work area for the drum-removal
+  struct harmonic_remover *harm; // for the octave removal (made at 1st use)
+  double *p_ref; // power spectrum at the last step where notes were picked
+
+  int icnt; // number of steps analysed since the start or the last silence
+
+  char vel[128]; // velocity at the last analysed step
+};
+
+
+/* initialize struct WAON_band
+ * INPUT
+ *  len              : FFT length
+ *  hop              : hop size between two analyses (used for the phase
+ *                     correction)
+ *  samplerate       :
+ *  notelow, notetop : note range to analyse
+ *  flag_window      : window type
+ *  flag_phase       : 0 == no phase correction
+ * OUTPUT
+ *  returned value : struct WAON_band, where the note selection parameters
+ *                   cut_ratio etc. are set to the defaults of waon,
+ *                   except for band->an, which should be set before
+ *                   WAON_band_analyse().
+ */
+struct WAON_band *
+WAON_band_init (long len, long hop, double samplerate,
+		int notelow, int notetop,
+		int flag_window, int flag_phase);
+
+void
+WAON_band_free (struct WAON_band *band);
+
+/* analyse one step (stages 1 and 2)
+ * INPUT
+ *  left [band->len], right [band->len] : wave data of the step
+ *  channels : 1 (mono, right[] is not referred) or 2 (stereo)
+ * OUTPUT
+ *  band->vel [128] : velocity at this step, which is kept from the last
+ *                    step if the spectral flux is below band->flux_th
+ *                    and is zero for the silent step
+ */
+void
+WAON_band_analyse (struct WAON_band *band,
+		   const double *left, const double *right,
+		   int channels);
+
+
+#endif /* !_BAND_H_ */
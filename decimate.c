@@ -0,0 +1,231 @@
+/* decimation of the input before the analysis
+ * Copyright (C) 1998-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <math.h>
+#include <stdio.h> /* fprintf()  */
+#include <stdlib.h> /* malloc(), free()  */
+#include <string.h> /* memmove()  */
+#include <sndfile.h>
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+/* FFTW library  */
+#ifdef FFTW2
+#include <rfftw.h>
+#else // FFTW3
+#include <fftw3.h>
+#endif // FFTW2
+
+#include "fft.h" // blackman()
+#include "snd.h" // sndfile_read()
+
+#include "decimate.h"
+
+
+/* the highest frequency to analyse should be below this ratio
+ * of the nyquist frequency after the decimation,
+ * where the rest is the transition band of the filter */
+#define DECIMATE_PASS 0.8
+
+
+/* decide the decimation factor for the analysis
+ * INPUT
+ *  samplerate : of the input
+ *  freq_top   : highest frequency to analyse [Hz]
+ *  len, hop   : FFT length and hop size, which should be divisible
+ *               by the factor
+ * OUTPUT
+ *  returned value : decimation factor (a power of 2, 1 == no decimation)
+ */
+int
+WAON_decimate_factor (double samplerate, double freq_top,
+		      long len, long hop)
+{
+  int factor = 1;
+  for (;;)
+    {
+      int f2 = factor * 2;
+      if (freq_top > DECIMATE_PASS * 0.5 * samplerate / (double)f2) break;
+      if (len % f2 != 0 || hop % f2 != 0) break;
+      factor = f2;
+    }
+  return (factor);
+}
+
+/* initialize struct WAON_decimate
+ * INPUT
+ *  factor     : decimation factor given by WAON_decimate_factor()
+ *  samplerate : of the input
+ *  freq_top   : highest frequency to analyse [Hz]
+ *  sf, sfinfo : input file, which is read from the current position
+ */
+struct WAON_decimate *
+WAON_decimate_init (int factor, double samplerate, double freq_top,
+		    SNDFILE *sf, SF_INFO *sfinfo)
+{
+  struct WAON_decimate *dec
+    = (struct WAON_decimate *)malloc (sizeof (struct WAON_decimate));
+  CHECK_MALLOC (dec, "WAON_decimate_init");
+
+  dec->sf = sf;
+  dec->sfinfo = sfinfo;
+  dec->factor = factor;
+
+  /* the filter is the windowed sinc with the cut-off at the new nyquist
+   * frequency. the transition band of the blackman window is about
+   * 5.5 / ntaps (in the unit of the input samplerate), which should be
+   * within (samplerate / factor - 2 freq_top) so that the aliases
+   * do not come below freq_top.
+   */
+  double df = (samplerate / (double)factor - 2.0 * freq_top) / samplerate;
+  int n = (int)(5.5 / df) + 1;
+  dec->nhalf = (n + 2 * factor - 1) / (2 * factor);
+  dec->ntaps = 2 * dec->nhalf * factor + 1;
+
+  dec->h = (double *)malloc (sizeof (double) * dec->ntaps);
+  CHECK_MALLOC (dec->h, "WAON_decimate_init");
+  int i;
+  double sum = 0.0;
+  for (i = 0; i < dec->ntaps; i ++)
+    {
+      double x = (double)(i - dec->nhalf * factor) / (double)factor;
+      if (x == 0.0)
+	{
+	  dec->h [i] = 1.0;
+	}
+      else
+	{
+	  dec->h [i] = sin (M_PI * x) / (M_PI * x);
+	}
+      dec->h [i] *= blackman (i + 1, dec->ntaps + 2);
+      sum += dec->h [i];
+    }
+  // normalize for the unit gain at DC
+  for (i = 0; i < dec->ntaps; i ++)
+    {
+      dec->h [i] /= sum;
+    }
+
+  dec->nbuf = dec->ntaps - 1;
+  dec->l_buf = (double *)malloc (sizeof (double) * dec->nbuf);
+  dec->r_buf = (double *)malloc (sizeof (double) * dec->nbuf);
+  dec->s_buf = (double *)malloc (sizeof (double) * dec->nbuf
+				 * dec->sfinfo->channels);
+  CHECK_MALLOC (dec->l_buf, "WAON_decimate_init");
+  CHECK_MALLOC (dec->r_buf, "WAON_decimate_init");
+  CHECK_MALLOC (dec->s_buf, "WAON_decimate_init");
+
+  /* the first half of the filter is zero (before the start of the input)
+   * and the second half is read in advance,
+   * so that the filter is centered at the first sample */
+  int nh = dec->nhalf * factor;
+  for (i = 0; i < dec->nbuf; i ++)
+    {
+      dec->l_buf [i] = 0.0;
+      dec->r_buf [i] = 0.0;
+    }
+  sndfile_read (dec->sf, *(dec->sfinfo),
+		dec->l_buf + nh, dec->r_buf + nh,
+		nh, dec->s_buf);
+
+  return (dec);
+}
+
+void
+WAON_decimate_free (struct WAON_decimate *dec)
+{
+  if (dec == NULL) return;
+  if (dec->h != NULL) free (dec->h);
+  if (dec->l_buf != NULL) free (dec->l_buf);
+  if (dec->r_buf != NULL) free (dec->r_buf);
+  if (dec->s_buf != NULL) free (dec->s_buf);
+  free (dec);
+}
+
+/* read len samples at the decimated rate,
+ * where the timing is the same as the input (no delay by the filter).
+ * INPUT
+ *  len : number of samples at the decimated rate
+ * OUTPUT
+ *  left [len], right [len] : decimated data
+ *                            (right[] is not referred for mono input)
+ *  returned value : number of samples read, as sndfile_read()
+ */
+long
+WAON_decimate_read (struct WAON_decimate *dec,
+		    double *left, double *right,
+		    int len)
+{
+  int factor = dec->factor;
+  int ncarry = dec->ntaps - 1;
+  int nread = len * factor;
+  int stereo = (dec->sfinfo->channels == 2);
+  int i, j;
+
+  if (ncarry + nread > dec->nbuf)
+    {
+      dec->nbuf = ncarry + nread;
+      dec->l_buf = (double *)realloc (dec->l_buf, sizeof (double) * dec->nbuf);
+      dec->r_buf = (double *)realloc (dec->r_buf, sizeof (double) * dec->nbuf);
+      dec->s_buf = (double *)realloc (dec->s_buf, sizeof (double)
+				      * dec->nbuf * dec->sfinfo->channels);
+      CHECK_MALLOC (dec->l_buf, "WAON_decimate_read");
+      CHECK_MALLOC (dec->r_buf, "WAON_decimate_read");
+      CHECK_MALLOC (dec->s_buf, "WAON_decimate_read");
+    }
+
+  long status = sndfile_read (dec->sf, *(dec->sfinfo),
+			      dec->l_buf + ncarry, dec->r_buf + ncarry,
+			      nread, dec->s_buf);
+  if (status < 0) status = 0;
+  for (i = ncarry + status; i < ncarry + nread; i ++)
+    {
+      dec->l_buf [i] = 0.0;
+      dec->r_buf [i] = 0.0;
+    }
+
+  // filter at every factor-th sample
+  for (i = 0; i < len; i ++)
+    {
+      const double *l = dec->l_buf + i * factor;
+      const double *r = dec->r_buf + i * factor;
+      double lsum = 0.0;
+      double rsum = 0.0;
+      for (j = 0; j < dec->ntaps; j ++)
+	{
+	  lsum += dec->h [j] * l [j];
+	}
+      left [i] = lsum;
+      if (stereo)
+	{
+	  for (j = 0; j < dec->ntaps; j ++)
+	    {
+	      rsum += dec->h [j] * r [j];
+	    }
+	  right [i] = rsum;
+	}
+    }
+
+  // carry over the last (ntaps - 1) samples
+  memmove (dec->l_buf, dec->l_buf + nread, sizeof (double) * ncarry);
+  if (stereo)
+    {
+      memmove (dec->r_buf, dec->r_buf + nread, sizeof (double) * ncarry);
+    }
+
+  return (status / factor);
+}
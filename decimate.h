@@ -0,0 +1,86 @@
+/* header file for decimate.c --
+ * decimation of the input before the analysis
+ * Copyright (C) 1998-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_DECIMATE_H_
+#define	_DECIMATE_H_
+
+#include <sndfile.h>
+
+
+struct WAON_decimate {
+  // input (just reference purpose only)
+  SNDFILE *sf;
+  SF_INFO *sfinfo;
+
+  int factor; // decimation factor
+  int nhalf;  // half length of the filter in the output samples
+  int ntaps;  // = 2 * nhalf * factor + 1
+  double *h;  // low-pass filter h[ntaps]
+
+  /* input buffers, where the first (ntaps - 1) samples are
+   * carried over from the last call */
+  int nbuf;
+  double *l_buf;
+  double *r_buf;
+  double *s_buf; // [nbuf * channels] interleaved data of sndfile_read()
+};
+
+
+/* decide the decimation factor for the analysis
+ * INPUT
+ *  samplerate : of the input
+ *  freq_top   : highest frequency to analyse [Hz]
+ *  len, hop   : FFT length and hop size, which should be divisible
+ *               by the factor
+ * OUTPUT
+ *  returned value : decimation factor (a power of 2, 1 == no decimation)
+ */
+int
+WAON_decimate_factor (double samplerate, double freq_top,
+		      long len, long hop);
+
+/* initialize struct WAON_decimate
+ * INPUT
+ *  factor     : decimation factor given by WAON_decimate_factor()
+ *  samplerate : of the input
+ *  freq_top   : highest frequency to analyse [Hz]
+ *  sf, sfinfo : input file, which is read from the current position
+ */
+struct WAON_decimate *
+WAON_decimate_init (int factor, double samplerate, double freq_top,
+		    SNDFILE *sf, SF_INFO *sfinfo);
+
+void
+WAON_decimate_free (struct WAON_decimate *dec);
+
+/* read len samples at the decimated rate,
+ * where the timing is the same as the input (no delay by the filter).
+ * INPUT
+ *  len : number of samples at the decimated rate
+ * OUTPUT
+ *  left [len], right [len] : decimated data
+ *                            (right[] is not referred for mono input)
+ *  returned value : number of samples read, as sndfile_read()
+ */
+long
+WAON_decimate_read (struct WAON_decimate *dec,
+		    double *left, double *right,
+		    int len);
+
+
+#endif /* !_DECIMATE_H_ */
@@ -30,6 +30,7 @@
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 #include "hc.h" // HC_to_amp2()
+#include "fft.h" // struct harmonic_remover
 
 
 /* Reference: "Numerical Recipes in C" 2nd Ed.
@@ -138,6 +139,108 @@ windowing (int n, const double *data, int flag_window, double scale,
     }
 }
 
+/* single-precision version of windowing()
+ * INPUT
+ *  flag_window : window type as windowing()
+ */
+void
+windowing_f (int n, const float *data, int flag_window, double scale,
+	     float *out)
+{
+  int i;
+  for (i = 0; i < n; i ++)
+    {
+      switch (flag_window)
+	{
+	case 1: // parzen window
+	  out [i] = data [i] * (float)(parzen (i, n) / scale);
+	  break;
+
+	case 2: // welch window
+	  out [i] = data [i] * (float)(welch (i, n) / scale);
+	  break;
+
+	case 3: // hanning window
+	  out [i] = data [i] * (float)(hanning (i, n) / scale);
+	  break;
+
+	case 4: // hamming window
+	  out [i] = data [i] * (float)(hamming (i, n) / scale);
+	  break;
+
+	case 5: // blackman window
+	  out [i] = data [i] * (float)(blackman (i, n) / scale);
+	  break;
+
+	case 6: // steeper 30-dB/octave rolloff window
+	  out [i] = data [i] * (float)(steeper (i, n) / scale);
+	  break;
+
+	default:
+	  fprintf (stderr, "invalid flag_window\n");
+	case 0: // square (no window)
+	  out [i] = data [i] / (float)scale;
+	  break;
+	}
+    }
+}
+
+/* prepare the table of the window function, so that the window is
+ * applied by a multiplication (together with other operations such as
+ * the mixdown) instead of calling windowing() at every frame.
+ * INPUT
+ *  n : # of samples
+ *  flag_window : 0 : no-window (default -- that is, other than 1 ~ 6)
+ *                1 : parzen window
+ *                2 : welch window
+ *                3 : hanning window
+ *                4 : hamming window
+ *                5 : blackman window
+ *                6 : steeper 30-dB/octave rolloff window
+ * OUTPUT
+ *  w[n] : window function
+ */
+void
+init_window (int n, int flag_window, double *w)
+{
+  int i;
+  for (i = 0; i < n; i ++)
+    {
+      switch (flag_window)
+	{
+	case 1: // parzen window
+	  w [i] = parzen (i, n);
+	  break;
+
+	case 2: // welch window
+	  w [i] = welch (i, n);
+	  break;
+
+	case 3: // hanning window
+	  w [i] = hanning (i, n);
+	  break;
+
+	case 4: // hamming window
+	  w [i] = hamming (i, n);
+	  break;
+
+	case 5: // blackman window
+	  w [i] = blackman (i, n);
+	  break;
+
+	case 6: // steeper 30-dB/octave rolloff window
+	  w [i] = steeper (i, n);
+	  break;
+
+	default:
+	  fprintf (stderr, "invalid flag_window\n");
+	case 0: // square (no window)
+	  w [i] = 1.0;
+	  break;
+	}
+    }
+}
+
 void
 fprint_window_name (FILE *out, int flag_window)
 {
@@ -316,6 +419,8 @@ power_spectrum_fftw (int n, double *x, double *y, double *p,
 
 /* subtract average from the power spectrum
  * -- intend to remove non-tonal signal (such as drums, percussions)
+ * the average is taken by the running sum over the window,
+ * so that the cost does not depend on m.
  * INPUT
  *  n : FFT size
  *  p[(n+1)/2] : power spectrum
@@ -324,44 +429,46 @@ power_spectrum_fftw (int n, double *x, double *y, double *p,
  *           (factor = 0.0) means no subtraction
  *           (factor = 1.0) means full subtraction of the average
  *           (factor = 2.0) means over subtraction
+ *  ave[n/2+1] : work area (allocated by the caller)
  * OUTPUT
  *  p[(n+1)/2] : subtracted power spectrum
  */
 void
-power_subtract_ave (int n, double *p, int m, double factor)
+power_subtract_ave (int n, double *p, int m, double factor,
+		    double *ave)
 {
   int nlen = n/2+1;
   int i;
-  int k;
+  double sum;
   int nave;
 
-  static double *ave = NULL;
-  static int n_ave = 0;
-  if (ave == NULL)
+  // the window for i = 0 is [0, m]
+  sum = 0.0;
+  nave = 0;
+  for (i = 0; i <= m && i < nlen; i ++)
     {
-      ave = (double *)malloc (sizeof (double) * nlen);
-      CHECK_MALLOC (ave, "power_subtract_ave");
-      n_ave = nlen;
+      sum += p [i];
+      nave ++;
     }
-  else if (n_ave < nlen)
-    {
-      ave = (double *)realloc (ave, sizeof (double) * nlen);
-      CHECK_MALLOC (ave, "power_subtract_ave");
-      n_ave = nlen;
-    }
-
   for (i = 0; i < nlen; i ++) // full span
     {
-      ave [i] = 0.0;
-      nave = 0;
-      for (k = -m; k <= m; k ++)
+      if (i > 0)
 	{
-	  if ((i + k) < 0 || (i + k) >= nlen) continue;
-
-	  ave [i] += p [i+k];
-	  nave ++;
+	  // slide the window [i-1-m, i-1+m] to [i-m, i+m]
+	  if (i + m < nlen)
+	    {
+	      sum += p [i+m];
+	      nave ++;
+	    }
+	  if (i - m - 1 >= 0)
+	    {
+	      sum -= p [i-m-1];
+	      nave --;
+	    }
 	}
-      if (nave > 0) ave [i] /= (double)nave;
+      ave [i] = sum / (double)nave;
+      // the round-off of the running sum could make it negative
+      if (ave [i] < 0.0) ave [i] = 0.0;
     }
 
   for (i = 0; i < nlen; i ++) // full span
@@ -370,60 +477,115 @@ power_subtract_ave (int n, double *p, int m, double factor)
       if (p [i] < 0.0) p [i] = 0.0;
       else             p [i] = p [i] * p [i];
     }
-
-  //free (ave);
 }
 
-/* octave remover
+/* initialize the harmonic remover, where the index map of the
+ * fundamental bin for each bin is prepared once for the FFT size.
+ * for the harmonic h, the power at the bin k is subtracted by
+ *   factor * sqrt (factor * p[k/h])       for (k % h) == 0,
+ *   factor * sqrt (0.5 * factor * p[j])   otherwise,
+ * where j is the nearest bin to k/h.
  * INPUT
  *  n : FFT size
- *  p[(n+1)/2] : power spectrum
- *  factor : factor * average is subtracted from the power
- *           (factor = 0.0) means no subtraction
- *           (factor = 1.0) means full subtraction of the average
- *           (factor = 2.0) means over subtraction
+ *  nh : number of harmonics
+ *  harm[nh] : harmonics (2 for the octave, 3 for the 12th, ...)
+ *  factor[nh] : factor for each harmonic
+ *               (factor = 0.0) means no subtraction
+ *               (factor = 1.0) means full subtraction
+ *               (factor = 2.0) means over subtraction
  * OUTPUT
- *  p[(n+1)/2] : subtracted power spectrum
+ *  returned value : struct harmonic_remover
  */
-void
-power_subtract_octave (int n, double *p, double factor)
+struct harmonic_remover *
+harmonic_remover_init (int n, int nh, const int *harm, const double *factor)
 {
   int nlen = (n+1)/2;
-  int i;
-  int i2;
+  int ih;
+  int k;
+
+  struct harmonic_remover *hr
+    = (struct harmonic_remover *)malloc (sizeof (struct harmonic_remover));
+  CHECK_MALLOC (hr, "harmonic_remover_init");
 
-  static double *oct = NULL;
-  static int n_oct = 0;
-  if (oct == NULL)
+  hr->n = n;
+  hr->nh = nh;
+  hr->src  = (int *)malloc (sizeof (int) * nh * nlen);
+  hr->coef = (double *)malloc (sizeof (double) * nh * nlen);
+  hr->sq   = (double *)malloc (sizeof (double) * nlen);
+  CHECK_MALLOC (hr->src,  "harmonic_remover_init");
+  CHECK_MALLOC (hr->coef, "harmonic_remover_init");
+  CHECK_MALLOC (hr->sq,   "harmonic_remover_init");
+
+  for (ih = 0; ih < nh; ih ++)
     {
-      oct = (double *)malloc (sizeof (double) * (n/2+1));
-      CHECK_MALLOC (oct, "power_subtract_octave");
-      n_oct = n/2+1;
+      int h = harm [ih];
+      int *src = hr->src + ih * nlen;
+      double *coef = hr->coef + ih * nlen;
+      for (k = 0; k < nlen; k ++)
+	{
+	  int j = (k + h/2) / h; // nearest bin to k/h
+	  src [k] = j;
+	  if (k == 0 || j == 0)
+	    {
+	      coef [k] = 0.0;
+	    }
+	  else if (j * h == k)
+	    {
+	      coef [k] = factor [ih] * sqrt (factor [ih]);
+	    }
+	  else
+	    {
+	      coef [k] = factor [ih] * sqrt (0.5 * factor [ih]);
+	    }
+	}
     }
-  else if (n_oct < (n/2+1))
+
+  return (hr);
+}
+
+void
+harmonic_remover_free (struct harmonic_remover *hr)
+{
+  if (hr == NULL) return;
+  if (hr->src  != NULL) free (hr->src);
+  if (hr->coef != NULL) free (hr->coef);
+  if (hr->sq   != NULL) free (hr->sq);
+  free (hr);
+}
+
+/* harmonic (octave) remover
+ * INPUT
+ *  hr : struct harmonic_remover for the FFT size
+ *  p[(n+1)/2] : power spectrum
+ * OUTPUT
+ *  p[(n+1)/2] : subtracted power spectrum
+ */
+void
+power_subtract_harmonics (struct harmonic_remover *hr, double *p)
+{
+  int nlen = (hr->n+1)/2;
+  double *sq = hr->sq;
+  int ih;
+  int k;
+
+  for (k = 0; k < nlen; k ++)
     {
-      oct = (double *)realloc (oct, sizeof (double) * (n/2+1));
-      CHECK_MALLOC (oct, "power_subtract_octave");
-      n_oct = n/2+1;
+      sq [k] = sqrt (p [k]);
+      p [k] = sq [k];
     }
 
-  oct [0] = p [0];
-  for (i = 1; i < nlen/2+1; i ++)
+  for (ih = 0; ih < hr->nh; ih ++)
     {
-      i2 = i * 2;
-      if (i2 >= n/2+1) break;
-
-      oct [i2] = factor * p[i];
-      if (i2-1 > 0)    oct [i2-1] = 0.5 * factor * p[i];
-      if (i2+1 < nlen) oct [i2+1] = 0.5 * factor * p[i];
+      const int *src = hr->src + ih * nlen;
+      const double *coef = hr->coef + ih * nlen;
+      for (k = 0; k < nlen; k ++)
+	{
+	  p [k] -= coef [k] * sq [src [k]];
+	}
     }
 
-  for (i = 0; i < nlen; i ++) // full span
+  for (k = 0; k < nlen; k ++)
     {
-      p [i] = sqrt (p[i]) - factor * sqrt (oct [i]);
-      if (p [i] < 0.0) p [i] = 0.0;
-      else             p [i] = p [i] * p [i];
+      p [k] = (p [k] < 0.0 ? 0.0 : p [k] * p [k]);
     }
-
-  //free (oct);
 }
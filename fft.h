@@ -40,6 +40,20 @@ double steeper (int i, int nn);
 void
 windowing (int n, const double *data, int flag_window, double scale,
 	   double *out);
+/* single-precision version of windowing() (for the vocoder in WAON_FLOAT) */
+void
+windowing_f (int n, const float *data, int flag_window, double scale,
+	     float *out);
+/* prepare the table of the window function
+ * INPUT
+ *  n : # of samples
+ *  flag_window : window type as windowing()
+ * OUTPUT
+ *  w[n] : window function
+ */
+void
+init_window (int n, int flag_window, double *w);
+
 void
 fprint_window_name (FILE *out, int flag_window);
 
@@ -115,6 +129,8 @@ power_spectrum_fftw (int n, double *x, double *y, double *p,
 
 /* subtract average from the power spectrum
  * -- intend to remove non-tonal signal (such as drums, percussions)
+ * the average is taken by the running sum over the window,
+ * so that the cost does not depend on m.
  * INPUT
  *  n : FFT size
  *  p[(n+1)/2] : power spectrum
@@ -123,25 +139,55 @@ power_spectrum_fftw (int n, double *x, double *y, double *p,
  *           (factor = 0.0) means no subtraction
  *           (factor = 1.0) means full subtraction of the average
  *           (factor = 2.0) means over subtraction
+ *  ave[n/2+1] : work area (allocated by the caller)
  * OUTPUT
  *  p[(n+1)/2] : subtracted power spectrum
  */
 void
-power_subtract_ave (int n, double *p, int m, double factor);
+power_subtract_ave (int n, double *p, int m, double factor,
+		    double *ave);
+
+/* harmonic (octave) remover */
+struct harmonic_remover {
+  int n;  // FFT size
+  int nh; // number of harmonics
+  int *src;     // src[nh * (n+1)/2] : bin of the fundamental for each bin
+  double *coef; // coef[nh * (n+1)/2] : factor for sqrt(p[src])
+  double *sq;   // work area for sqrt(p)
+};
 
-/* octave remover
+/* initialize the harmonic remover, where the index map of the
+ * fundamental bin for each bin is prepared once for the FFT size.
+ * for the harmonic h, the power at the bin k is subtracted by
+ *   factor * sqrt (factor * p[k/h])       for (k % h) == 0,
+ *   factor * sqrt (0.5 * factor * p[j])   otherwise,
+ * where j is the nearest bin to k/h.
  * INPUT
  *  n : FFT size
+ *  nh : number of harmonics
+ *  harm[nh] : harmonics (2 for the octave, 3 for the 12th, ...)
+ *  factor[nh] : factor for each harmonic
+ *               (factor = 0.0) means no subtraction
+ *               (factor = 1.0) means full subtraction
+ *               (factor = 2.0) means over subtraction
+ * OUTPUT
+ *  returned value : struct harmonic_remover
+ */
+struct harmonic_remover *
+harmonic_remover_init (int n, int nh, const int *harm, const double *factor);
+
+void
+harmonic_remover_free (struct harmonic_remover *hr);
+
+/* harmonic (octave) remover
+ * INPUT
+ *  hr : struct harmonic_remover for the FFT size
  *  p[(n+1)/2] : power spectrum
- *  factor : factor * average is subtracted from the power
- *           (factor = 0.0) means no subtraction
- *           (factor = 1.0) means full subtraction of the average
- *           (factor = 2.0) means over subtraction
  * OUTPUT
  *  p[(n+1)/2] : subtracted power spectrum
  */
 void
-power_subtract_octave (int n, double *p, double factor);
+power_subtract_harmonics (struct harmonic_remover *hr, double *p);
 
 
 #endif /* !_FFT_H_ */
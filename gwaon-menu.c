@@ -25,6 +25,7 @@
 
 #include "gwaon-about.h" /* create_about() */
 #include "gwaon-wav.h" /* create_wav() */
+#include "pv-prefetch.h" /* pv_prefetch_free() */
 
 
 static void
@@ -44,17 +45,32 @@ on_file_open_wav_sel_ok (GtkWidget *widget, GtkFileSelection *fs)
 {
   extern SNDFILE *sf;
   extern SF_INFO sfinfo;
+  extern SNDFILE *sf_pv;
+  extern SF_INFO sfinfo_pv;
 
   gchar *filename =
     (gchar *) gtk_file_selection_get_filename (GTK_FILE_SELECTION (fs));
   g_print ("%s\n", filename);
 
 
+  // stop the playback thread reading sf_pv, if any
+  extern struct pv_prefetch *pv_prefetch;
+  if (pv_prefetch != NULL)
+    {
+      pv_prefetch_free (pv_prefetch);
+      pv_prefetch = NULL;
+    }
+
   // close sf first, if sf is open
   if (sf != NULL)
     {
       sf_close (sf);
     }
+  if (sf_pv != NULL)
+    {
+      sf_close (sf_pv);
+      sf_pv = NULL;
+    }
 
   // open the file
   memset (&sfinfo, 0, sizeof (sfinfo));
@@ -64,6 +80,15 @@ on_file_open_wav_sel_ok (GtkWidget *widget, GtkFileSelection *fs)
       g_print ("fail to open %s\n", filename);
       return;
     }
+  memset (&sfinfo_pv, 0, sizeof (sfinfo_pv));
+  sf_pv = sf_open (filename, SFM_READ, &sfinfo_pv);
+  if (sf_pv == NULL)
+    {
+      g_print ("fail to open %s\n", filename);
+      sf_close (sf);
+      sf = NULL;
+      return;
+    }
 
   g_print ("channels = %d\n", sfinfo.channels);
   g_print ("samplerate = %d\n", sfinfo.samplerate);
@@ -25,41 +25,42 @@
 
 // ao sound device
 #include <ao/ao.h>
+#include "ao-wrapper.h" // struct ao_out
 
-#include "pv-complex.h" // struct pv_complex, pv_complex_play_step()
+#include "pv-complex.h" // struct pv_complex
+#include "pv-prefetch.h" // struct pv_prefetch
 #include "gwaon-wav.h" // draw_play_indicator()
 
 
 // global variables
-ao_device *ao = NULL;
+struct ao_out *ao = NULL;
 
 long play_cur; // current frame to play
 int flag_play; // status: 0 = not playing, 1 = playing
 gint tag_play; // for timeout callback
 
 /* rate and pitch are taken care at wav_pv_rate() and wav_pv_pitch 
- * in gwaon-wav.c by pv_complex_change_rate_pitch() through 
- * struct pv_complex *pv.
+ * in gwaon-wav.c by pv_prefetch_set_rate_pitch() through 
+ * struct pv_prefetch *pv_prefetch.
  */
 double pv_rate;  // time-scaling rate (0 = stop, 1 = normal, -1 = backward)
 double pv_pitch; // pitch-shift
 
 struct pv_complex *pv = NULL; // initialized in create_wav()
+struct pv_prefetch *pv_prefetch = NULL; // initialized in create_wav()
 
 
-/* play 100 milisecond and return
+/* update the loop range of the playback and the indicator every
+ * 100 milisecond, where the phase vocoder itself runs in the threads of
+ * struct pv_prefetch (see create_wav())
  */
 gint
 play_100msec (gpointer data)
 {
   extern struct pv_complex *pv;
+  extern struct pv_prefetch *pv_prefetch;
   extern long play_cur;
 
-  long len_100msec = (long)(0.1 /* sec */ * pv->sfinfo->samplerate /* Hz */);
-
-  // draw indicator
-  draw_play_indicator ((GtkWidget *)data);
-
   extern int WIN_wav_cur;
   extern int WIN_wav_scale;
   extern int WIN_wav_width;
@@ -68,40 +69,13 @@ play_100msec (gpointer data)
   frame0 = (long) WIN_wav_cur;
   frame1 = frame0 + (long)(WIN_wav_scale * WIN_wav_width) - 1;
   if (frame1 >= pv->sfinfo->frames) frame1 = (long)pv->sfinfo->frames - 1;
-  if (play_cur < frame0) play_cur = frame0;
-  if (play_cur >= frame1) play_cur = frame1;
-
-
-  long l;
-  for (l = 0; l < len_100msec; l += pv->hop_syn)
-    {
-      long len_play = pv_complex_play_step (pv, play_cur);
-      if (len_play < pv->hop_res)
-	{
-	  flag_play = 0; // stop playing
-	  // rewind
-	  if (pv->hop_ana >= 0.0) play_cur = frame0;
-	  else                    play_cur = frame1;
+  pv_prefetch_set_range (pv_prefetch, frame0, frame1);
 
-	  // if FAIL is returned, this timeout is removed
-	  return FALSE;
-	}
+  // the frame heard now, rather than the one rendered
+  play_cur = pv_prefetch_get_cur (pv_prefetch);
 
-      // increment play_cur
-      play_cur += pv->hop_ana;
+  // draw indicator
+  draw_play_indicator ((GtkWidget *)data);
 
-      // check the boundary
-      if (play_cur < frame0 ||
-	  play_cur + pv->hop_ana >= frame1)
-	{
-	  // rewind
-	  if (pv->hop_ana >= 0.0) play_cur = frame0;
-	  else                    play_cur = frame1;
-	}
-    }
   return TRUE;
 }
-
-
-
-
@@ -20,7 +20,11 @@
 #define	_GWAON_PLAY_H_
 
 
-/* play 100 milisecond and return
+/* length of the playback rendered ahead by struct pv_prefetch */
+#define PLAY_PREFETCH_MSEC (300.0)
+
+/* update the loop range of the playback and the indicator
+ * (timeout callback every 100 milisecond)
  */
 gint
 play_100msec (gpointer data);
@@ -39,6 +39,7 @@
 #include "ao-wrapper.h"
 
 #include "pv-complex.h" // struct pv_complex
+#include "pv-prefetch.h" // struct pv_prefetch
 #include "gtk-color.h" /* get_color() */
 #include "memory-check.h" // CHECK_MALLOC() macro
 
@@ -60,6 +61,9 @@ GdkPixbuf *wav_pixbuf = NULL;
 
 
 int WIN_spec_n;
+/* the FFT length of the playback is changed with WIN_spec_n
+ * in the range from WIN_spec_n/8 to WIN_spec_n*8 at the start */
+#define WIN_PV_LEN_RANGE (8)
 int WIN_spec_hop_scale;
 int WIN_spec_hop;
 int WIN_spec_mode;
@@ -144,7 +148,7 @@ draw_wav_frame (GtkWidget *widget,
 	{
 	  left [i] = right [i] = 0.0;
 	}
-      sndfile_read_at (sf, sfinfo, cur_read, left, right, len);
+      sndfile_read_at (sf, sfinfo, cur_read, left, right, len, NULL);
 
 
       int iarray = 0;
@@ -173,7 +177,7 @@ draw_wav_frame (GtkWidget *widget,
 	      // read next frame
 	      cur_read += iarray;
 	      for (k = 0; k < len; k ++) left [k] = right [k] = 0.0;
-	      sndfile_read_at (sf, sfinfo, cur_read, left, right, len);
+	      sndfile_read_at (sf, sfinfo, cur_read, left, right, len, NULL);
 	      // reset iarray
 	      iarray = 0;
 	    }
@@ -200,7 +204,7 @@ draw_wav_frame (GtkWidget *widget,
 		  // read next frame
 		  cur_read += iarray;
 		  for (k = 0; k < len; k ++) left [k] = right [k] = 0.0;
-		  sndfile_read_at (sf, sfinfo, cur_read, left, right, len);
+		  sndfile_read_at (sf, sfinfo, cur_read, left, right, len, NULL);
 		  // reset iarray
 		  iarray = 0;
 		}
@@ -692,24 +696,26 @@ fft_one_frame (int i,
 
   int k;
 
-  // read data
-  for (k = 0; k < WIN_spec_n; k ++)
-    {
-      spec_left [k] = spec_right [k] = 0.0;
-    }
-  sndfile_read_at (sf, sfinfo,
-		   i,
-		   spec_left, spec_right,
-		   WIN_spec_n);
-
   if (r_amp2 == NULL)
     {
-      // left + right
-      for (k = 0; k < WIN_spec_n; k ++)
+      // table of the window function
+      static double *win = NULL;
+      static int win_n = 0;
+      static int win_flag = -1;
+      if (win_n != WIN_spec_n || win_flag != flag_window)
 	{
-	  spec_in [k] = 0.5 * (spec_left [k] + spec_right [k]);
+	  win = (double *)realloc (win, sizeof (double) * WIN_spec_n);
+	  CHECK_MALLOC (win, "fft_one_frame");
+	  init_window (WIN_spec_n, flag_window, win);
+	  win_n = WIN_spec_n;
+	  win_flag = flag_window;
 	}
-      windowing (WIN_spec_n, spec_in, flag_window, 1.0, spec_in);
+
+      // left + right, read with the window directly into spec_in[]
+      sndfile_read_mix_at (sf, sfinfo,
+			   i, win,
+			   spec_in,
+			   WIN_spec_n, NULL);
       fftw_execute (plan); // FFT: spec_in[] -> spec_out[]
       if (l_ph == NULL)
 	{
@@ -724,6 +730,16 @@ fft_one_frame (int i,
     }
   else
     {
+      // read data
+      for (k = 0; k < WIN_spec_n; k ++)
+	{
+	  spec_left [k] = spec_right [k] = 0.0;
+	}
+      sndfile_read_at (sf, sfinfo,
+		       i,
+		       spec_left, spec_right,
+		       WIN_spec_n, NULL);
+
       // left
       windowing (WIN_spec_n, spec_left, flag_window, 1.0, spec_in);
       fftw_execute (plan); // FFT: spec_in[] -> spec_out[]
@@ -789,8 +805,7 @@ fft_two_frames (int i, int hop,
       // left
       dphi = l_ph1[i] - l_ph[i]
 	- twopi * (double)i / (double)WIN_spec_n * (double)hop;
-      for (; dphi >= M_PI; dphi -= twopi);
-      for (; dphi < -M_PI; dphi += twopi);
+      dphi = principal_argument (dphi);
       l_dphi [i] = dphi / twopi / (double)hop;
 
       // right
@@ -798,8 +813,7 @@ fft_two_frames (int i, int hop,
 	{
 	  dphi = r_ph1[i] - r_ph[i]
 	    - twopi * (double)i / (double)WIN_spec_n * (double)hop;
-	  for (; dphi >= M_PI; dphi -= twopi);
-	  for (; dphi < -M_PI; dphi += twopi);
+	  dphi = principal_argument (dphi);
 	  r_dphi [i] = dphi / twopi / (double)hop;
 	}
     }
@@ -1902,11 +1916,18 @@ WIN_spec_n_update (void)
   extern int WIN_spec_hop;
   WIN_spec_hop = WIN_spec_n / WIN_spec_hop_scale;
 
-  // hop_res and hop_ana depend on hop_syn ( = WIN_spec_hop)
+  /* swap the plans of the playback in the pool,
+   * where the len out of the pool is kept */
   extern struct pv_complex *pv;
+  extern struct pv_prefetch *pv_prefetch;
+  pv_prefetch_lock (pv_prefetch);
+  pv_complex_change_len (pv, WIN_spec_n);
+
+  // hop_res and hop_ana depend on hop_syn ( = WIN_spec_hop)
   extern double pv_rate;
   extern double pv_pitch;
   pv_complex_change_rate_pitch (pv, pv_rate, pv_pitch);
+  pv_prefetch_unlock (pv_prefetch);
 }
 
 static gint
@@ -1958,10 +1979,10 @@ b_hop_up_press_event (GtkWidget *widget, gpointer data)
   WIN_spec_hop = WIN_spec_n / WIN_spec_hop_scale;
 
   // hop_res and hop_ana depend on hop_syn ( = WIN_spec_hop)
-  extern struct pv_complex *pv;
+  extern struct pv_prefetch *pv_prefetch;
   extern double pv_rate;
   extern double pv_pitch;
-  pv_complex_change_rate_pitch (pv, pv_rate, pv_pitch);
+  pv_prefetch_set_rate_pitch (pv_prefetch, pv_rate, pv_pitch);
 
   //update_win_wav (widget,
   update_win_wav (GTK_WIDGET (data),
@@ -1982,10 +2003,10 @@ b_hop_down_press_event (GtkWidget *widget, gpointer data)
   WIN_spec_hop = WIN_spec_n / WIN_spec_hop_scale;
 
   // hop_res and hop_ana depend on hop_syn ( = WIN_spec_hop)
-  extern struct pv_complex *pv;
+  extern struct pv_prefetch *pv_prefetch;
   extern double pv_rate;
   extern double pv_pitch;
-  pv_complex_change_rate_pitch (pv, pv_rate, pv_pitch);
+  pv_prefetch_set_rate_pitch (pv_prefetch, pv_rate, pv_pitch);
 
   //update_win_wav (widget,
   update_win_wav (GTK_WIDGET (data),
@@ -2069,7 +2090,9 @@ static gint
 b_lock_press_event (GtkWidget *widget, gpointer data)
 {
   extern struct pv_complex *pv;
+  extern struct pv_prefetch *pv_prefetch;
 
+  pv_prefetch_lock (pv_prefetch);
   if (pv->flag_lock == 0)
     {
       pv->flag_lock = 1;
@@ -2078,6 +2101,7 @@ b_lock_press_event (GtkWidget *widget, gpointer data)
     {
       pv->flag_lock = 0;
     }
+  pv_prefetch_unlock (pv_prefetch);
   
   return TRUE;
 }
@@ -2087,15 +2111,18 @@ b_play_press_event (GtkWidget *widget, gpointer data)
 {
   extern int flag_play;
   extern gint tag_play;
+  extern struct pv_prefetch *pv_prefetch;
   flag_play ++;
   if (flag_play > 1)
     {
       flag_play = 0;
+      pv_prefetch_play (pv_prefetch, 0);
       // gtk_timeout_remove is deprecated
       g_source_remove (tag_play);
     }
   else
     {
+      pv_prefetch_play (pv_prefetch, 1);
       // gtk_timeout_add is deprecated
       tag_play = g_timeout_add (100, // miliseconds
 				play_100msec, widget);
@@ -2415,9 +2442,9 @@ wav_pv_rate (GtkAdjustment *get, GtkAdjustment *set)
   extern double pv_rate;
   pv_rate = get->value;
 
-  extern struct pv_complex *pv;
+  extern struct pv_prefetch *pv_prefetch;
   extern double pv_pitch;
-  pv_complex_change_rate_pitch (pv, pv_rate, pv_pitch);
+  pv_prefetch_set_rate_pitch (pv_prefetch, pv_rate, pv_pitch);
 }
 
 static void
@@ -2426,9 +2453,9 @@ wav_pv_pitch (GtkAdjustment *get, GtkAdjustment *set)
   extern double pv_pitch;
   pv_pitch = get->value;
 
-  extern struct pv_complex *pv;
+  extern struct pv_prefetch *pv_prefetch;
   extern double pv_rate;
-  pv_complex_change_rate_pitch (pv, pv_rate, pv_pitch);
+  pv_prefetch_set_rate_pitch (pv_prefetch, pv_rate, pv_pitch);
 }
 
 
@@ -2495,6 +2522,14 @@ wav_delete (GtkWidget *widget,
       g_source_remove (tag_play);
     }
 
+  // stop the threads before pv and ao are closed
+  extern struct pv_prefetch *pv_prefetch;
+  if (pv_prefetch != NULL)
+    {
+      pv_prefetch_free (pv_prefetch);
+      pv_prefetch = NULL;
+    }
+
   extern struct pv_complex *pv;
   if (pv != NULL)
     {
@@ -2509,12 +2544,18 @@ wav_delete (GtkWidget *widget,
       sf_close (sf);
       sf = NULL;
     }
+  extern SNDFILE *sf_pv;
+  if (sf_pv != NULL)
+    {
+      sf_close (sf_pv);
+      sf_pv = NULL;
+    }
 
   // ao device
-  extern ao_device *ao;
+  extern struct ao_out *ao;
   if (ao != NULL)
     {
-      ao_close (ao);
+      ao_out_close (ao);
       ao = NULL;
     }
 
@@ -2558,10 +2599,17 @@ create_wav (void)
 
   extern SNDFILE *sf;
   extern SF_INFO sfinfo;
+  extern SNDFILE *sf_pv;
+  extern SF_INFO sfinfo_pv;
 
   extern struct pv_complex *pv;
-  pv = pv_complex_init (WIN_spec_n, WIN_spec_hop, 3 /* hanning */);
-  pv_complex_set_input (pv, sf, &sfinfo);
+  // the FFT length of the playback follows WIN_spec_n in the pool
+  pv = pv_complex_init_pool (WIN_spec_n,
+			     WIN_spec_n / WIN_PV_LEN_RANGE,
+			     WIN_spec_n * WIN_PV_LEN_RANGE,
+			     WIN_spec_hop, 3 /* hanning */);
+  // the own handle, as the producer thread reads it during the drawing
+  pv_complex_set_input (pv, sf_pv, &sfinfo_pv);
 
 
   extern double *spec_in;
@@ -2612,9 +2660,11 @@ create_wav (void)
   logf_max = midi_to_logf ((oct_max+1)*12);
 
 
-  extern ao_device *ao;
-  ao = ao_init_16_stereo (sfinfo.samplerate, 0);
-  pv_complex_set_output_ao (pv, ao);
+  extern struct ao_out *ao;
+  ao = ao_out_open (sfinfo.samplerate, 0);
+  // pv is played by the threads through the ring (see play_100msec())
+  extern struct pv_prefetch *pv_prefetch;
+  pv_prefetch = pv_prefetch_init (pv, ao, PLAY_PREFETCH_MSEC);
 
 
   extern long play_cur;
@@ -2879,7 +2929,7 @@ create_wav (void)
                       (GtkSignalFunc) b_lock_press_event, wav_win);
 
 
-  pv_complex_change_rate_pitch (pv, pv_rate, pv_pitch);
+  pv_prefetch_set_rate_pitch (pv_prefetch, pv_rate, pv_pitch);
 
   // everything is done
   gtk_widget_show (window);
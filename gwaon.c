@@ -25,6 +25,10 @@
 /** global variables **/
 SNDFILE *sf = NULL;
 SF_INFO sfinfo;
+/* the same file opened again for the playback thread (pv_prefetch),
+ * so that the drawing does not move the position under it */
+SNDFILE *sf_pv = NULL;
+SF_INFO sfinfo_pv;
 
 int
 main (int argc, char *argv[])
@@ -138,6 +138,171 @@ void HC_to_amp2 (long len, const double * freq, double scale,
     }
 }
 
+/* approximation of atan2 (y, x) by the polynomial for atan on [0,1]
+ * (Abramowitz and Stegun 4.4.49), where the max error is 1.2e-5 rad.
+ * the range is (-pi, pi] as atan2(), and fast_atan2 (0, 0) = 0.
+ */
+static inline double
+fast_atan2 (double y, double x)
+{
+  double ax = fabs (x);
+  double ay = fabs (y);
+  double mx = (ax > ay ? ax : ay);
+  double mn = (ax > ay ? ay : ax);
+  double a = (mx > 0.0 ? mn / mx : 0.0);
+  double s = a * a;
+  double r = a * (0.9998660
+		  + s * (-0.3302995
+			 + s * (0.1801410
+				+ s * (-0.0851330
+				       + s * 0.0208351))));
+  r = (ay > ax ? M_PI_2 - r : r);
+  r = (x < 0.0 ? M_PI - r : r);
+  return (y < 0.0 ? -r : r);
+}
+
+/* fast version of HC_to_polar2() for the phase,
+ * where atan2() is replaced by the polynomial approximation
+ * whose max error is 1.2e-5 rad (and amp2[] is exact).
+ * INPUT
+ *  len        :
+ *  freq [len] :
+ *  conj       : set 0 for normal case.
+ *               set 1 for conjugate of the complex (freq(k),freq(len-k))
+ *               that is, for (freq(k),-freq(len-k)).
+ *  scale      : scale factor for amp2[]
+ * OUTPUT
+ *  amp2 [len/2+1] := (real^2 + imag^2) / scale
+ *  phs  [len/2+1] := atan2 (+imag / real) for conj==0
+ *                  = atan2 (-imag / real) for conj==1
+ */
+void HC_to_polar2_fast (long len, const double * freq,
+			int conj, double scale,
+			double * amp2, double * phs)
+{
+  int i;
+  double rl, im;
+  double sign = (conj == 0 ? 1.0 : -1.0);
+
+  phs [0] = 0.0;
+  amp2 [0] = freq [0] * freq [0] / scale;
+  for (i = 1; i < (len+1)/2; i ++)
+    {
+      rl = freq [i];
+      im = freq [len - i];
+      amp2 [i] = (rl * rl + im * im)  / scale;
+      phs [i] = fast_atan2 (sign * im, rl);
+    }
+  if (len%2 == 0)
+    {
+      phs [len/2] = 0.0;
+      amp2 [len/2] = freq [len/2] * freq [len/2] / scale;
+    }
+}
+
+/* single-precision version of HC_to_polar2()
+ * (the FFT data is float, while the results are in double)
+ * INPUT
+ *  len        :
+ *  freq [len] :
+ *  conj       : set 0 for normal case.
+ *               set 1 for conjugate of the complex (freq(k),freq(len-k))
+ *               that is, for (freq(k),-freq(len-k)).
+ *  scale      : scale factor for amp2[]
+ * OUTPUT
+ *  amp2 [len/2+1] := (real^2 + imag^2) / scale
+ *  phs  [len/2+1] := atan2 (+imag / real) for conj==0
+ *                  = atan2 (-imag / real) for conj==1
+ */
+void HC_to_polar2_f (long len, const float * freq,
+		     int conj, double scale,
+		     double * amp2, double * phs)
+{
+  int i;
+  float rl, im;
+  float fscale = (float)(1.0 / scale);
+
+  phs [0] = 0.0;
+  amp2 [0] = (double)(freq [0] * freq [0] * fscale);
+  for (i = 1; i < (len+1)/2; i ++)
+    {
+      rl = freq [i];
+      im = freq [len - i];
+      amp2 [i] = (double)((rl * rl + im * im) * fscale);
+      if (amp2 [i] > 0.0) 
+	{
+	  if (conj == 0) phs [i] = (double)atan2f (+im, rl);
+	  else           phs [i] = (double)atan2f (-im, rl);
+	}
+      else
+	{
+	  phs [i] = 0.0;
+	}
+    }
+  if (len%2 == 0)
+    {
+      phs [len/2] = 0.0;
+      amp2 [len/2] = (double)(freq [len/2] * freq [len/2] * fscale);
+    }
+}
+
+/* single-precision version of HC_to_polar2_fast()
+ * (the FFT data is float, while the results are in double)
+ */
+void HC_to_polar2_f_fast (long len, const float * freq,
+			  int conj, double scale,
+			  double * amp2, double * phs)
+{
+  int i;
+  float rl, im;
+  float fscale = (float)(1.0 / scale);
+  double sign = (conj == 0 ? 1.0 : -1.0);
+
+  phs [0] = 0.0;
+  amp2 [0] = (double)(freq [0] * freq [0] * fscale);
+  for (i = 1; i < (len+1)/2; i ++)
+    {
+      rl = freq [i];
+      im = freq [len - i];
+      amp2 [i] = (double)((rl * rl + im * im) * fscale);
+      phs [i] = fast_atan2 (sign * (double)im, (double)rl);
+    }
+  if (len%2 == 0)
+    {
+      phs [len/2] = 0.0;
+      amp2 [len/2] = (double)(freq [len/2] * freq [len/2] * fscale);
+    }
+}
+
+/* single-precision version of HC_to_amp2()
+ * (the FFT data is float, while the results are in double)
+ * INPUT
+ *  len        :
+ *  freq [len] :
+ *  scale      : scale factor for amp2[]
+ * OUTPUT
+ *  amp2 [len/2+1] := (real^2 + imag^2) / scale
+ */
+void HC_to_amp2_f (long len, const float * freq, double scale,
+		   double * amp2)
+{
+  int i;
+  float rl, im;
+  float fscale = (float)(1.0 / scale);
+
+  amp2 [0] = (double)(freq [0] * freq [0] * fscale);
+  for (i = 1; i < (len+1)/2; i ++)
+    {
+      rl = freq [i];
+      im = freq [len - i];
+      amp2 [i] = (double)((rl * rl + im * im) * fscale);
+    }
+  if (len%2 == 0)
+    {
+      amp2 [len/2] = (double)(freq [len/2] * freq [len/2] * fscale);
+    }
+}
+
 /* 
  * INPUT
  *  len           : N
@@ -337,6 +502,7 @@ void HC_puckette_lock (long len, const double *y,
  *  fs[]        : X[s_i], analysis-FFT at starting time of i step
  *  ft[]        : X[t_i], analysis-FFT at terminal time of i step
  *                Note: t_i - s_i = u_i - u_{i-1} = hop_out
+ *  tmp1[len], tmp2[len] : work area given by the caller
  * OUTPUT
  *  f_out[]     : Y[u_i], synthesis-FFT at i step
  *                you can use the same point f_out_old[] for this.
@@ -344,36 +510,140 @@ void HC_puckette_lock (long len, const double *y,
 void
 HC_complex_phase_vocoder (int len, const double *fs, const double *ft,
 			  const double *f_out_old, 
-			  double *f_out)
+			  double *f_out,
+			  double *tmp1, double *tmp2)
 {
-  static double *tmp1 = NULL;
-  static double *tmp2 = NULL;
-  static int n0 = 0;
-  if (tmp1 == NULL)
+  // tmp1 = Y[u_{i-1}]/X[s(i)]
+  HC_div (len, f_out_old, fs, tmp1);
+  // tmp2 = |Y[u_{i-1}]/X[s(i)]|
+  HC_abs (len, tmp1, tmp2);
+
+  // tmp1 = (Y[u_{i-1}]/X[s_i]) / |Y[u_{i-1}]/X[s_i]|
+  HC_div (len, tmp1, tmp2, tmp1);
+
+  // f_out = X[t_i] (Y[u_{i-1}]/X[s_i]) / |Y[u_{i-1}]/X[s_i]|
+  HC_mul (len, ft, tmp1, f_out);
+}
+
+
+/** single-precision versions for the vocoder in WAON_FLOAT **/
+
+/* single-precision version of HC_mul() */
+void HC_mul_f (long len, const float *x, const float *y,
+	       float *z)
+{
+  int i;
+  float rx, ix;
+  float ry, iy;
+
+  z [0] = x [0] * y [0];
+  for (i = 1; i < (len+1)/2; i ++)
     {
-      tmp1 = (double *)malloc (sizeof (double) * len);
-      tmp2 = (double *)malloc (sizeof (double) * len);
-      CHECK_MALLOC (tmp1, "HC_complex_phase_vocoder");
-      CHECK_MALLOC (tmp2, "HC_complex_phase_vocoder");
-      n0 = len;
+      rx = x [i];
+      ix = x [len - i];
+      ry = y [i];
+      iy = y [len - i];
+      z [i]       = rx * ry - ix * iy;
+      z [len - i] = rx * iy + ix * ry;
     }
-  else if (n0 < len)
+  if (len%2 == 0)
     {
-      tmp1 = (double *)realloc (tmp1, sizeof (double) * len);
-      tmp2 = (double *)realloc (tmp2, sizeof (double) * len);
-      CHECK_MALLOC (tmp1, "HC_complex_phase_vocoder");
-      CHECK_MALLOC (tmp2, "HC_complex_phase_vocoder");
-      n0 = len;
+      z [len/2] = x [len/2] * y [len/2];
     }
+}
+
+/* single-precision version of HC_div() */
+void HC_div_f (long len, const float *x, const float *y,
+	       float *z)
+{
+  int i;
+  float rx, ix;
+  float ry, iy;
+  float den;
 
+  z [0] = x [0] / y [0];
+  for (i = 1; i < (len+1)/2; i ++)
+    {
+      rx = x [i];
+      ix = x [len - i];
+      ry = y [i];
+      iy = y [len - i];
+      den = ry * ry + iy * iy;
+      z [i]       = (rx * ry + ix * iy) / den;
+      z [len - i] = (ix * ry - rx * iy) / den;
+    }
+  if (len%2 == 0)
+    {
+      z [len/2] = x [len/2] / y [len/2];
+    }
+}
+
+/* single-precision version of HC_abs() */
+void HC_abs_f (long len, const float *x,
+	       float *z)
+{
+  int i;
+  float rx, ix;
+
+  z [0] = fabsf (x [0]);
+  for (i = 1; i < (len+1)/2; i ++)
+    {
+      rx = x [i];
+      ix = x [len - i];
+      z [i]       = sqrtf (rx * rx + ix * ix);
+      z [len - i] = 0.0;
+    }
+  if (len%2 == 0)
+    {
+      z [len/2] = fabsf (x [len/2]);
+    }
+}
+
+/* single-precision version of HC_puckette_lock()
+ * NOTE: y cannot be z!
+ */
+void HC_puckette_lock_f (long len, const float *y,
+			 float *z)
+{
+  int k;
+
+  z [0] = y [0];
+  for (k = 1; k < (len+1)/2; k ++)
+    {
+      z [k]       = y [k];
+      z [len - k] = y [len - k];
+      if (k > 1)
+	{
+	  z [k]       += y [k-1];
+	  z [len - k] += y [len - (k-1)];
+	}
+      if (k < (len+1)/2 - 1)
+	{
+	  z [k]       += y [k+1];
+	  z [len - k] += y [len - (k+1)];
+	}
+    }
+  if (len%2 == 0)
+    {
+      z [len/2] = y [len/2];
+    }
+}
+
+/* single-precision version of HC_complex_phase_vocoder() */
+void
+HC_complex_phase_vocoder_f (int len, const float *fs, const float *ft,
+			    const float *f_out_old,
+			    float *f_out,
+			    float *tmp1, float *tmp2)
+{
   // tmp1 = Y[u_{i-1}]/X[s(i)]
-  HC_div (len, f_out_old, fs, tmp1);
+  HC_div_f (len, f_out_old, fs, tmp1);
   // tmp2 = |Y[u_{i-1}]/X[s(i)]|
-  HC_abs (len, tmp1, tmp2);
+  HC_abs_f (len, tmp1, tmp2);
 
   // tmp1 = (Y[u_{i-1}]/X[s_i]) / |Y[u_{i-1}]/X[s_i]|
-  HC_div (len, tmp1, tmp2, tmp1);
+  HC_div_f (len, tmp1, tmp2, tmp1);
 
   // f_out = X[t_i] (Y[u_{i-1}]/X[s_i]) / |Y[u_{i-1}]/X[s_i]|
-  HC_mul (len, ft, tmp1, f_out);
+  HC_mul_f (len, ft, tmp1, f_out);
 }
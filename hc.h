@@ -19,6 +19,19 @@
 #ifndef	_HC_H_
 #define	_HC_H_
 
+#include <math.h> // floor(), M_PI
+
+
+/* principal argument of the phase x, that is, x - 2 pi n in [-pi, pi)
+ * without the data-dependent branches, so that the loops calling it
+ * could be vectorized.
+ */
+static inline double
+principal_argument (double x)
+{
+  return (x - 2.0 * M_PI * floor (x / (2.0 * M_PI) + 0.5));
+}
+
 
 /* return angle (arg) of the complex number (freq(k),freq(len-k));
  * where (real,imag) = (cos(angle), sin(angle)).
@@ -54,6 +67,14 @@ void HC_to_polar2 (long len, const double * freq,
 		   int conj, double scale,
 		   double * amp2, double * phs);
 
+/* fast version of HC_to_polar2() for the phase,
+ * where atan2() is replaced by the polynomial approximation
+ * whose max error is 1.2e-5 rad (and amp2[] is exact).
+ */
+void HC_to_polar2_fast (long len, const double * freq,
+			int conj, double scale,
+			double * amp2, double * phs);
+
 /* return power (amp2) of the complex number (freq(k),freq(len-k));
  * where (real,imag) = (cos(angle), sin(angle)).
  * INPUT
@@ -66,6 +87,19 @@ void HC_to_polar2 (long len, const double * freq,
 void HC_to_amp2 (long len, const double * freq, double scale,
 		 double * amp2);
 
+/* single-precision versions of HC_to_polar2(), HC_to_amp2()
+ * and HC_to_polar2_fast()
+ * (the FFT data is float, while the results are in double)
+ */
+void HC_to_polar2_f (long len, const float * freq,
+		     int conj, double scale,
+		     double * amp2, double * phs);
+void HC_to_amp2_f (long len, const float * freq, double scale,
+		   double * amp2);
+void HC_to_polar2_f_fast (long len, const float * freq,
+			  int conj, double scale,
+			  double * amp2, double * phs);
+
 /* 
  * INPUT
  *  len           : N
@@ -134,6 +168,7 @@ void HC_puckette_lock (long len, const double *y,
  *  fs[]        : X[s_i], analysis-FFT at starting time of i step
  *  ft[]        : X[t_i], analysis-FFT at terminal time of i step
  *                Note: t_i - s_i = u_i - u_{i-1} = hop_out
+ *  tmp1[len], tmp2[len] : work area given by the caller
  * OUTPUT
  *  f_out[]     : Y[u_i], synthesis-FFT at i step
  *                you can use the same point f_out_old[] for this.
@@ -141,7 +176,27 @@ void HC_puckette_lock (long len, const double *y,
 void
 HC_complex_phase_vocoder (int len, const double *fs, const double *ft,
 			  const double *f_out_old, 
-			  double *f_out);
+			  double *f_out,
+			  double *tmp1, double *tmp2);
+
+
+/** single-precision versions for the vocoder in WAON_FLOAT **/
+
+void HC_mul_f (long len, const float *x, const float *y,
+	       float *z);
+void HC_div_f (long len, const float *x, const float *y,
+	       float *z);
+void HC_abs_f (long len, const float *x,
+	       float *z);
+/* NOTE: y cannot be z!
+ */
+void HC_puckette_lock_f (long len, const float *y,
+			 float *z);
+void
+HC_complex_phase_vocoder_f (int len, const float *fs, const float *ft,
+			    const float *f_out_old,
+			    float *f_out,
+			    float *tmp1, float *tmp2);
 
 
 #endif /* !_HC_H_ */
@@ -16,7 +16,8 @@
  * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
  */
 #include <stdio.h>
-#include <unistd.h> // sleep()
+#include <unistd.h> // sleep(), usleep()
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h> // pow()
@@ -29,6 +30,7 @@
 
 #include <jack/jack.h>
 #include <jack/transport.h>
+#include <jack/ringbuffer.h>
 
 #include "pv-complex.h" // struct pv_complex
 #include "hc.h" // HC_complex_phase_vocoder()
@@ -36,110 +38,50 @@
 
 #include "jack-pv.h"
 
-// check
-FILE *err_log = NULL;
 
-/*
- * OUTPUT
- *  returned value : 1 if x[i] = 0 for i = 0 to n-1
- *                   0 otherwise
- */
-static int
-check_zero (int n, const double *x)
-{
-  int i;
+/* work area for the steps (used only by the worker thread) */
+static pv_real *l_fs  = NULL;
+static pv_real *r_fs  = NULL;
+static pv_real *l_ft  = NULL;
+static pv_real *r_ft  = NULL;
+static pv_real *l_tmp = NULL;
+static pv_real *r_tmp = NULL;
 
-  for (i = 0; i < n; i ++)
-    {
-      if (x[i] != 0.0) return 1;
-    }
-  return 0;
-}
-
-/* play one hop_in by the phase vocoder:
- * phase vocoder by complex arithmetics with fixed hops.
- *   t_i - s_i = u_i - u_{i-1} = hop
- *   where s_i and t_i are the times for two analysis FFT
- *   and u_i is the time for the synthesis FFT at step i
- * Reference: M.Puckette (1995)
- * INPUT
- *  pv : struct pv_complex
- *  cur : current frame to play.
- *        you have to increment this by yourself.
- *  pv->flag_lock : 0 == no phase lock
- *                  1 == loose phase lock
- * OUTPUT
- *  left[pv->hop_res], right[pv->hop_res] : 
- *  returned value : hop_res (not hop_syn).
- */
-int
-jack_pv_complex_play_step (struct pv_complex *pv,
-			   long cur,
-			   double *left, double *right)
+static void
+jack_pv_complex_alloc (struct pv_complex *pv)
 {
-  static double *l_fs  = NULL;
-  static double *r_fs  = NULL;
-  static double *l_ft  = NULL;
-  static double *r_ft  = NULL;
-  static double *l_tmp = NULL;
-  static double *r_tmp = NULL;
-
   if (l_fs == NULL)
     {
-      l_fs = (double *)malloc (pv->len * sizeof (double));
-      r_fs = (double *)malloc (pv->len * sizeof (double));
+      l_fs = (pv_real *)malloc (pv->len * sizeof (pv_real));
+      r_fs = (pv_real *)malloc (pv->len * sizeof (pv_real));
       CHECK_MALLOC (l_fs, "pv_complex_play_step");
       CHECK_MALLOC (r_fs, "pv_complex_play_step");
 
-      l_ft = (double *)malloc (pv->len * sizeof (double));
-      r_ft = (double *)malloc (pv->len * sizeof (double));
+      l_ft = (pv_real *)malloc (pv->len * sizeof (pv_real));
+      r_ft = (pv_real *)malloc (pv->len * sizeof (pv_real));
       CHECK_MALLOC (l_ft, "pv_complex_play_step");
       CHECK_MALLOC (r_ft, "pv_complex_play_step");
 
-      l_tmp = (double *)malloc (pv->len * sizeof (double));
-      r_tmp = (double *)malloc (pv->len * sizeof (double));
+      l_tmp = (pv_real *)malloc (pv->len * sizeof (pv_real));
+      r_tmp = (pv_real *)malloc (pv->len * sizeof (pv_real));
       CHECK_MALLOC (l_tmp, "pv_complex_play_step");
       CHECK_MALLOC (r_tmp, "pv_complex_play_step");
     }
+}
 
-  long status;
-  // read the starting frame (cur)
-  status = read_and_FFT_stereo (pv, cur, l_fs, r_fs);
-  if (status != pv->len)
-    {
-      return 0; // no output
-    }
-
-  // read the terminal frame (cur + hop_syn)
-  status = read_and_FFT_stereo (pv, cur + pv->hop_syn, l_ft, r_ft);
-  if (status != pv->len)
-    {
-      return 0; // no output
-    }
-
-  int flag_left_cur;
-  int flag_right_cur;
-  if (check_zero (pv->len, l_fs) == 0 ||
-      check_zero (pv->len, l_ft) == 0)
-    {
-      flag_left_cur = 0; // inactive
-    }
-  else
-    {
-      flag_left_cur = 1; // active
-    }
-
-  if (check_zero (pv->len, r_fs) == 0 ||
-      check_zero (pv->len, r_ft) == 0)
-    {
-      flag_right_cur = 0; // inactive
-    }
-  else
-    {
-      flag_right_cur = 1; // active
-    }
-
-
+/* synthesize one hop from the FFT of the starting frames [lr]_fs[]
+ * and the terminal frames [lr]_ft[]
+ * INPUT
+ *  flag_left_cur, flag_right_cur : 1 == active, 0 == silent channel
+ * OUTPUT
+ *  left[pv->hop_res], right[pv->hop_res] : 
+ *  returned value : hop_res (not hop_syn).
+ */
+static int
+jack_pv_complex_synth (struct pv_complex *pv,
+		       int flag_left_cur, int flag_right_cur,
+		       double *left, double *right)
+{
   int i;
 
   // left channel
@@ -158,7 +100,7 @@ jack_pv_complex_play_step (struct pv_complex *pv,
 	  else // loose phase lock
 	    {
 	      // apply loose phase lock
-	      HC_puckette_lock (pv->len, l_fs, pv->l_f_old);
+	      pv_complex_phase_lock (pv, l_fs, pv->l_f_old);
 	    }
 
 	  pv->flag_left = 1;
@@ -168,7 +110,7 @@ jack_pv_complex_play_step (struct pv_complex *pv,
       if (pv->flag_lock == 0) // no phase lock
 	{
 	  // Y[u_i] = X[t_i] (Y[u_{i-1}]/X[s_i]) / |Y[u_{i-1}]/X[s_i]|
-	  HC_complex_phase_vocoder (pv->len, l_fs, l_ft, pv->l_f_old,
+	  pv_complex_phase_vocoder (pv, l_fs, l_ft, pv->l_f_old,
 				    pv->l_f_old);
 	  // already backed up for the next step in [lr]_f_old[]
 	  apply_invFFT_mono (pv, pv->l_f_old, pv->window_scale, pv->l_out);
@@ -176,10 +118,10 @@ jack_pv_complex_play_step (struct pv_complex *pv,
       else // loose phase lock
 	{
 	  // Y[u_i] = X[t_i] (Z[u_{i-1}]/X[s_i]) / |Z[u_{i-1}]/X[s_i]|
-	  HC_complex_phase_vocoder (pv->len, l_fs, l_ft, pv->l_f_old,
+	  pv_complex_phase_vocoder (pv, l_fs, l_ft, pv->l_f_old,
 				    l_tmp);
 	  // apply loose phase lock and store for the next step
-	  HC_puckette_lock (pv->len, l_tmp, pv->l_f_old);
+	  pv_complex_phase_lock (pv, l_tmp, pv->l_f_old);
 
 	  apply_invFFT_mono (pv, l_tmp, pv->window_scale, pv->l_out);
 	}
@@ -202,7 +144,7 @@ jack_pv_complex_play_step (struct pv_complex *pv,
 	  else // loose phase lock
 	    {
 	      // apply loose phase lock
-	      HC_puckette_lock (pv->len, r_fs, pv->r_f_old);
+	      pv_complex_phase_lock (pv, r_fs, pv->r_f_old);
 	    }
 	  pv->flag_right = 1;
 	}
@@ -211,7 +153,7 @@ jack_pv_complex_play_step (struct pv_complex *pv,
       if (pv->flag_lock == 0) // no phase lock
 	{
 	  // Y[u_i] = X[t_i] (Y[u_{i-1}]/X[s_i]) / |Y[u_{i-1}]/X[s_i]|
-	  HC_complex_phase_vocoder (pv->len, r_fs, r_ft, pv->r_f_old,
+	  pv_complex_phase_vocoder (pv, r_fs, r_ft, pv->r_f_old,
 				    pv->r_f_old);
 	  // already backed up for the next step in [lr]_f_old[]
 	  apply_invFFT_mono (pv, pv->r_f_old, pv->window_scale, pv->r_out);
@@ -219,10 +161,10 @@ jack_pv_complex_play_step (struct pv_complex *pv,
       else // loose phase lock
 	{
 	  // Y[u_i] = X[t_i] (Z[u_{i-1}]/X[s_i]) / |Z[u_{i-1}]/X[s_i]|
-	  HC_complex_phase_vocoder (pv->len, r_fs, r_ft, pv->r_f_old,
+	  pv_complex_phase_vocoder (pv, r_fs, r_ft, pv->r_f_old,
 				    r_tmp);
 	  // apply loose phase lock and store for the next step
-	  HC_puckette_lock (pv->len, r_tmp, pv->r_f_old);
+	  pv_complex_phase_lock (pv, r_tmp, pv->r_f_old);
 
 	  apply_invFFT_mono (pv, r_tmp, pv->window_scale, pv->r_out);
 	}
@@ -233,7 +175,20 @@ jack_pv_complex_play_step (struct pv_complex *pv,
   //status = pv_complex_play_resample (pv);
   if (pv->hop_syn != pv->hop_res)
     {
-      pv_complex_resample (pv, left, right);
+      long n = pv_complex_resample (pv, left, right);
+      if (n < pv->hop_res)
+	{
+	  // the first step of the polyphase filter,
+	  // where the output is delayed by zeros to keep hop_res
+	  long nz = pv->hop_res - n;
+	  memmove (left + nz,  left,  sizeof (double) * n);
+	  memmove (right + nz, right, sizeof (double) * n);
+	  for (i = 0; i < nz; i ++)
+	    {
+	      left[i]  = 0.0;
+	      right[i] = 0.0;
+	    }
+	}
     }
   else
     {
@@ -242,82 +197,364 @@ jack_pv_complex_play_step (struct pv_complex *pv,
 	  left[i]  = pv->l_out[i];
 	  right[i] = pv->r_out[i];
 	}
+      pv->src_flag = 0; // reset the converter when the pitch is shifted
     }
 
 
   /* shift [lr]_out by hop_syn */
-  for (i = 0; i < pv->len; i ++)
+  pv_complex_shift_out (pv);
+
+  return (pv->hop_res);
+}
+
+/* play one hop_in by the phase vocoder:
+ * phase vocoder by complex arithmetics with fixed hops.
+ *   t_i - s_i = u_i - u_{i-1} = hop
+ *   where s_i and t_i are the times for two analysis FFT
+ *   and u_i is the time for the synthesis FFT at step i
+ * Reference: M.Puckette (1995)
+ * INPUT
+ *  pv : struct pv_complex
+ *  cur : current frame to play.
+ *        you have to increment this by yourself.
+ *  pv->flag_lock : 0 == no phase lock
+ *                  1 == loose phase lock
+ * OUTPUT
+ *  left[pv->hop_res], right[pv->hop_res] : 
+ *  returned value : hop_res (not hop_syn).
+ */
+int
+jack_pv_complex_play_step (struct pv_complex *pv,
+			   long cur,
+			   double *left, double *right)
+{
+  jack_pv_complex_alloc (pv);
+
+  long status;
+  int flag_left_s, flag_right_s;
+  int flag_left_t, flag_right_t;
+  // read the starting frame (cur)
+  status = read_and_FFT_stereo (pv, cur, l_fs, r_fs,
+				&flag_left_s, &flag_right_s);
+  if (status != pv->len)
     {
-      pv->l_out [i] = pv->l_out [i + pv->hop_syn];
-      pv->r_out [i] = pv->r_out [i + pv->hop_syn];
+      return 0; // no output
     }
-  for (i = pv->len; i < pv->len + pv->hop_syn; i ++)
+
+  // read the terminal frame (cur + hop_syn)
+  status = read_and_FFT_stereo (pv, cur + pv->hop_syn, l_ft, r_ft,
+				&flag_left_t, &flag_right_t);
+  if (status != pv->len)
     {
-      pv->l_out [i] = 0.0;
-      pv->r_out [i] = 0.0;
+      return 0; // no output
     }
 
-  return (pv->hop_res);
+  // the channel is active only if both frames are not silent
+  return (jack_pv_complex_synth (pv,
+				 (flag_left_s  && flag_left_t),
+				 (flag_right_s && flag_right_t),
+				 left, right));
 }
 
-/**
- * The process callback for this JACK application is called in a
- * special realtime thread once for each audio cycle.
- *
- * This client follows a simple rule: when the JACK transport is
- * running, copy the input port to the output.  When it stops, exit.
+/* play one hop of the live input by the phase vocoder,
+ * as jack_pv_complex_play_step() but from the memory.
+ * INPUT
+ *  l_in[len + hop_syn], r_in[len + hop_syn] : input from the frame s_i,
+ *                                             where t_i is at hop_syn.
+ * OUTPUT
+ *  left[pv->hop_res], right[pv->hop_res] : 
+ *  returned value : hop_res (not hop_syn).
  */
 int
-my_jack_process (jack_nframes_t nframes, void *arg)
+jack_pv_complex_live_step (struct pv_complex *pv,
+			   const pv_real *l_in, const pv_real *r_in,
+			   double *left, double *right)
 {
-  static long play_cur = 0;
+  jack_pv_complex_alloc (pv);
+
+  int flag_left_s, flag_right_s;
+  int flag_left_t, flag_right_t;
+  FFT_stereo (pv, l_in, r_in, l_fs, r_fs,
+	      &flag_left_s, &flag_right_s);
+  FFT_stereo (pv, l_in + pv->hop_syn, r_in + pv->hop_syn, l_ft, r_ft,
+	      &flag_left_t, &flag_right_t);
+
+  // the channel is active only if both frames are not silent
+  return (jack_pv_complex_synth (pv,
+				 (flag_left_s  && flag_left_t),
+				 (flag_right_s && flag_right_t),
+				 left, right));
+}
 
-  struct pv_jack *pv_jack = (struct pv_jack *)arg;
+/* take the live input from pv_jack->ring_in[] into l_in[] and r_in[]
+ * up to nneed frames, where *nskip frames are discarded first.
+ * INPUT
+ *  *nin : number of frames in l_in[] and r_in[]
+ *  fbuf[nneed] : work area
+ * OUTPUT
+ *  *nin, *nskip : updated
+ */
+static void
+pv_jack_read_input (struct pv_jack *pv_jack, long nneed,
+		    pv_real *l_in, pv_real *r_in, long *nin, long *nskip,
+		    jack_default_audio_sample_t *fbuf)
+{
+  int nch = pv_jack->nch;
+  int ich;
+  long i;
+
+  // take the same frames from all rings to keep the channels aligned
+  long m = nneed - *nin + *nskip;
+  for (ich = 0; ich < nch; ich ++)
+    {
+      long avail
+	= (long)(jack_ringbuffer_read_space (pv_jack->ring_in[ich])
+		 / sizeof (jack_default_audio_sample_t));
+      if (m > avail) m = avail;
+    }
+
+  // the frames behind the analysis
+  long mskip = (m < *nskip ? m : *nskip);
+  for (ich = 0; ich < nch; ich ++)
+    {
+      jack_ringbuffer_read_advance
+	(pv_jack->ring_in[ich], sizeof (jack_default_audio_sample_t) * mskip);
+    }
+  *nskip -= mskip;
+  m -= mskip;
+  if (m == 0) return;
 
-  static jack_default_audio_sample_t *in = NULL;
-  static jack_nframes_t in_len = 0;
-  if (in == NULL)
+  for (ich = 0; ich < nch; ich ++)
     {
-      in = (jack_default_audio_sample_t *)malloc
-	(sizeof (jack_default_audio_sample_t) * nframes);
-      in_len = nframes;
+      pv_real *x = (ich == 0 ? l_in : r_in);
+      jack_ringbuffer_read (pv_jack->ring_in[ich], (char *)fbuf,
+			    sizeof (jack_default_audio_sample_t) * m);
+      for (i = 0; i < m; i ++)
+	{
+	  x [*nin + i] = (pv_real)fbuf [i];
+	}
+    }
+  if (nch == 1)
+    {
+      for (i = 0; i < m; i ++)
+	{
+	  r_in [*nin + i] = l_in [*nin + i];
+	}
+    }
+  *nin += m;
+}
+
+/* worker thread running the phase vocoder ahead of the playhead,
+ * which fills pv_jack->ring[] with the output while there is a space.
+ * for the live input, the step waits for len + hop_syn frames
+ * in pv_jack->ring_in[] and the input is advanced by hop_ana.
+ * the parameters of pv_jack->pv are changed under pv_jack->lock.
+ */
+static void *
+pv_jack_worker (void *arg)
+{
+  struct pv_jack *pv_jack = (struct pv_jack *)arg;
+  struct pv_complex *pv = pv_jack->pv;
+  int nch = pv_jack->nch;
+  int ich;
+
+  double *left  = NULL;
+  double *right = NULL;
+  jack_default_audio_sample_t *buf[PV_JACK_MAX_CH];
+  for (ich = 0; ich < nch; ich ++)
+    {
+      buf[ich] = NULL;
     }
-  else if (in_len < nframes)
+  long nalloc = 0;
+  long n = 0; // number of frames in buf[]
+  long i = 0; // number of frames in buf[] written into the ring
+
+  /* live input, where hop_syn is up to len by 'H' and by the check
+   * of the initial value in pv_complex_curses_jack() */
+  pv_real *l_in = NULL;
+  pv_real *r_in = NULL;
+  jack_default_audio_sample_t *fbuf = NULL;
+  long nin = 0;   // number of frames in l_in[] and r_in[]
+  long nskip = 0; // number of frames to discard (hop_ana > nin)
+  if (pv_jack->flag_live != 0)
     {
-      in = (jack_default_audio_sample_t *)realloc
-	(in,
-	 sizeof (jack_default_audio_sample_t) * nframes);
-      in_len = nframes;
+      l_in = (pv_real *)malloc (sizeof (pv_real) * 2 * pv->len);
+      r_in = (pv_real *)malloc (sizeof (pv_real) * 2 * pv->len);
+      fbuf = (jack_default_audio_sample_t *)malloc
+	(sizeof (jack_default_audio_sample_t) * 2 * pv->len);
+      CHECK_MALLOC (l_in, "pv_jack_worker");
+      CHECK_MALLOC (r_in, "pv_jack_worker");
+      CHECK_MALLOC (fbuf, "pv_jack_worker");
     }
 
-  static double *left  = NULL;
-  static double *right = NULL;
-  static int hop_res0 = 0;
-  static int cur = 0;
-  if (left == NULL)
+  while (pv_jack->state != Exit)
     {
-      left  = (double *)malloc (sizeof (double) * pv_jack->pv->hop_res);
-      right = (double *)malloc (sizeof (double) * pv_jack->pv->hop_res);
-      CHECK_MALLOC (left,  "my_jack_process");
-      CHECK_MALLOC (right, "my_jack_process");
-      hop_res0 = pv_jack->pv->hop_res;
-      cur = hop_res0; // no data left
+      if (i >= n && pv_jack->flag_live != 0)
+	{
+	  long nneed = pv->len + pv->hop_syn;
+	  if (nin < nneed)
+	    {
+	      pv_jack_read_input (pv_jack, nneed, l_in, r_in,
+				  &nin, &nskip, fbuf);
+	    }
+	  if (nin < nneed)
+	    {
+	      usleep (pv_jack->sleep_usec);
+	      continue;
+	    }
+	}
+
+      if (i >= n)
+	{
+	  // process further data (next hop_res frames)
+	  pthread_mutex_lock (&pv_jack->lock);
+	  n = pv->hop_res;
+	  if (nalloc < n)
+	    {
+	      left  = (double *)realloc (left,  sizeof (double) * n);
+	      right = (double *)realloc (right, sizeof (double) * n);
+	      CHECK_MALLOC (left,  "pv_jack_worker");
+	      CHECK_MALLOC (right, "pv_jack_worker");
+	      for (ich = 0; ich < nch; ich ++)
+		{
+		  buf[ich] = (jack_default_audio_sample_t *)realloc
+		    (buf[ich], sizeof (jack_default_audio_sample_t) * n);
+		  CHECK_MALLOC (buf[ich], "pv_jack_worker");
+		}
+	      nalloc = n;
+	    }
+	  int status;
+	  if (pv_jack->flag_live == 0)
+	    {
+	      status = jack_pv_complex_play_step (pv, pv_jack->play_cur,
+						  left, right);
+	    }
+	  else
+	    {
+	      status = jack_pv_complex_live_step (pv, l_in, r_in,
+						  left, right);
+	      // advance the input by hop_ana
+	      if (pv->hop_ana < nin)
+		{
+		  nin -= pv->hop_ana;
+		  memmove (l_in, l_in + pv->hop_ana, sizeof (pv_real) * nin);
+		  memmove (r_in, r_in + pv->hop_ana, sizeof (pv_real) * nin);
+		}
+	      else
+		{
+		  nskip = pv->hop_ana - nin;
+		  nin = 0;
+		}
+	    }
+	  pv_jack->play_cur += pv->hop_ana;
+	  pthread_mutex_unlock (&pv_jack->lock);
+
+	  for (i = 0; i < n; i ++)
+	    {
+	      if (status == 0) // no output (out of the file)
+		{
+		  for (ich = 0; ich < nch; ich ++)
+		    {
+		      buf[ich][i] = 0.0;
+		    }
+		}
+	      else if (nch == 1)
+		{
+		  buf[0][i] = (jack_default_audio_sample_t)
+		    (0.5 * (left[i] + right[i]));
+		}
+	      else
+		{
+		  buf[0][i] = (jack_default_audio_sample_t)left[i];
+		  buf[1][i] = (jack_default_audio_sample_t)right[i];
+		}
+	    }
+	  i = 0;
+	}
+
+      // write as much as possible into the rings by the same frames
+      long m = n - i;
+      for (ich = 0; ich < nch; ich ++)
+	{
+	  long space
+	    = (long)(jack_ringbuffer_write_space (pv_jack->ring[ich])
+		     / sizeof (jack_default_audio_sample_t));
+	  if (m > space) m = space;
+	}
+      if (m == 0)
+	{
+	  usleep (pv_jack->sleep_usec);
+	  continue;
+	}
+      for (ich = 0; ich < nch; ich ++)
+	{
+	  jack_ringbuffer_write (pv_jack->ring[ich],
+				 (const char *)(buf[ich] + i),
+				 sizeof (jack_default_audio_sample_t) * m);
+	}
+      i += m;
     }
-  else if (hop_res0 < pv_jack->pv->hop_res)
+
+  free (left);
+  free (right);
+  for (ich = 0; ich < nch; ich ++)
     {
-      left  = (double *)realloc (left,  sizeof (double) * pv_jack->pv->hop_res);
-      right = (double *)realloc (right, sizeof (double) * pv_jack->pv->hop_res);
-      CHECK_MALLOC (left,  "my_jack_process");
-      CHECK_MALLOC (right, "my_jack_process");
-      hop_res0 = pv_jack->pv->hop_res;
-      cur = hop_res0; // no data left
+      free (buf[ich]);
     }
+  if (l_in != NULL) free (l_in);
+  if (r_in != NULL) free (r_in);
+  if (fbuf != NULL) free (fbuf);
+  return (NULL);
+}
 
-  // check
-  extern FILE *err_log;
-  fprintf (err_log, "cur = %d\n", cur);
+/**
+ * The process callback for this JACK application is called in a
+ * special realtime thread once for each audio cycle.
+ *
+ * This client follows a simple rule: when the JACK transport is
+ * running, copy the output of the phase vocoder from the ring buffers
+ * to the output ports.  When it stops, exit.
+ * For the live input, the input ports are copied into the ring buffers
+ * for the worker at every cycle regardless of the transport.
+ * Nothing is allocated nor locked here; if the worker thread falls
+ * behind, the rest of the cycle is silent and pv_jack->nunderrun is
+ * incremented (and the input is dropped, counted in pv_jack->noverrun).
+ */
+int
+my_jack_process (jack_nframes_t nframes, void *arg)
+{
+  struct pv_jack *pv_jack = (struct pv_jack *)arg;
+  int ich;
+
+  jack_transport_state_t ts = JackTransportRolling;
+  if (pv_jack->flag_live == 0)
+    {
+      ts = jack_transport_query (pv_jack->client, NULL);
+    }
+  else
+    {
+      // put the same frames into all rings to keep the channels aligned
+      size_t nbytes = sizeof (jack_default_audio_sample_t) * nframes;
+      size_t n = nbytes;
+      for (ich = 0; ich < pv_jack->nch; ich ++)
+	{
+	  size_t space = jack_ringbuffer_write_space (pv_jack->ring_in[ich]);
+	  if (n > space) n = space;
+	}
+      n -= n % sizeof (jack_default_audio_sample_t);
+      for (ich = 0; ich < pv_jack->nch; ich ++)
+	{
+	  jack_default_audio_sample_t *in
+	    = (jack_default_audio_sample_t *)
+	    jack_port_get_buffer (pv_jack->in[ich], nframes);
+	  jack_ringbuffer_write (pv_jack->ring_in[ich], (const char *)in, n);
+	}
+      if (n < nbytes)
+	{
+	  pv_jack->noverrun ++;
+	}
+    }
 
-  jack_transport_state_t ts = jack_transport_query (pv_jack->client, NULL);
   if (ts == JackTransportRolling)
     {
       if (pv_jack->state == Init)
@@ -325,52 +562,30 @@ my_jack_process (jack_nframes_t nframes, void *arg)
 	  pv_jack->state = Run;
 	}
 
-      jack_default_audio_sample_t *out
-	= (jack_default_audio_sample_t *)
-	jack_port_get_buffer (pv_jack->out, nframes);
-
-      // the process for nframes
-      int i, j;
-      // paste the data left in left[] and right[] from cur to hop_res0
-      for (i = 0, j = cur;
-	   (j < hop_res0) && (i < nframes);
-	   i ++, j ++)
+      // take the same frames from all rings to keep the channels aligned
+      size_t nbytes = sizeof (jack_default_audio_sample_t) * nframes;
+      size_t n = nbytes;
+      for (ich = 0; ich < pv_jack->nch; ich ++)
 	{
-	  in[i] = (jack_default_audio_sample_t)(0.5*(left[j] + right[j]));
+	  size_t avail = jack_ringbuffer_read_space (pv_jack->ring[ich]);
+	  if (n > avail) n = avail;
 	}
-      cur = j;
-      cur = cur % hop_res0;
-
-      // if the data is not enough, 
-      while (i < nframes)
+      for (ich = 0; ich < pv_jack->nch; ich ++)
 	{
-	  // process further data (next hop_res frames)
-	  if (cur != 0)
-	    {
-	      fprintf (stderr, "cur update failed...\n");
-	      fprintf (err_log, "cur update failed...\n");
-	      fprintf (err_log, "cur = %d\n", cur);
-	      fclose (err_log);
-	      exit (1);
-	    }
-	  jack_pv_complex_play_step (pv_jack->pv, play_cur, left, right);
-	  play_cur += pv_jack->pv->hop_ana;
-
-	  // then, paste the data in left[] and right[] from 0 to hop_res0
-	  int j;
-	  for (j = 0;
-	       (j < hop_res0) && (i < nframes);
-	       j ++, i ++)
+	  jack_default_audio_sample_t *out
+	    = (jack_default_audio_sample_t *)
+	    jack_port_get_buffer (pv_jack->out[ich], nframes);
+
+	  jack_ringbuffer_read (pv_jack->ring[ich], (char *)out, n);
+	  if (n < nbytes)
 	    {
-	      in[i] = (jack_default_audio_sample_t)(0.5*(left[j] + right[j]));
+	      memset ((char *)out + n, 0, nbytes - n);
 	    }
-	  cur = j;
-	  cur = cur % hop_res0;
 	}
-
-      // now, the data in in[] is enough to pass jack server
-      memcpy (out, in,
-	      sizeof (jack_default_audio_sample_t) * nframes);
+      if (n < nbytes)
+	{
+	  pv_jack->nunderrun ++;
+	}
     }
   else if (ts == JackTransportStopped)
     {
@@ -393,13 +608,15 @@ jack_shutdown (void *arg)
   exit (1);
 }
 
-/* start jack process for output (playback)
+/* open jack client for output (playback)
  * INPUT
+ *  nch       : number of channels (up to PV_JACK_MAX_CH)
+ *  flag_live : 0 == play pv->sf, 1 == process the live input
  * OUTPUT
  *  returned value : struct pv_jack *pv_jack.
  */
 struct pv_jack *
-pv_jack_init (struct pv_complex *pv)
+pv_jack_init (struct pv_complex *pv, int nch, int flag_live)
 {
   struct pv_jack *pv_jack
     = (struct pv_jack *)malloc (sizeof (struct pv_jack));
@@ -407,6 +624,12 @@ pv_jack_init (struct pv_complex *pv)
 
   pv_jack->pv = pv;
   pv_jack->state = Init;
+  pv_jack->play_cur = 0;
+  pv_jack->nunderrun = 0;
+  pv_jack->noverrun = 0;
+  pv_jack->flag_live = flag_live;
+  pv_jack->latency = 0;
+  pthread_mutex_init (&pv_jack->lock, NULL);
 
 
   char *client_name = (char *)malloc (sizeof (char) * 8);
@@ -457,16 +680,127 @@ pv_jack_init (struct pv_complex *pv)
   printf ("engine sample rate: %" PRIu32 "\n",
 	  jack_get_sample_rate (pv_jack->client));
 
-  /* create the output ports */
-  pv_jack->out = jack_port_register (pv_jack->client, "output",
-				     JACK_DEFAULT_AUDIO_TYPE,
-				     JackPortIsOutput, 0);
+  // the worker polls the rings by a quarter of the period
+  pv_jack->sleep_usec
+    = (long)(0.25e6 * (double)jack_get_buffer_size (pv_jack->client)
+	     / (double)jack_get_sample_rate (pv_jack->client));
+  if (pv_jack->sleep_usec > PV_JACK_WORKER_SLEEP)
+    pv_jack->sleep_usec = PV_JACK_WORKER_SLEEP;
+
+  /* create the output ports, one for each channel of the input,
+   * where struct pv_complex keeps up to PV_JACK_MAX_CH channels */
+  pv_jack->nch = nch;
+  if (pv_jack->nch > PV_JACK_MAX_CH) pv_jack->nch = PV_JACK_MAX_CH;
+
+  /* the ring buffer between the worker and the process callback,
+   * holding PV_JACK_RING_HOPS FFT lengths in addition to one period */
+  size_t ring_len = (size_t)(PV_JACK_RING_HOPS * pv->len
+			     + jack_get_buffer_size (pv_jack->client));
+
+  int ich;
+  for (ich = 0; ich < pv_jack->nch; ich ++)
+    {
+      char port_name[16];
+      if (pv_jack->nch == 1)
+	{
+	  strcpy (port_name, "output");
+	}
+      else
+	{
+	  sprintf (port_name, "output_%d", ich + 1);
+	}
+      pv_jack->out[ich] = jack_port_register (pv_jack->client, port_name,
+					      JACK_DEFAULT_AUDIO_TYPE,
+					      JackPortIsOutput, 0);
+      if (pv_jack->out[ich] == NULL)
+	{
+	  fprintf(stderr, "no more JACK ports available\n");
+	  exit (1);
+	}
+
+      pv_jack->ring[ich] = jack_ringbuffer_create
+	(sizeof (jack_default_audio_sample_t) * ring_len);
+      CHECK_MALLOC (pv_jack->ring[ich], "pv_jack_init");
+      jack_ringbuffer_mlock (pv_jack->ring[ich]);
+
+      if (flag_live == 0) continue;
+
+      // input ports for the live input
+      if (pv_jack->nch == 1)
+	{
+	  strcpy (port_name, "input");
+	}
+      else
+	{
+	  sprintf (port_name, "input_%d", ich + 1);
+	}
+      pv_jack->in[ich] = jack_port_register (pv_jack->client, port_name,
+					     JACK_DEFAULT_AUDIO_TYPE,
+					     JackPortIsInput, 0);
+      if (pv_jack->in[ich] == NULL)
+	{
+	  fprintf(stderr, "no more JACK ports available\n");
+	  exit (1);
+	}
 
-  if (pv_jack->out == NULL)
+      pv_jack->ring_in[ich] = jack_ringbuffer_create
+	(sizeof (jack_default_audio_sample_t) * ring_len);
+      CHECK_MALLOC (pv_jack->ring_in[ich], "pv_jack_init");
+      jack_ringbuffer_mlock (pv_jack->ring_in[ich]);
+    }
+
+  return (pv_jack);
+}
+
+/* the first output comes after len + hop_syn frames of the input
+ * and the input of the cycle is processed after the cycle,
+ * so that the latency of the live input depends on hop_syn
+ * (at the start, as the silence of this length is written only once).
+ */
+static long
+pv_jack_get_latency (struct pv_jack *pv_jack)
+{
+  return (pv_jack->pv->len + pv_jack->pv->hop_syn
+	  + (long)jack_get_buffer_size (pv_jack->client));
+}
+
+/* start the worker thread and the jack process
+ * (set the rate and pitch of pv_jack->pv before this)
+ */
+void
+pv_jack_start (struct pv_jack *pv_jack)
+{
+  if (pthread_create (&pv_jack->worker, NULL, pv_jack_worker, pv_jack) != 0)
     {
-      fprintf(stderr, "no more JACK ports available\n");
+      fprintf (stderr, "cannot create the worker thread\n");
       exit (1);
     }
+  int ich;
+  if (pv_jack->flag_live == 0)
+    {
+      // wait for the ring to be filled before the first cycle
+      while (jack_ringbuffer_write_space (pv_jack->ring[0])
+	     >= sizeof (jack_default_audio_sample_t) * pv_jack->pv->len)
+	{
+	  usleep (PV_JACK_WORKER_SLEEP);
+	}
+    }
+  else
+    {
+      // the output is delayed by the silence of this latency
+      pv_jack->latency = pv_jack_get_latency (pv_jack);
+      jack_default_audio_sample_t *zero
+	= (jack_default_audio_sample_t *)calloc
+	(pv_jack->latency, sizeof (jack_default_audio_sample_t));
+      CHECK_MALLOC (zero, "pv_jack_start");
+      for (ich = 0; ich < pv_jack->nch; ich ++)
+	{
+	  jack_ringbuffer_write
+	    (pv_jack->ring[ich], (const char *)zero,
+	     sizeof (jack_default_audio_sample_t) * pv_jack->latency);
+	}
+      free (zero);
+    }
 
   /* Tell the JACK server that we are ready to roll.  Our
    * process() callback will start running now. */
@@ -491,20 +825,61 @@ pv_jack_init (struct pv_complex *pv)
       fprintf(stderr, "no physical playback ports\n");
       exit (1);
     }
-  if (jack_connect (pv_jack->client, jack_port_name (pv_jack->out), ports[0]))
+  // connect the channels to the playback ports in order
+  for (ich = 0; ich < pv_jack->nch && ports[ich] != NULL; ich ++)
     {
-      fprintf (stderr, "cannot connect output ports\n");
+      if (jack_connect (pv_jack->client, jack_port_name (pv_jack->out[ich]),
+			ports[ich]))
+	{
+	  fprintf (stderr, "cannot connect output ports\n");
+	}
     }
   free (ports);
 
+  if (pv_jack->flag_live == 0) return;
 
-  return (pv_jack);
+  // connect the capture ports to the channels in order
+  ports = jack_get_ports (pv_jack->client, NULL, NULL,
+			  JackPortIsPhysical|JackPortIsOutput);
+  if (ports == NULL)
+    {
+      fprintf(stderr, "no physical capture ports\n");
+      return;
+    }
+  for (ich = 0; ich < pv_jack->nch && ports[ich] != NULL; ich ++)
+    {
+      if (jack_connect (pv_jack->client, ports[ich],
+			jack_port_name (pv_jack->in[ich])))
+	{
+	  fprintf (stderr, "cannot connect input ports\n");
+	}
+    }
+  free (ports);
 }
 
+/* close the jack client and stop the worker thread
+ */
 void
 pv_jack_free (struct pv_jack *pv_jack)
 {
-  if (pv_jack != NULL) free (pv_jack);
+  if (pv_jack == NULL) return;
+
+  jack_client_close (pv_jack->client);
+
+  pv_jack->state = Exit;
+  pthread_join (pv_jack->worker, NULL);
+
+  int ich;
+  for (ich = 0; ich < pv_jack->nch; ich ++)
+    {
+      jack_ringbuffer_free (pv_jack->ring[ich]);
+      if (pv_jack->flag_live != 0)
+	{
+	  jack_ringbuffer_free (pv_jack->ring_in[ich]);
+	}
+    }
+  pthread_mutex_destroy (&pv_jack->lock);
+  free (pv_jack);
 }
 
 
@@ -614,6 +989,20 @@ curses_print_pitch (int pv_pitch)
     }
 }
 
+/* print pv_jack->latency (for the live input only),
+ * which is fixed by the silence written by pv_jack_start()
+ * and is not changed by the later changes of hop_syn
+ */
+static void
+curses_print_latency (struct pv_jack *pv_jack, int jack_sr)
+{
+  if (pv_jack->flag_live == 0) return;
+
+  mvprintw (Y_comment, 1, "latency : %ld frames (%.1f msec)   ",
+	    pv_jack->latency,
+	    1000.0 * (double)pv_jack->latency / (double)jack_sr);
+}
+
 static void
 curses_print_pv (const char *file,
 		 struct pv_complex *pv,
@@ -676,8 +1065,17 @@ pv_complex_change_rate_pitch_ (struct pv_complex *pv,
 /* phase vocoder by complex arithmetics with fixed hops.
  */
 void pv_complex_curses_jack (const char *file,
-			     long len, long hop_syn)
+			     long len, long hop_syn,
+			     int src_type)
 {
+  // the step takes len + hop_syn frames, where the buffers are 2 * len
+  if (hop_syn > len)
+    {
+      fprintf (stderr, "hop (%ld) should not be larger than len (%ld)\n",
+	       hop_syn, len);
+      exit (1);
+    }
+
   // ncurses initializing
   initscr();             /* Start curses mode */
   raw();                 /* Line buffering disabled */
@@ -690,32 +1088,42 @@ void pv_complex_curses_jack (const char *file,
   struct pv_complex *pv
     = pv_complex_init (len, hop_syn, flag_window);
   CHECK_MALLOC (pv, "pv_complex_curses");
+  pv_complex_set_src_type (pv, src_type);
 
   // open input file
   SNDFILE *sf = NULL;
   SF_INFO sfinfo;
   memset (&sfinfo, 0, sizeof (sfinfo));
-  sf = sf_open (file, SFM_READ, &sfinfo);
-  if (sf == NULL)
+  int flag_live = (file == NULL);
+  if (flag_live == 0)
     {
-      fprintf (stderr, "fail to open %s\n", file);
-      exit (1);
+      sf = sf_open (file, SFM_READ, &sfinfo);
+      if (sf == NULL)
+	{
+	  fprintf (stderr, "fail to open %s\n", file);
+	  exit (1);
+	}
+    }
+  else
+    {
+      // live input in stereo (samplerate is set after jack_client_open())
+      file = "(live input)";
+      sfinfo.channels = 2;
     }
   //sndfile_print_info (&sfinfo);
 
   pv_complex_set_input (pv, sf, &sfinfo);
 
   /*
-  ao_device *ao = NULL;
-  ao = ao_init_16_stereo (sfinfo.samplerate, 0);
+  struct ao_out *ao = NULL;
+  ao = ao_out_open (sfinfo.samplerate, 0);
   pv_complex_set_output_ao (pv, ao);
   */
 
   // jack initialization
-  struct pv_jack *pv_jack = pv_jack_init (pv);
+  struct pv_jack *pv_jack = pv_jack_init (pv, sfinfo.channels, flag_live);
   int jack_sr = (int)jack_get_sample_rate (pv_jack->client);
-  extern FILE *err_log;
-  err_log = fopen ("jack-pv.log", "w");
+  if (flag_live != 0) sfinfo.samplerate = jack_sr;
 
 
   // initial values
@@ -724,12 +1132,12 @@ void pv_complex_curses_jack (const char *file,
   pv_complex_change_rate_pitch_ (pv, sfinfo.samplerate, jack_sr,
 				 pv_rate, pv_pitch);
   fprintf (stderr, "# samplerates: %d %d\n", sfinfo.samplerate, jack_sr);
+  pv_jack_start (pv_jack);
 
   long frame0 = 0;
   long frame1 = (long)pv->sfinfo->frames - 1;
   pv->flag_lock = 0; // no phase-lock
   int flag_play = 1;
-  long play_cur = 0;
 
   long len_1sec  = (long)(pv->sfinfo->samplerate /* Hz */);
   long len_10sec = (long)(10 * pv->sfinfo->samplerate /* Hz */);
@@ -737,6 +1145,7 @@ void pv_complex_curses_jack (const char *file,
   mvprintw (Y_comment, 1, "Welcome WaoN-pv in curses mode.");
   curses_print_pv (file, pv, flag_play, frame0, frame1,
 		   pv_pitch, pv_rate);
+  curses_print_latency (pv_jack, jack_sr);
 
   // main loop
   //long status = 1; // TRUE
@@ -744,6 +1153,9 @@ void pv_complex_curses_jack (const char *file,
     {
       // scan keyboard
       int ch = getch();
+      long play_cur = pv_jack->play_cur;
+      // the parameters of pv are changed while the worker is waiting
+      if (ch != ERR) pthread_mutex_lock (&pv_jack->lock);
       switch (ch)
 	{
 	case ERR: // no key event
@@ -862,6 +1274,7 @@ void pv_complex_curses_jack (const char *file,
 	  break;
 
 	case KEY_LEFT:
+	  if (flag_live != 0) break; // the rate is fixed for the live input
 	  pv_rate -= 0.1;
 	  pv_complex_change_rate_pitch_ (pv, sfinfo.samplerate, jack_sr,
 					 pv_rate, pv_pitch);
@@ -872,6 +1285,7 @@ void pv_complex_curses_jack (const char *file,
 	  break;
 
 	case KEY_RIGHT:
+	  if (flag_live != 0) break; // the rate is fixed for the live input
 	  pv_rate += 0.1;
 	  pv_complex_change_rate_pitch_ (pv, sfinfo.samplerate, jack_sr,
 					 pv_rate, pv_pitch);
@@ -894,6 +1308,7 @@ void pv_complex_curses_jack (const char *file,
 	  curses_print_pv (file, pv, flag_play, frame0, frame1,
 			   pv_pitch, pv_rate);
 	  mvprintw(Y_comment, 1, "reset everything");
+	  curses_print_latency (pv_jack, jack_sr);
 	  break;
 
 	case 'Q':
@@ -908,19 +1323,30 @@ void pv_complex_curses_jack (const char *file,
 	  break;
 	  */
 	}
+      if (ch != ERR) pthread_mutex_unlock (&pv_jack->lock);
       mvprintw (Y_frames, 1, "current    : %010ld", play_cur);
       refresh();
     }
   //while (status == 1);
   while (pv_jack->state != Exit);
 
-  jack_client_close (pv_jack->client);
+  long nunderrun = pv_jack->nunderrun;
+  long noverrun = pv_jack->noverrun;
   pv_jack_free (pv_jack);
 
   pv_complex_free (pv);
-  sf_close (sf) ;
+  if (sf != NULL) sf_close (sf) ;
 
 
   /* End ncurses mode */
   endwin();
+
+  if (nunderrun > 0)
+    {
+      fprintf (stderr, "jack-pv : %ld cycles of underrun\n", nunderrun);
+    }
+  if (noverrun > 0)
+    {
+      fprintf (stderr, "jack-pv : %ld cycles of input dropped\n", noverrun);
+    }
 }
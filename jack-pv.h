@@ -21,7 +21,9 @@
 
 
 #include "pv-complex.h" // struct pv_complex
+#include <pthread.h> // pthread_t, pthread_mutex_t
 #include <jack/jack.h> // jack_client_t, jack_port_t
+#include <jack/ringbuffer.h> // jack_ringbuffer_t
 
 /* a simple state machine for this client */
 enum jack_state {
@@ -30,11 +32,40 @@ enum jack_state {
   Exit
 };
 
+/* max number of channels (those of struct pv_complex) */
+#define PV_JACK_MAX_CH (2)
+/* size of the ring buffer in FFT lengths (len) */
+#define PV_JACK_RING_HOPS (4)
+/* max sleep of the worker thread when the ring buffer is full
+ * (or the live input is short) [usec] */
+#define PV_JACK_WORKER_SLEEP (1000)
+
 struct pv_jack {
   struct pv_complex *pv;
   jack_client_t *client;
-  jack_port_t   *out;
-  enum jack_state state;
+  int nch; // number of channels (output ports)
+  jack_port_t   *out[PV_JACK_MAX_CH];
+
+  int flag_live; // 0 == play the file, 1 == process the live input
+  jack_port_t   *in[PV_JACK_MAX_CH]; // for the live input
+  volatile enum jack_state state;
+
+  /* the phase vocoder runs in the worker thread, which writes
+   * the output into the ring ahead of the playhead, so that
+   * my_jack_process() only reads it (no malloc, FFT nor file access) */
+  pthread_t worker;
+  pthread_mutex_t lock; // for the parameters of pv
+  jack_ringbuffer_t *ring[PV_JACK_MAX_CH]; // output of each channel
+                                           // (single producer and consumer)
+  volatile long play_cur;  // next frame to analyse (by the worker)
+  long sleep_usec; // sleep of the worker (up to PV_JACK_WORKER_SLEEP)
+  volatile long nunderrun; // number of cycles where the ring was short
+
+  // for the live input (written by the callback, read by the worker)
+  jack_ringbuffer_t *ring_in[PV_JACK_MAX_CH];
+  volatile long noverrun; // number of cycles where the input was dropped
+  long latency; // from the input to the output in frames
+                // (len + hop_syn + the period, set by pv_jack_start())
 };
 
 
@@ -59,12 +90,29 @@ jack_pv_complex_play_step (struct pv_complex *pv,
 			   long cur,
 			   double *left, double *right);
 
+/* play one hop of the live input by the phase vocoder,
+ * as jack_pv_complex_play_step() but from the memory.
+ * INPUT
+ *  l_in[len + hop_syn], r_in[len + hop_syn] : input from the frame s_i,
+ *                                             where t_i is at hop_syn.
+ * OUTPUT
+ *  left[pv->hop_res], right[pv->hop_res] : 
+ *  returned value : hop_res (not hop_syn).
+ */
+int
+jack_pv_complex_live_step (struct pv_complex *pv,
+			   const pv_real *l_in, const pv_real *r_in,
+			   double *left, double *right);
+
 /**
  * The process callback for this JACK application is called in a
  * special realtime thread once for each audio cycle.
  *
  * This client follows a simple rule: when the JACK transport is
- * running, copy the input port to the output.  When it stops, exit.
+ * running, copy the output of the phase vocoder from the ring buffers
+ * to the output ports.  When it stops, exit.
+ * For the live input, the input ports are copied into the ring buffers
+ * at every cycle regardless of the transport.
  */
 int
 my_jack_process (jack_nframes_t nframes, void *arg);
@@ -77,22 +125,39 @@ void
 jack_shutdown (void *arg);
 
 /**
- * start jack process for output (playback)
+ * open jack client for output (playback)
  * INPUT
+ *  nch       : number of channels (up to PV_JACK_MAX_CH)
+ *  flag_live : 0 == play pv->sf, 1 == process the live input
  * OUTPUT
  *  returned value : struct pv_jack *pv_jack.
  */
 struct pv_jack *
-pv_jack_init (struct pv_complex *pv);
+pv_jack_init (struct pv_complex *pv, int nch, int flag_live);
 
+/**
+ * start the worker thread and the jack process
+ * (set the rate and pitch of pv_jack->pv before this)
+ */
+void
+pv_jack_start (struct pv_jack *pv_jack);
+
+/**
+ * close the jack client and stop the worker thread
+ */
 void
 pv_jack_free (struct pv_jack *pv_jack);
 
 /**
  * phase vocoder by complex arithmetics with fixed hops.
+ * INPUT
+ *  file : input file, or NULL for the live input from the JACK ports
+ *         (pitch-shifter, where the rate is fixed to 1)
+ *  src_type : converter of libsamplerate for the pitch shift
  */
 void pv_complex_curses_jack (const char *file,
-			     long len, long hop_syn);
+			     long len, long hop_syn,
+			     int src_type);
 
 
 #endif /* !_JACK_PV_ */
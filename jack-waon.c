@@ -0,0 +1,464 @@
+/* real-time transcription of the live input from JACK into JACK MIDI
+ * Copyright (C) 1998-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h> // usleep()
+#include <signal.h> // signal()
+#include <pthread.h>
+
+#include <jack/jack.h>
+#include <jack/ringbuffer.h>
+#include <jack/midiport.h>
+
+#include "memory-check.h" // CHECK_MALLOC
+#include "waon.h" // struct WAON
+
+#include "jack-waon.h"
+
+
+/* set by SIGINT to finish the transcription */
+static volatile sig_atomic_t waon_jack_interrupted = 0;
+
+static void
+waon_jack_sigint (int sig)
+{
+  waon_jack_interrupted = 1;
+}
+
+/* output of WAON_stream_events(), called in the worker thread,
+ * where the event is stamped by the input frames fed so far,
+ * that is, the last frame of the step deciding it.
+ */
+static void
+waon_jack_output (void *data, const struct WAON_note_event *ev)
+{
+  struct waon_jack *wj = (struct waon_jack *)data;
+
+  struct waon_jack_event mev;
+  mev.frame = wj->frames_fed;
+  if (ev->event == 1)
+    {
+      mev.data[0] = 0x90; // note-on on the channel 1
+      mev.data[1] = (unsigned char)ev->note;
+      mev.data[2] = (unsigned char)ev->vel;
+    }
+  else
+    {
+      mev.data[0] = 0x80; // note-off on the channel 1
+      mev.data[1] = (unsigned char)ev->note;
+      mev.data[2] = 64;
+    }
+
+  if (jack_ringbuffer_write_space (wj->ring_midi) < sizeof (mev))
+    {
+      wj->nlost ++;
+      return;
+    }
+  jack_ringbuffer_write (wj->ring_midi, (const char *)&mev, sizeof (mev));
+}
+
+/* worker thread running the transcription, which reads the input
+ * from wj->ring_in[] in the chunks ending at the steps, so that the
+ * events of the step are stamped by the right frame.
+ * when wj->flag_exit is set, the notes are closed by WAON_finish().
+ */
+static void *
+waon_jack_worker (void *arg)
+{
+  struct waon_jack *wj = (struct waon_jack *)arg;
+  int nch = wj->nch;
+  int ich;
+  long i;
+
+  long nbuf = WAON_get_hop (wj->waon);
+  double *left  = (double *)malloc (sizeof (double) * nbuf);
+  double *right = (double *)malloc (sizeof (double) * nbuf);
+  jack_default_audio_sample_t *fbuf
+    = (jack_default_audio_sample_t *)malloc
+    (sizeof (jack_default_audio_sample_t) * nbuf);
+  CHECK_MALLOC (left,  "waon_jack_worker");
+  CHECK_MALLOC (right, "waon_jack_worker");
+  CHECK_MALLOC (fbuf,  "waon_jack_worker");
+
+  while (wj->flag_exit == 0)
+    {
+      // take the same frames from all rings to keep the channels aligned
+      long n = WAON_get_samples_to_step (wj->waon);
+      if (n > nbuf) n = nbuf;
+      for (ich = 0; ich < nch; ich ++)
+	{
+	  long avail
+	    = (long)(jack_ringbuffer_read_space (wj->ring_in[ich])
+		     / sizeof (jack_default_audio_sample_t));
+	  if (n > avail) n = avail;
+	}
+      if (n == 0)
+	{
+	  usleep (wj->sleep_usec);
+	  continue;
+	}
+
+      for (ich = 0; ich < nch; ich ++)
+	{
+	  double *x = (ich == 0 ? left : right);
+	  jack_ringbuffer_read (wj->ring_in[ich], (char *)fbuf,
+				sizeof (jack_default_audio_sample_t) * n);
+	  for (i = 0; i < n; i ++)
+	    {
+	      x [i] = (double)fbuf [i];
+	    }
+	}
+
+      // the events of the step completed by this chunk are given
+      // to waon_jack_output() in WAON_process()
+      wj->frames_fed += n;
+      WAON_process (wj->waon, left, right, n);
+    }
+
+  // close the notes sounding
+  WAON_finish (wj->waon);
+
+  free (left);
+  free (right);
+  free (fbuf);
+
+  return (NULL);
+}
+
+/* process callback in the realtime thread of JACK,
+ * which copies the input ports into the rings for the worker
+ * and sends the events decided by the worker to the MIDI port
+ * at the head of the cycle.
+ * Nothing is allocated nor locked here; if the worker thread falls
+ * behind, the input is dropped and counted in wj->noverrun.
+ */
+static int
+waon_jack_process (jack_nframes_t nframes, void *arg)
+{
+  struct waon_jack *wj = (struct waon_jack *)arg;
+  int ich;
+
+  // put the same frames into all rings to keep the channels aligned
+  size_t nbytes = sizeof (jack_default_audio_sample_t) * nframes;
+  size_t n = nbytes;
+  for (ich = 0; ich < wj->nch; ich ++)
+    {
+      size_t space = jack_ringbuffer_write_space (wj->ring_in[ich]);
+      if (n > space) n = space;
+    }
+  n -= n % sizeof (jack_default_audio_sample_t);
+  for (ich = 0; ich < wj->nch; ich ++)
+    {
+      jack_default_audio_sample_t *in
+	= (jack_default_audio_sample_t *)
+	jack_port_get_buffer (wj->in[ich], nframes);
+      jack_ringbuffer_write (wj->ring_in[ich], (const char *)in, n);
+    }
+  if (n < nbytes)
+    {
+      wj->noverrun ++;
+    }
+  wj->frames_in += (long)(n / sizeof (jack_default_audio_sample_t));
+
+  // MIDI output
+  void *mbuf = jack_port_get_buffer (wj->midi_out, nframes);
+  jack_midi_clear_buffer (mbuf);
+  struct waon_jack_event mev;
+  while (jack_ringbuffer_read_space (wj->ring_midi) >= sizeof (mev))
+    {
+      jack_ringbuffer_peek (wj->ring_midi, (char *)&mev, sizeof (mev));
+      // the rest waits for the next cycle if the port buffer is full
+      if (jack_midi_event_write (mbuf, 0, mev.data, 3) != 0) break;
+      jack_ringbuffer_read_advance (wj->ring_midi, sizeof (mev));
+
+      long lat = wj->frames_in - mev.frame;
+      if (wj->nevents == 0 || lat < wj->lat_min) wj->lat_min = lat;
+      if (wj->nevents == 0 || lat > wj->lat_max) wj->lat_max = lat;
+      wj->lat_sum += (double)lat;
+      wj->nevents ++;
+    }
+
+  return 0;
+}
+
+/* JACK calls this if the server shuts down or disconnects the client,
+ * where the notes are closed and the latency is printed as SIGINT.
+ */
+static void
+waon_jack_shutdown (void *arg)
+{
+  struct waon_jack *wj = (struct waon_jack *)arg;
+  wj->flag_exit = 1;
+  waon_jack_interrupted = 1;
+}
+
+/* open the jack client with the input ports and the MIDI output port
+ * INPUT
+ *  params  : parameters of the transcription
+ *  horizon : see waon_jack()
+ * OUTPUT
+ *  returned value : struct waon_jack, or NULL on error
+ */
+static struct waon_jack *
+waon_jack_init (const struct WAON_params *params, int horizon)
+{
+  struct waon_jack *wj
+    = (struct waon_jack *)malloc (sizeof (struct waon_jack));
+  CHECK_MALLOC (wj, "waon_jack_init");
+
+  wj->flag_exit = 0;
+  wj->frames_fed = 0;
+  wj->frames_in = 0;
+  wj->noverrun = 0;
+  wj->nlost = 0;
+  wj->nevents = 0;
+  wj->lat_min = 0;
+  wj->lat_max = 0;
+  wj->lat_sum = 0.0;
+
+  /* open a client connection to the JACK server */
+  jack_options_t options = JackNullOption;
+  jack_status_t jack_status;
+  wj->client = jack_client_open ("waon", options, &jack_status, NULL);
+  if (wj->client == NULL)
+    {
+      fprintf (stderr, "jack_client_open() failed, "
+	       "status = 0x%2.0x\n", jack_status);
+      if (jack_status & JackServerFailed)
+	{
+	  fprintf (stderr, "Unable to connect to JACK server\n");
+	}
+      free (wj);
+      return (NULL);
+    }
+  if (jack_status & JackNameNotUnique)
+    {
+      fprintf (stderr, "unique name `%s' assigned\n",
+	       jack_get_client_name (wj->client));
+    }
+
+  double samplerate = (double)jack_get_sample_rate (wj->client);
+  jack_nframes_t period = jack_get_buffer_size (wj->client);
+  fprintf (stderr, "WaoN : JACK samplerate %.0f, period %d\n",
+	   samplerate, (int)period);
+
+  // the input is taken in stereo, as the sound file
+  wj->nch = WAON_JACK_MAX_CH;
+  wj->waon = WAON_init (params, samplerate, wj->nch);
+  if (wj->waon == NULL)
+    {
+      fprintf (stderr, "cannot initialize the analysis\n");
+      jack_client_close (wj->client);
+      free (wj);
+      return (NULL);
+    }
+  if (WAON_stream_events (wj->waon, waon_jack_output, wj, horizon) != 0)
+    {
+      fprintf (stderr, "cannot stream the events\n");
+      WAON_free (wj->waon);
+      jack_client_close (wj->client);
+      free (wj);
+      return (NULL);
+    }
+
+  // the worker polls the rings by a quarter of the period
+  wj->sleep_usec = (long)(0.25e6 * (double)period / samplerate);
+  if (wj->sleep_usec > WAON_JACK_WORKER_SLEEP)
+    wj->sleep_usec = WAON_JACK_WORKER_SLEEP;
+
+  jack_set_process_callback (wj->client, waon_jack_process, wj);
+  jack_on_shutdown (wj->client, waon_jack_shutdown, wj);
+
+  /* the ring buffer between the process callback and the worker,
+   * holding WAON_JACK_RING_LENS FFT lengths in addition to one period */
+  size_t ring_len = (size_t)(WAON_JACK_RING_LENS * params->len + period);
+
+  int ich;
+  for (ich = 0; ich < wj->nch; ich ++)
+    {
+      char port_name[16];
+      sprintf (port_name, "input_%d", ich + 1);
+      wj->in[ich] = jack_port_register (wj->client, port_name,
+					JACK_DEFAULT_AUDIO_TYPE,
+					JackPortIsInput, 0);
+      if (wj->in[ich] == NULL)
+	{
+	  fprintf(stderr, "no more JACK ports available\n");
+	  exit (1);
+	}
+
+      wj->ring_in[ich] = jack_ringbuffer_create
+	(sizeof (jack_default_audio_sample_t) * ring_len);
+      CHECK_MALLOC (wj->ring_in[ich], "waon_jack_init");
+      jack_ringbuffer_mlock (wj->ring_in[ich]);
+    }
+
+  wj->midi_out = jack_port_register (wj->client, "midi_out",
+				     JACK_DEFAULT_MIDI_TYPE,
+				     JackPortIsOutput, 0);
+  if (wj->midi_out == NULL)
+    {
+      fprintf(stderr, "no more JACK ports available\n");
+      exit (1);
+    }
+  wj->ring_midi = jack_ringbuffer_create
+    (sizeof (struct waon_jack_event) * WAON_JACK_RING_EVENTS);
+  CHECK_MALLOC (wj->ring_midi, "waon_jack_init");
+  jack_ringbuffer_mlock (wj->ring_midi);
+
+  return (wj);
+}
+
+/* start the worker thread and the jack process,
+ * and connect the capture ports to the input ports
+ */
+static void
+waon_jack_start (struct waon_jack *wj)
+{
+  if (pthread_create (&wj->worker, NULL, waon_jack_worker, wj) != 0)
+    {
+      fprintf (stderr, "cannot create the worker thread\n");
+      exit (1);
+    }
+
+  if (jack_activate (wj->client))
+    {
+      fprintf (stderr, "cannot activate client");
+      exit (1);
+    }
+
+  // connect the capture ports to the channels in order
+  const char **ports;
+  ports = jack_get_ports (wj->client, NULL, NULL,
+			  JackPortIsPhysical|JackPortIsOutput);
+  if (ports == NULL)
+    {
+      fprintf(stderr, "no physical capture ports\n");
+      return;
+    }
+  int ich;
+  for (ich = 0; ich < wj->nch && ports[ich] != NULL; ich ++)
+    {
+      if (jack_connect (wj->client, ports[ich],
+			jack_port_name (wj->in[ich])))
+	{
+	  fprintf (stderr, "cannot connect input ports\n");
+	}
+    }
+  free (ports);
+}
+
+/* stop the worker thread, which closes the notes sounding,
+ * and wait for the last events to be sent (up to one second)
+ */
+static void
+waon_jack_stop (struct waon_jack *wj)
+{
+  wj->flag_exit = 1;
+  pthread_join (wj->worker, NULL);
+
+  int i;
+  for (i = 0; i < 1000; i ++)
+    {
+      if (jack_ringbuffer_read_space (wj->ring_midi) == 0) break;
+      usleep (1000);
+    }
+}
+
+/* close the jack client (after waon_jack_stop())
+ */
+static void
+waon_jack_free (struct waon_jack *wj)
+{
+  if (wj == NULL) return;
+
+  jack_client_close (wj->client);
+
+  int ich;
+  for (ich = 0; ich < wj->nch; ich ++)
+    {
+      jack_ringbuffer_free (wj->ring_in[ich]);
+    }
+  jack_ringbuffer_free (wj->ring_midi);
+  WAON_free (wj->waon);
+  free (wj);
+}
+
+/* print the latency of the events in msec
+ */
+static void
+waon_jack_print_latency (const struct waon_jack *wj,
+			 const struct WAON_params *params)
+{
+  double samplerate = (double)jack_get_sample_rate (wj->client);
+  double period = (double)jack_get_buffer_size (wj->client);
+  double ms = 1000.0 / samplerate;
+
+  fprintf (stderr, "WaoN : %ld events sent", wj->nevents);
+  if (wj->nlost > 0)
+    {
+      fprintf (stderr, " (%ld lost)", wj->nlost);
+    }
+  fprintf (stderr, ", %ld overruns of the input\n", wj->noverrun);
+  fprintf (stderr, "WaoN : latency [msec]\n");
+  fprintf (stderr, "  window (len)     : %.1f\n",
+	   (double)params->len * ms);
+  fprintf (stderr, "  step (hop)       : %.1f\n",
+	   (double)WAON_get_hop (wj->waon) * ms);
+  fprintf (stderr, "  period (JACK)    : %.1f\n", period * ms);
+  if (wj->nevents > 0)
+    {
+      /* measured from the last frame of the step deciding the event
+       * to the cycle sending it (including the period of the input) */
+      double lat_ave = wj->lat_sum / (double)wj->nevents;
+      fprintf (stderr, "  processing       : %.1f (min %.1f, max %.1f)\n",
+	       lat_ave * ms,
+	       (double)wj->lat_min * ms,
+	       (double)wj->lat_max * ms);
+      /* the onset is found by the window of len frames ending after it,
+       * and the event is played in the next period */
+      fprintf (stderr, "  end-to-end       : %.1f\n",
+	       ((double)params->len + lat_ave + period) * ms);
+    }
+}
+
+int
+waon_jack (const struct WAON_params *params, int horizon)
+{
+  struct waon_jack *wj = waon_jack_init (params, horizon);
+  if (wj == NULL) return (-1);
+
+  waon_jack_interrupted = 0;
+  signal (SIGINT, waon_jack_sigint);
+
+  waon_jack_start (wj);
+  fprintf (stderr, "WaoN : transcribing the JACK input"
+	   " (Ctrl-C to stop)...\n");
+  while (waon_jack_interrupted == 0)
+    {
+      usleep (100000);
+    }
+  signal (SIGINT, SIG_DFL);
+
+  waon_jack_stop (wj);
+  waon_jack_print_latency (wj, params);
+
+  waon_jack_free (wj);
+  return (0);
+}
@@ -0,0 +1,90 @@
+/* header file for jack-waon.c --
+ * real-time transcription of the live input from JACK into JACK MIDI
+ * Copyright (C) 1998-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_JACK_WAON_H_
+#define	_JACK_WAON_H_
+
+
+#include "waon.h" // struct WAON, struct WAON_params
+#include <pthread.h> // pthread_t
+#include <jack/jack.h> // jack_client_t, jack_port_t
+#include <jack/ringbuffer.h> // jack_ringbuffer_t
+
+/* max number of input channels (those of struct WAON) */
+#define WAON_JACK_MAX_CH (2)
+/* size of the input ring buffer in FFT lengths (len) */
+#define WAON_JACK_RING_LENS (4)
+/* number of MIDI events kept in the ring buffer */
+#define WAON_JACK_RING_EVENTS (1024)
+/* max sleep of the worker thread when the input is short [usec] */
+#define WAON_JACK_WORKER_SLEEP (1000)
+
+/* MIDI event for the process callback */
+struct waon_jack_event {
+  long frame;              // input frame at which the event is decided
+  unsigned char data [3];  // note-on or note-off on the channel 1
+};
+
+struct waon_jack {
+  struct WAON *waon;
+  jack_client_t *client;
+  int nch; // number of channels (input ports)
+  jack_port_t *in[WAON_JACK_MAX_CH];
+  jack_port_t *midi_out;
+
+  /* the transcription runs in the worker thread, so that the process
+   * callback only copies the input into ring_in[] and the events from
+   * ring_midi into the MIDI port (no malloc, FFT nor file access) */
+  pthread_t worker;
+  volatile int flag_exit; // 1 == finish the transcription
+  jack_ringbuffer_t *ring_in[WAON_JACK_MAX_CH]; // written by the callback
+  jack_ringbuffer_t *ring_midi; // struct waon_jack_event by the worker
+  long sleep_usec; // sleep of the worker (up to WAON_JACK_WORKER_SLEEP)
+
+  long frames_fed; // input frames given to WAON_process() (by the worker)
+  volatile long frames_in; // input frames received (by the callback)
+  volatile long noverrun; // cycles where the input was dropped
+  volatile long nlost;    // events dropped for the full ring_midi
+
+  /* latency from the last frame of the step deciding the event
+   * to the cycle where the event is sent, in frames (by the callback) */
+  volatile long nevents;
+  volatile long lat_min;
+  volatile long lat_max;
+  volatile double lat_sum;
+};
+
+
+/* transcribe the live input from JACK into the MIDI output port,
+ * until SIGINT (Ctrl-C) or the shutdown of JACK,
+ * and print the latency at the end.
+ * INPUT
+ *  params  : parameters of the transcription, where len and hop are
+ *            at the samplerate of JACK (no decimation is done).
+ *            the latency is traded for the resolution by them.
+ *  horizon : 0 == the events are sent at the step they are found,
+ *            otherwise the on-event waits up to this number of steps
+ *            for the removal of short notes (see WAON_stream_events())
+ * OUTPUT
+ *  returned value : 0 on success, -1 on error
+ */
+int
+waon_jack (const struct WAON_params *params, int horizon);
+
+
+#endif /* !_JACK_WAON_H_ */
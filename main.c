@@ -39,7 +39,12 @@
 
 #include "midi.h" /* smf_...(), mid2freq[], get_note()  */
 #include "analyse.h" /* note_intensity(), note_on_off(), output_midi()  */
-#include "notes.h" // struct WAON_notes
+#include "decimate.h" // struct WAON_decimate
+#include "waon.h" // struct WAON
+#include "stats.h" // struct WAON_stats
+#ifdef ENABLE_JACK
+#include "jack-waon.h" // waon_jack()
+#endif // ENABLE_JACK
 
 #include "VERSION.h"
 
@@ -73,6 +78,14 @@ void print_usage (char * argv0)
   fprintf (stdout, "\toptions -i and -o have argument '-' "
 	   "as stdin/stdout\n");
   fprintf (stdout, "  -p --patch\tpatch file (default: no patch)\n");
+#ifdef ENABLE_JACK
+  fprintf (stdout, "  -jack\t\ttranscribe the live input from JACK into\n"
+	   "\t\tthe MIDI output port until Ctrl-C, instead of -i and -o.\n"
+	   "\t\tthe latency is traded for the resolution by -n and -s\n"
+	   "\t\t(at the samplerate of JACK), and -flush is the number\n"
+	   "\t\tof steps to wait for the removal of short notes.\n"
+	   "\t\t(default: 0 = send the notes at the step found)\n");
+#endif // ENABLE_JACK
   fprintf (stdout, "FFT OPTIONS\n");
   fprintf (stdout, "  -n\t\tsampling number from WAV in 1 step "
 	   "(default: 2048)\n");
@@ -86,9 +99,27 @@ void print_usage (char * argv0)
   fprintf (stdout, "READING WAV OPTIONS\n");
   fprintf (stdout, "  -s --shift\tshift number from WAV in 1 step\n");
   fprintf (stdout, "\t\t(default: 1/4 of the value in -n option)\n");
+  fprintf (stdout, "  -nodecim\tdon't decimate the input.\n"
+	   "\t\t(default: decimate to the lowest samplerate\n"
+	   "\t\tcovering the note in -t option, where the values\n"
+	   "\t\tin -n and -s options are reduced by the same factor,\n"
+	   "\t\tand no decimation with -p option)\n");
+  fprintf (stdout, "  -flush\twrite the notes into the output during the analysis,\n"
+	   "\t\twhere the notes sounding longer than this number\n"
+	   "\t\tof steps are written with the velocity at that time.\n"
+	   "\t\tthe memory is bounded for the long input.\n"
+	   "\t\t(not for the output to stdout)\n"
+	   "\t\t(default: 0 = write all notes at the end)\n");
+  fprintf (stdout, "  --stats\tprint the time of each stage of the analysis,\n"
+	   "\t\tframes per second and realtime factor to stderr\n");
+  fprintf (stdout, "  -stats-json\tfile name to write the report of --stats in JSON\n"
+	   "\t\t(\"-\" for stdout, unless the output -o is stdout)\n");
   fprintf (stdout, "PHASE-VOCODER OPTIONS\n");
   fprintf (stdout, "  -nophase\tdon't use phase diff to improve freq estimation.\n"
 	   "\t\t(default: use the correction)\n");
+  fprintf (stdout, "  -fast-phase\tuse the approximate atan2 for the phase,\n"
+	   "\t\twhose error is less than 1.2e-5 rad.\n"
+	   "\t\t(default: use the exact atan2)\n");
   fprintf (stdout, "NOTE SELECTION OPTIONS\n");
   fprintf (stdout, "  -c --cutoff\tlog10 of cut-off ratio "
 	   "to scale velocity of note\n"
@@ -111,6 +142,15 @@ void print_usage (char * argv0)
 	   "which is suggested by WaoN after analysis.\n"
 	   "\t\tunit is half-note, that is, +1 is half-note up,\n"
 	   "\t\tand -0.5 is quater-note down. (default: 0)\n");
+  fprintf (stdout, "  -silence\tpeak amplitude at or below which"
+	   " the step is regarded as silence\n"
+	   "\t\tand skipped without FFT. the amplitude is in [0,1].\n"
+	   "\t\t(default: 0 = digital silence only)\n");
+  fprintf (stdout, "  -flux\t\tthreshold of the spectral flux,"
+	   " below which the notes at the last step\n"
+	   "\t\tare kept without picking up notes again.\n"
+	   "\t\tthe flux is the relative change of the amplitude\n"
+	   "\t\tin the note range. (default: 0 = no skip)\n");
   fprintf (stdout, "DRUM-REMOVAL OPTIONS\n");
   fprintf (stdout, "  -psub-n\tnumber of averaging bins in one side.\n"
 	   "\t\tthat is, for n, (i-n,...,i,...,i+n) are averaged\n"
@@ -124,16 +164,47 @@ void print_usage (char * argv0)
 	   " where the power is modified as\n"
 	   "\t\tp[i] = (sqrt(p[i]) - f * sqrt(oct[i]))^2\n"
 	   "\t\t(default: 0.0)\n");
+  fprintf (stdout, "  -harm3\tfactor to the 3rd harmonic removal,"
+	   " as -oct option (default: 0.0)\n");
+  fprintf (stdout, "  -harm5\tfactor to the 5th harmonic removal,"
+	   " as -oct option (default: 0.0)\n");
+  fprintf (stdout, "MULTI-RESOLUTION OPTIONS\n");
+  fprintf (stdout, "  -multi\tanalyse bass, mid and treble by different FFT"
+	   " lengths,\n"
+	   "\t\tthat is, 8, 2 and 1/2 times of the value in -n option.\n"
+	   "\t\tthe default of -s option becomes 1/8 of -n.\n"
+	   "\t\t(default: single FFT length for all notes)\n");
+  fprintf (stdout, "  -multi-l\tlowest note [midi #] of the mid band"
+	   " (default: 48 = C3)\n");
+  fprintf (stdout, "  -multi-h\tlowest note [midi #] of the treble band"
+	   " (default: 72 = C5)\n");
+}
+
+/* read the input through the decimation stage, if any
+ * INPUT
+ *  dec : struct WAON_decimate, or NULL for no decimation
+ *  len : number of samples (at the decimated rate)
+ *  buf[len * sfinfo.channels] : work area of sndfile_read()
+ * OUTPUT
+ *  returned value : number of samples read
+ */
+static long
+read_input (SNDFILE *sf, SF_INFO sfinfo, struct WAON_decimate *dec,
+	    double *left, double *right, int len, double *buf)
+{
+  if (dec == NULL)
+    {
+      return (sndfile_read (sf, sfinfo, left, right, len, buf));
+    }
+  else
+    {
+      return (WAON_decimate_read (dec, left, right, len));
+    }
 }
 
 
 int main (int argc, char** argv)
 {
-  extern int abs_flg; /* flag for absolute/relative cutoff  */
-  extern double adj_pitch;
-  extern double pitch_shift;
-  extern int n_pitch;
-
   char *file_midi = NULL;
   char *file_wav = NULL;
   char *file_patch = NULL;
@@ -151,19 +222,34 @@ int main (int argc, char** argv)
   int notetop = 103; /* G8  */
   int notelow = 28; /* E2  */
 
-  abs_flg = 1;
+  int abs_flg = 1; /* flag for absolute/relative cutoff  */
 
   long hop = 0;
   int show_help = 0;
   int show_version = 0;
-  adj_pitch = 0.0;
+  double adj_pitch = 0.0;
   /* to select peaks in a note  */
   int peak_threshold = 128; /* this means no peak search  */
 
   int flag_phase = 1; // use the phase correction
+  int flag_fast_phase = 0; // use the exact atan2()
   int psub_n = 0;
   double psub_f = 0.0;
   double oct_f = 0.0;
+  double harm3_f = 0.0;
+  double harm5_f = 0.0;
+  double flux_th = 0.0;
+  double silence = 0.0;
+  int flag_multi = 0; // single resolution
+  int multi_l = 48; // C3
+  int multi_h = 72; // C5
+  int flag_decim = 1; // decimate the input if possible
+  int flush = 0; // write all notes at the end
+  int flag_stats = 0; // no timing report
+  char *file_stats = NULL; // no JSON report
+#ifdef ENABLE_JACK
+  int flag_jack = 0; // read the sound file
+#endif // ENABLE_JACK
   for (i = 1; i < argc; i++)
     {
       if ((strcmp (argv[i], "-input" ) == 0)
@@ -338,6 +424,10 @@ int main (int argc, char** argv)
 	{
 	  flag_phase = 0;
 	}
+      else if (strcmp (argv[i], "-fast-phase") == 0)
+	{
+	  flag_fast_phase = 1;
+	}
       else if (strcmp (argv[i], "-psub-n") == 0)
 	{
 	  if ( i+1 < argc )
@@ -374,6 +464,121 @@ int main (int argc, char** argv)
 	      break;
 	    }
 	}
+      else if (strcmp (argv[i], "-silence") == 0)
+	{
+	  if ( i+1 < argc )
+	    {
+	      silence = atof (argv[++i]);
+	    }
+	  else
+	    {
+	      show_help = 1;
+	      break;
+	    }
+	}
+      else if (strcmp (argv[i], "-flux") == 0)
+	{
+	  if ( i+1 < argc )
+	    {
+	      flux_th = atof (argv[++i]);
+	    }
+	  else
+	    {
+	      show_help = 1;
+	      break;
+	    }
+	}
+      else if (strcmp (argv[i], "-harm3") == 0)
+	{
+	  if ( i+1 < argc )
+	    {
+	      harm3_f = atof (argv[++i]);
+	    }
+	  else
+	    {
+	      show_help = 1;
+	      break;
+	    }
+	}
+      else if (strcmp (argv[i], "-harm5") == 0)
+	{
+	  if ( i+1 < argc )
+	    {
+	      harm5_f = atof (argv[++i]);
+	    }
+	  else
+	    {
+	      show_help = 1;
+	      break;
+	    }
+	}
+      else if (strcmp (argv[i], "-flush") == 0)
+	{
+	  if ( i+1 < argc )
+	    {
+	      flush = atoi (argv[++i]);
+	    }
+	  else
+	    {
+	      show_help = 1;
+	      break;
+	    }
+	}
+      else if ((strcmp (argv[i], "-stats") == 0)
+	       || (strcmp (argv[i], "--stats") == 0))
+	{
+	  flag_stats = 1;
+	}
+      else if (strcmp (argv[i], "-stats-json") == 0)
+	{
+	  if ( i+1 < argc )
+	    {
+	      file_stats = argv[++i];
+	    }
+	  else
+	    {
+	      show_help = 1;
+	      break;
+	    }
+	}
+      else if (strcmp (argv[i], "-nodecim") == 0)
+	{
+	  flag_decim = 0;
+	}
+#ifdef ENABLE_JACK
+      else if (strcmp (argv[i], "-jack") == 0)
+	{
+	  flag_jack = 1;
+	}
+#endif // ENABLE_JACK
+      else if (strcmp (argv[i], "-multi") == 0)
+	{
+	  flag_multi = 1;
+	}
+      else if (strcmp (argv[i], "-multi-l") == 0)
+	{
+	  if ( i+1 < argc )
+	    {
+	      multi_l = atoi (argv[++i]);
+	    }
+	  else
+	    {
+	      show_help = 1;
+	      break;
+	    }
+	}
+      else if (strcmp (argv[i], "-multi-h") == 0)
+	{
+	  if ( i+1 < argc )
+	    {
+	      multi_h = atoi (argv[++i]);
+	    }
+	  else
+	    {
+	      show_help = 1;
+	      break;
+	    }
+	}
       else if (strcmp (argv[i], "-v") == 0 ||
 	       strcmp (argv[i], "--version") == 0)
 	{
@@ -395,75 +600,67 @@ int main (int argc, char** argv)
       exit (1);
     }
 
+  if (notelow < 0 || notetop > 127 || notelow > notetop)
+    {
+      fprintf (stderr, "invalid range of the notes (%d to %d)\n",
+	       notelow, notetop);
+      exit (1);
+    }
+
 #ifdef __MINGW32__
       _setmode(_fileno(stdin),_O_BINARY);
       _setmode(_fileno(stdout),_O_BINARY);
 #endif
 
-  if (flag_window < 0 || flag_window > 6)
-    {
-      flag_window = 0;
-    }
   if (hop == 0)
     {
-      hop = len / 4;
-    }
-  if (psub_n == 0) psub_f = 0.0;
-  if (psub_f == 0.0) psub_n = 0;
-
-
-  struct WAON_notes *notes = WAON_notes_init();
-  CHECK_MALLOC (notes, "main");
-  char vel[128];     // velocity at the current step
-  int on_event[128]; // event index of struct WAON_notes.
-  for (i = 0; i < 128; i ++)
-    {
-      vel[i]      = 0;
-      on_event[i] = -1;
+      if (flag_multi == 0)
+	{
+	  hop = len / 4;
+	}
+      else
+	{
+	  // 1/4 of the FFT length of the treble band
+	  hop = len / 8;
+	}
     }
 
-  // allocate buffers
-  double *left  = (double *)malloc (sizeof (double) * len);
-  double *right = (double *)malloc (sizeof (double) * len);
-  CHECK_MALLOC (left,  "main");
-  CHECK_MALLOC (right, "main");
 
-  double *x = NULL; /* wave data for FFT  */
-  double *y = NULL; /* spectrum data for FFT */ 
-#ifdef FFTW2
-  x = (double *)malloc (sizeof (double) * len);
-  y = (double *)malloc (sizeof (double) * len);
-#else // FFTW3
-  x = (double *)fftw_malloc (sizeof (double) * len);
-  y = (double *)fftw_malloc (sizeof (double) * len);
-#endif // FFTW2
-  CHECK_MALLOC (x, "main");
-  CHECK_MALLOC (y, "main");
-
-  /* power spectrum  */
-  double *p = (double *)malloc (sizeof (double) * (len / 2 + 1));
-  CHECK_MALLOC (p, "main");
-
-  double *p0 = NULL;
-  double *dphi = NULL;
-  double *ph0 = NULL;
-  double *ph1 = NULL;
-  if (flag_phase != 0)
+  // the transcription engine
+  struct WAON_params params;
+  WAON_params_default (&params);
+  params.len = len;
+  params.hop = hop;
+  params.flag_window = flag_window;
+  params.notelow = notelow;
+  params.notetop = notetop;
+  params.flag_phase = flag_phase;
+  params.flag_fast_phase = flag_fast_phase;
+  params.flag_multi = flag_multi;
+  params.multi_l = multi_l;
+  params.multi_h = multi_h;
+  params.abs_flg = abs_flg;
+  params.cut_ratio = cut_ratio;
+  params.rel_cut_ratio = rel_cut_ratio;
+  params.peak_threshold = peak_threshold;
+  params.adj_pitch = adj_pitch;
+  params.psub_n = psub_n;
+  params.psub_f = psub_f;
+  params.oct_f = oct_f;
+  params.harm3_f = harm3_f;
+  params.harm5_f = harm5_f;
+  params.flux_th = flux_th;
+  params.silence = silence;
+  params.file_patch = file_patch;
+
+#ifdef ENABLE_JACK
+  if (flag_jack != 0)
     {
-      p0 = (double *)malloc (sizeof (double) * (len / 2 + 1));
-      CHECK_MALLOC (p0, "main");
-
-      dphi = (double *)malloc (sizeof (double) * (len / 2 + 1));
-      CHECK_MALLOC (dphi, "main");
-
-      ph0 = (double *)malloc (sizeof (double) * (len/2+1));
-      ph1 = (double *)malloc (sizeof (double) * (len/2+1));
-      CHECK_MALLOC (ph0, "main");
-      CHECK_MALLOC (ph1, "main");
+      // live input at the samplerate of JACK (no decimation)
+      if (waon_jack (&params, flush) != 0) exit (1);
+      return 0;
     }
-
-  double *pmidi = (double *)malloc (sizeof (double) * 128);
-  CHECK_MALLOC (pmidi, "main");
+#endif // ENABLE_JACK
 
 
   // MIDI output
@@ -473,6 +670,21 @@ int main (int argc, char** argv)
       CHECK_MALLOC (file_midi, "main");
       strcpy (file_midi, "output.mid");
     }
+  if (flush > 0 && strcmp (file_midi, "-") == 0)
+    {
+      // the track length is written at the end by seeking back
+      fprintf (stderr, "-flush cannot write to stdout,"
+	       " which is not seekable\n");
+      exit (1);
+    }
+  if (file_stats != NULL
+      && strcmp (file_stats, "-") == 0
+      && strcmp (file_midi, "-") == 0)
+    {
+      // the JSON would be mixed into the MIDI stream
+      fprintf (stderr, "-stats-json and -o cannot be both stdout\n");
+      exit (1);
+    }
 
   // open input wav file
   if (file_wav == NULL)
@@ -500,225 +712,97 @@ int main (int argc, char** argv)
     }
 
 
-  // time-period for FFT (inverse of smallest frequency)
-  double t0 = (double)len/(double)sfinfo.samplerate;
-
-  // weight of window function for FFT
-  double den = init_den (len, flag_window);
-
-  /* set range to analyse (search notes) */
-  /* -- after 't0' is calculated  */
-  int i0 = (int)(mid2freq[notelow]*t0 - 0.5);
-  int i1 = (int)(mid2freq[notetop]*t0 - 0.5)+1;
-  if (i0 <= 0)
+  /* decimate the input down to the lowest samplerate covering notetop
+   * (a half-note above for the margin),
+   * where len and hop are reduced by the same factor
+   * to keep the frequency resolution and the time step.
+   * the patch file is read at its own samplerate, so that no decimation
+   * is made with the patch.
+   */
+  double samplerate = (double)sfinfo.samplerate;
+  double freq_top = mid2freq[notetop] * pow (2.0, 1.0 / 12.0);
+  int decim = 1;
+  if (flag_decim != 0 && file_patch == NULL)
     {
-      i0 = 1; // i0=0 means DC component (frequency = 0)
+      // for the multi resolution, the shortest FFT is len/2
+      decim = WAON_decimate_factor (samplerate, freq_top,
+				    (flag_multi == 0 ? len : len / 2),
+				    hop);
     }
-  if (i1 >= (len/2))
+  struct WAON_decimate *dec = NULL;
+  if (decim > 1)
     {
-      i1 = len/2 - 1;
+      dec = WAON_decimate_init (decim, samplerate, freq_top,
+				sf, &sfinfo);
+      len /= decim;
+      hop /= decim;
+      params.len = len;
+      params.hop = hop;
+      samplerate /= (double)decim;
+      fprintf (stderr, "WaoN : decimation by %d (samplerate %.0f)\n",
+	       decim, samplerate);
     }
 
-  // init patch
-  init_patch (file_patch, len, flag_window);
-  /*                      ^^^ len could be given by option separately  */
-
-  // initialization plan for FFTW
-#ifdef FFTW2
-  rfftw_plan plan;
-  plan = rfftw_create_plan (len, FFTW_REAL_TO_COMPLEX, FFTW_ESTIMATE);
-#else // FFTW3
-  fftw_plan plan;
-  plan = fftw_plan_r2r_1d (len, x, y, FFTW_R2HC, FFTW_ESTIMATE);
-#endif
 
-  // for first step
-  if (hop != len)
+  struct WAON *waon = WAON_init (&params, samplerate, sfinfo.channels);
+  if (waon == NULL)
     {
-      if (sndfile_read (sf, sfinfo,
-			left + hop,
-			right + hop,
-			(len - hop))
-	  != (len - hop))
-	{
-	  fprintf (stderr, "No Wav Data!\n");
-	  exit(0);
-	}
+      fprintf (stderr, "cannot initialize the analysis\n");
+      exit (1);
     }
-
-  /** main loop (icnt) **/
-  pitch_shift = 0.0;
-  n_pitch = 0;
-  int icnt; /* counter  */
-  for (icnt=0; ; icnt++)
+  struct WAON_stats *stats = NULL;
+  if (flag_stats != 0 || file_stats != NULL)
     {
-      // shift
-      for (i = 0; i < len - hop; i ++)
-	{
-	  if (sfinfo.channels == 2) // stereo
-	    {
-	      left  [i] = left  [i + hop];
-	      right [i] = right [i + hop];
-	    }
-	  else // mono
-	    {
-	      left  [i] = left  [i + hop];
-	    }
-	}
-      // read from wav
-      if (sndfile_read (sf, sfinfo,
-			left  + (len - hop),
-			right + (len - hop),
-			hop)
-	  != hop)
-	{
-	  fprintf (stderr, "WaoN : end of file.\n");
-	  break;
-	}
-
-      // set double table x[] for FFT
-      for (i = 0; i < len; i ++)
-	{
-	  if (sfinfo.channels == 2) // stereo
-	    {
-	      x [i] = 0.5 * (left [i] + right [i]);
-	    }
-	  else // mono
-	    {
-	      x [i] = left [i];
-	    }
-	}
-
-      /**
-       * stage 1: calc power spectrum
-       */
-      windowing (len, x, flag_window, 1.0, x);
-
-      /* FFTW library  */
-#ifdef FFTW2
-      rfftw_one (plan, x, y);
-#else // FFTW3
-      fftw_execute (plan); // x[] -> y[]
-#endif
-
-      if (flag_phase == 0)
-	{
-	  // no phase-vocoder correction
-	  HC_to_amp2 (len, y, den, p);
-	}
-      else
-	{
-	  // with phase-vocoder correction
-	  HC_to_polar2 (len, y, 0, den, p, ph1);
-
-	  if (icnt == 0) // first step, so no ph0[] yet
-	    {
-	      for (i = 0; i < (len/2+1); ++i) // full span
-		{
-		  // no correction
-		  dphi[i] = 0.0;
-
-		  // backup the phase for the next step
-		  p0  [i] = p   [i];
-		  ph0 [i] = ph1 [i];
-		}	  
-	    }
-	  else // icnt > 0
-	    {
-	      // freq correction by phase difference
-	      for (i = 0; i < (len/2+1); ++i) // full span
-		{
-		  double twopi = 2.0 * M_PI;
-		  //double dphi;
-		  dphi[i] = ph1[i] - ph0[i]
-		    - twopi * (double)i / (double)len * (double)hop;
-		  for (; dphi[i] >= M_PI; dphi[i] -= twopi);
-		  for (; dphi[i] < -M_PI; dphi[i] += twopi);
-
-		  // frequency correction
-		  // NOTE: freq is (i / len + dphi) * samplerate [Hz]
-		  dphi[i] = dphi[i] / twopi / (double)hop;
-
-		  // backup the phase for the next step
-		  p0  [i] = p   [i];
-		  ph0 [i] = ph1 [i];
-
-		  // then, average the power for the analysis
-		  p[i] = 0.5 *(sqrt (p[i]) + sqrt (p0[i]));
-		  p[i] = p[i] * p[i];
-		}
-	    }
-	}
-
-      // drum-removal process
-      if (psub_n != 0)
+      stats = WAON_stats_init ();
+      WAON_set_stats (waon, stats);
+    }
+  if (flush > 0)
+    {
+      if (WAON_stream_midi (waon, file_midi, flush) != 0)
 	{
-	  power_subtract_ave (len, p, psub_n, psub_f);
+	  fprintf (stderr, "cannot write %s\n", file_midi);
+	  exit (1);
 	}
+    }
 
-      // octave-removal process
-      if (oct_f != 0.0)
-	{
-	  power_subtract_octave (len, p, oct_f);
-	}
+  // allocate buffers
+  double *left  = (double *)malloc (sizeof (double) * hop);
+  double *right = (double *)malloc (sizeof (double) * hop);
+  double *buf   = (double *)malloc (sizeof (double) * hop * sfinfo.channels);
+  CHECK_MALLOC (left,  "main");
+  CHECK_MALLOC (right, "main");
+  CHECK_MALLOC (buf,   "main");
 
-      /**
-       * stage 2: pickup notes
-       */
-      /* new code
-      if (flag_phase == 0)
-	{
-	  average_FFT_into_midi (len, (double)sfinfo.samplerate,
-				 p, NULL,
-				 pmidi);
-	}
-      else
-	{
-	  average_FFT_into_midi (len, (double)sfinfo.samplerate,
-				 p, dphi,
-				 pmidi);
-	}
-      pickup_notes (pmidi,
-		    cut_ratio, rel_cut_ratio,
-		    notelow, notetop,
-		    vel);
-      */
 
-      /* old code */
-      if (flag_phase == 0)
+  /** main loop **/
+  long nread = 0; // number of samples read
+  for (;;)
+    {
+      // read from wav
+      double t = 0.0;
+      if (stats != NULL) t = WAON_stats_clock ();
+      long n = read_input (sf, sfinfo, dec, left, right, hop, buf);
+      WAON_STATS_LAP (stats, WAON_STAT_READ, &t);
+      if (n > 0)
 	{
-	  // no phase-vocoder correction
-	  note_intensity (p, NULL,
-			  cut_ratio, rel_cut_ratio, i0, i1, t0, vel);
+	  WAON_process (waon, left, right, n);
+	  nread += n;
 	}
-      else
+      if (n != hop)
 	{
-	  // with phase-vocoder correction
-	  // make corrected frequency (i / len + dphi) * samplerate [Hz]
-	  for (i = 0; i < (len/2+1); ++i) // full span
-	    {
-	      dphi[i] = ((double)i / (double)len + dphi[i])
-		* (double)sfinfo.samplerate;
-	    }
-	  note_intensity (p, dphi,
-			  cut_ratio, rel_cut_ratio, i0, i1, t0, vel);
+	  fprintf (stderr, "WaoN : end of file.\n");
+	  break;
 	}
-
-      /**
-       * stage 3: check previous time for note-on/off
-       */
-      WAON_notes_check (notes, icnt, vel, on_event,
-			8, 0, peak_threshold);
+    }
+  if (nread == 0)
+    {
+      fprintf (stderr, "No Wav Data!\n");
+      exit(0);
     }
 
 
   // clean notes
-  WAON_notes_regulate (notes);
-
-  WAON_notes_remove_shortnotes (notes, 1, 64);
-  WAON_notes_remove_shortnotes (notes, 2, 28);
-
-  WAON_notes_remove_octaves (notes);
+  WAON_finish (waon);
 
 
   /*
@@ -731,32 +815,53 @@ int main (int argc, char** argv)
   /* div is the divisions for one beat (quater-note).
    * here we assume 120 BPM, that is, 1 beat is 0.5 sec.
    * note: (hop / ft->rate) = duration for 1 step (sec) */
-  long div = (long)(0.5 * (double)sfinfo.samplerate / (double) hop);
-  fprintf (stderr, "division = %ld\n", div);
-  fprintf (stderr, "WaoN : # of events = %d\n", notes->n);
-
-  WAON_notes_output_midi (notes, div, file_midi);
+  fprintf (stderr, "division = %ld\n", WAON_get_division (waon));
+  if (flush == 0)
+    {
+      fprintf (stderr, "WaoN : # of events = %d\n",
+	       WAON_get_notes (waon)->n);
+      WAON_write_midi (waon, file_midi);
+    }
 
+  if (stats != NULL)
+    {
+      // duration of the input at the (decimated) samplerate
+      double duration = (double)nread / samplerate;
+      WAON_stats_stop (stats);
+      if (flag_stats != 0)
+	{
+	  WAON_stats_print (stats, duration, stderr);
+	}
+      if (file_stats != NULL)
+	{
+	  if (strcmp (file_stats, "-") == 0)
+	    {
+	      WAON_stats_print_json (stats, duration, stdout);
+	    }
+	  else
+	    {
+	      FILE *fp = fopen (file_stats, "w");
+	      if (fp == NULL)
+		{
+		  fprintf (stderr, "cannot write %s\n", file_stats);
+		}
+	      else
+		{
+		  WAON_stats_print_json (stats, duration, fp);
+		  fclose (fp);
+		}
+	    }
+	}
+      WAON_stats_free (stats);
+    }
 
-#ifdef FFTW2
-  rfftw_destroy_plan (plan);
-#else
-  fftw_destroy_plan (plan);
-#endif /* FFTW2 */
 
+  WAON_free (waon);
+  WAON_decimate_free (dec);
 
-  WAON_notes_free (notes);
   free (left);
   free (right);
-  free (x);
-  free (y);
-  free (p);
-  if (p0 != NULL) free (p0);
-  if (dphi != NULL) free (dphi);
-  if (ph0 != NULL) free (ph0);
-  if (ph1 != NULL) free (ph1);
-
-  if (pmidi != NULL) free (pmidi);
+  free (buf);
 
   if (file_wav  != NULL) free (file_wav);
   if (file_midi != NULL) free (file_midi);
@@ -23,6 +23,7 @@
 #include <fcntl.h> // open(), fcntl()
 #include <sys/stat.h> // S_IRUSR, S_IWUSR
 #include <math.h> // log()
+#include "memory-check.h" // CHECK_MALLOC() macro
 
 #include "notes.h" // struct WAON_notes
 
@@ -114,6 +115,18 @@ logf_to_midi (double logf)
 }
 
 
+/* get std MIDI note from frequency
+ * taken into account adj_pitch (in half-notes)
+ * (reentrant version of get_note() without the pitch_shift statistics)
+ */
+int
+get_note_adj (double freq, double adj_pitch)
+{
+  const double factor = 1.731234049066756242e+01; /* 12/log(2)  */
+  /* MIDI note # 69 is A4(440Hz)  */
+  return ((int)(69.5 + factor * log(freq/440.0) + adj_pitch));
+}
+
 /* get std MIDI note from frequency
  * taken into account (global) adj_pitch
  * collecting information for (global) pitch_shift
@@ -316,17 +329,20 @@ wbshort (int fd, unsigned short us)
 }
 
 
-/* MIDI output for WAON_notes
+/* open the standard MIDI file to write the events one by one
  * INPUT
- *  notes    : struct WAON_notes
+ *  filename : filename of output midi file ("-" for stdout)
  *  div      : divisioin
- *  filename : filename of output midi file
+ *  nevents  : number of events to write, for the track length
+ *             on the non-seekable output such as stdout
+ *             (it is corrected at the end for the normal file),
+ *             or -1 if unknown
+ * OUTPUT
+ *  returned value : struct WAON_midi, or NULL on error
  */
-void
-WAON_notes_output_midi (struct WAON_notes *notes,
-			double div, char *filename)
+struct WAON_midi *
+WAON_midi_open (const char *filename, double div, int nevents)
 {
-  fprintf (stderr, "WAON_notes : n = %d\n", notes->n);
   fprintf (stderr, "filename : %s\n", filename);
   /* file open */
   int fd; /* file descriptor of output midi file  */
@@ -351,126 +367,192 @@ WAON_notes_output_midi (struct WAON_notes *notes,
       exit (1);
     }
 
+  struct WAON_midi *midi
+    = (struct WAON_midi *)malloc (sizeof (struct WAON_midi));
+  CHECK_MALLOC (midi, "WAON_midi_open");
+  midi->fd = fd;
+  midi->flag_stdout = flag_stdout;
+  midi->nevents = nevents;
+  midi->n = 0;
+  midi->last_step = 0;
+
   /* MIDI header */
-  int p_midi;
   int n_midi;
-  p_midi = 0;
+  midi->p_midi = 0;
   n_midi = smf_header_fmt (fd, 0, 1, div);
   if (n_midi != 14)
     {
-      fprintf (stderr, "Error during writing mid! %d (header)\n", p_midi);
-      return;
+      fprintf (stderr, "Error during writing mid! %d (header)\n",
+	       midi->p_midi);
+      close (fd);
+      free (midi);
+      return (NULL);
     }
-  p_midi += n_midi;
+  midi->p_midi += n_midi;
 
-  int h_midi; /* pointer of track header  */
-  h_midi = p_midi; /* pointer of track-head  */
-  int nmidi = notes->n; // number of on-off events
-  n_midi = smf_track_head (fd, (7+4*nmidi));
+  midi->h_midi = midi->p_midi; /* pointer of track-head  */
+  // the track length is unknown for nevents < 0
+  n_midi = smf_track_head (fd, (nevents < 0 ? 0 : (7+4*nevents)));
   if (n_midi != 8)
     {
-      fprintf (stderr, "Error during writing mid! %d (track header)\n", p_midi);
-      return;
+      fprintf (stderr, "Error during writing mid! %d (track header)\n",
+	       midi->p_midi);
+      close (fd);
+      free (midi);
+      return (NULL);
     }
-  p_midi += n_midi;
+  midi->p_midi += n_midi;
 
   /* head of data  */
-  int dh_midi; /* pointer of data head  */
-  dh_midi = p_midi;
+  midi->dh_midi = midi->p_midi;
 
   /* tempo set  */
   n_midi = smf_tempo (fd, 500000); // 0.5 sec => 120 bpm for 4/4
   if (n_midi != 7)
     {
-      fprintf (stderr, "Error during writing mid! %d (tempo)\n", p_midi);
-      return;
+      fprintf (stderr, "Error during writing mid! %d (tempo)\n",
+	       midi->p_midi);
+      close (fd);
+      free (midi);
+      return (NULL);
     }
-  p_midi += n_midi;
+  midi->p_midi += n_midi;
 
   /* ch.0 prog. 0  */
   n_midi = smf_prog_change (fd, 0, 0);
   if (n_midi != 3)
     {
-      fprintf (stderr, "Error during writing mid! %d (prog change)\n", p_midi);
-      return;
+      fprintf (stderr, "Error during writing mid! %d (prog change)\n",
+	       midi->p_midi);
+      close (fd);
+      free (midi);
+      return (NULL);
     }
-  p_midi += n_midi;
+  midi->p_midi += n_midi;
+
+  return (midi);
+}
 
+/* write one event, where the events should be given in the order
+ */
+void
+WAON_midi_write (struct WAON_midi *midi, const struct WAON_note_event *ev)
+{
+  int n_midi;
   int idt; /* delta time  */
-  int last_step = 0;
-  int i;
-  for (i = 0; i < notes->n; i ++)
-    {
-      /* calc delta time  */
-      if (i==0) idt = 0;
-      else      idt = notes->step[i] - last_step;
-      last_step = notes->step[i];
 
-      // for check
-      if (notes->event[i] == 1) /* start note  */
-	{
-	  n_midi = smf_note_on (fd, idt,
-				notes->note[i],
-				notes->vel[i],
-				0);
-	}
-      else /* stop note */
+  /* calc delta time  */
+  if (midi->n == 0) idt = 0;
+  else              idt = ev->step - midi->last_step;
+  midi->last_step = ev->step;
+  midi->n ++;
+
+  // for check
+  if (ev->event == 1) /* start note  */
+    {
+      n_midi = smf_note_on (midi->fd, idt,
+			    ev->note,
+			    ev->vel,
+			    0);
+    }
+  else /* stop note */
+    {
+      n_midi = smf_note_off (midi->fd, idt,
+			     ev->note,
+			     64, /* default  */
+			     0);
+    }
+  if (n_midi < 4)
+    {
+      if (ev->event == 1)
 	{
-	  n_midi = smf_note_off (fd, idt,
-				 notes->note[i],
-				 64, /* default  */
-				 0);
+	  fprintf (stderr, "Error during writing mid! %d (note-on)\n"
+		   " idt = %d, note = %d, vel = %d, n_midi = %d\n",
+		   midi->p_midi,
+		   idt, ev->note, ev->vel, n_midi);
 	}
-      if (n_midi < 4)
+      else
 	{
-	  if (notes->event[i] == 1)
-	    {
-	      fprintf (stderr, "Error during writing mid! %d (note-on)\n"
-		       " idt = %d, note = %d, vel = %d, n_midi = %d\n",
-		       p_midi,
-		       idt, notes->note[i], notes->vel[i], n_midi);
-	    }
-	  else
-	    {
-	      fprintf (stderr, "Error during writing mid! %d (note-off)\n"
-		       " idt = %d, note = %d, vel = %d, n_midi = %d\n",
-		       p_midi,
-		       idt, notes->note[i], 64, n_midi);
-	    }
-	  /*return;*/
+	  fprintf (stderr, "Error during writing mid! %d (note-off)\n"
+		   " idt = %d, note = %d, vel = %d, n_midi = %d\n",
+		   midi->p_midi,
+		   idt, ev->note, 64, n_midi);
 	}
-      p_midi += n_midi;
+      /*return;*/
     }
+  midi->p_midi += n_midi;
+}
+
+/* end the track, correct the track length if possible, and close
+ */
+void
+WAON_midi_close (struct WAON_midi *midi)
+{
+  if (midi == NULL) return;
 
-  n_midi = smf_track_end (fd);
+  int fd = midi->fd;
+  int n_midi = smf_track_end (fd);
   if (n_midi != 4)
     {
       fprintf (stderr, "Error during writing mid! %d (track end)\n",
-	       p_midi);
+	       midi->p_midi);
+      close (fd);
+      free (midi);
       return;
     }
-  p_midi += n_midi;
+  midi->p_midi += n_midi;
 
-  if (flag_stdout == 0) /* random-accessible file  */
+  if (midi->flag_stdout == 0) /* random-accessible file  */
     {
       /* re-calculate # of data in track  */
-      if (lseek (fd, h_midi, SEEK_SET) < 0)
+      if (lseek (fd, midi->h_midi, SEEK_SET) < 0)
 	{
-	  fprintf (stderr, "Error during lseek %d (re-calc)\n", h_midi);
-	  return;
+	  fprintf (stderr, "Error during lseek %d (re-calc)\n", midi->h_midi);
 	}
-      n_midi = smf_track_head (fd, (p_midi - dh_midi));
-      if (n_midi != 8)
+      else
 	{
-	  fprintf (stderr, "Error during write %d (re-calc)\n", p_midi);
-	  return;
+	  n_midi = smf_track_head (fd, (midi->p_midi - midi->dh_midi));
+	  if (n_midi != 8)
+	    {
+	      fprintf (stderr, "Error during write %d (re-calc)\n",
+		       midi->p_midi);
+	    }
 	}
     }
+  else if (midi->nevents < 0) /* stdout for the unknown length  */
+    {
+      fprintf(stderr, "WaoN warning : stdout isn't seekable to write the track length into the header. Midi players may not tolerate this.\n");
+    }
   else /* stdout  */
     {
-      if ((7 + 4 * nmidi) != (p_midi - dh_midi))
+      if ((7 + 4 * midi->nevents) != (midi->p_midi - midi->dh_midi))
 	fprintf(stderr, "WaoN warning : data size seems to differ from the header prediction, and stdout isn't seekable to correct the header. Midi players may not tolerate this.\n");
     }
 
   close (fd);
+  free (midi);
+}
+
+/* MIDI output for WAON_notes
+ * INPUT
+ *  notes    : struct WAON_notes
+ *  div      : divisioin
+ *  filename : filename of output midi file
+ */
+void
+WAON_notes_output_midi (struct WAON_notes *notes,
+			double div, const char *filename)
+{
+  fprintf (stderr, "WAON_notes : n = %d\n", notes->n);
+
+  struct WAON_midi *midi = WAON_midi_open (filename, div, notes->n);
+  if (midi == NULL) return;
+
+  struct WAON_note_event *ev;
+  WAON_notes_foreach (notes, ev)
+    {
+      WAON_midi_write (midi, ev);
+    }
+
+  WAON_midi_close (midi);
 }
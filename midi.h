@@ -46,6 +46,12 @@ logf_to_midi (double logf);
  */
 int get_note (double freq);
 
+/* get std MIDI note from frequency
+ * taken into account adj_pitch (in half-notes)
+ * (reentrant version of get_note() without the pitch_shift statistics)
+ */
+int get_note_adj (double freq, double adj_pitch);
+
 int smf_header_fmt (int fd,
 		       unsigned short format,
 		       unsigned short tracks,
@@ -62,6 +68,42 @@ int wblong (int fd, unsigned long ul);
 int wbshort (int fd, unsigned short us);
 
 
+/* writer of the standard MIDI file for the events one by one */
+struct WAON_midi {
+  int fd;
+  int flag_stdout; // 1 for stdout, where the track length is not corrected
+  int nevents; // number of events given at the open
+  int n;       // number of events written
+  int last_step;
+  int p_midi;  // current position
+  int h_midi;  // position of the track head
+  int dh_midi; // position of the data head
+};
+
+/* open the standard MIDI file to write the events one by one
+ * INPUT
+ *  filename : filename of output midi file ("-" for stdout)
+ *  div      : divisioin
+ *  nevents  : number of events to write, for the track length
+ *             on the non-seekable output such as stdout
+ *             (it is corrected at the end for the normal file),
+ *             or -1 if unknown
+ * OUTPUT
+ *  returned value : struct WAON_midi, or NULL on error
+ */
+struct WAON_midi *
+WAON_midi_open (const char *filename, double div, int nevents);
+
+/* write one event, where the events should be given in the order
+ */
+void
+WAON_midi_write (struct WAON_midi *midi, const struct WAON_note_event *ev);
+
+/* end the track, correct the track length if possible, and close
+ */
+void
+WAON_midi_close (struct WAON_midi *midi);
+
 /* MIDI output for WAON_notes
  * INPUT
  *  notes    : struct WAON_notes
@@ -70,7 +112,7 @@ int wbshort (int fd, unsigned short us);
  */
 void
 WAON_notes_output_midi (struct WAON_notes *notes,
-			double div, char *filename);
+			double div, const char *filename);
 
 
 #endif /* !_MIDI_H_ */
@@ -17,6 +17,7 @@
  */
 #include <stdio.h> // fprintf()
 #include <stdlib.h> // malloc()
+#include <string.h> // memmove()
 #include <errno.h> // errno
 #include "memory-check.h" // CHECK_MALLOC() macro
 
@@ -24,6 +25,10 @@
 
 
 
+/* initial number of records allocated for the events */
+#define WAON_NOTES_NALLOC 256
+
+
 struct WAON_notes *
 WAON_notes_init (void)
 {
@@ -32,10 +37,15 @@ WAON_notes_init (void)
   CHECK_MALLOC (notes, "WAON_notes_init");
 
   notes->n = 0;
-  notes->step  = NULL;
-  notes->event = NULL;
-  notes->note  = NULL;
-  notes->vel   = NULL;
+  notes->nalloc = 0;
+  notes->ev = NULL;
+  notes->pair = NULL;
+
+  int i;
+  for (i = 0; i < 128; i ++)
+    {
+      notes->on[i] = -1;
+    }
 
   return (notes);
 }
@@ -45,32 +55,87 @@ WAON_notes_free (struct WAON_notes *notes)
 {
   if (notes == NULL) return;
 
-  if (notes->step  != NULL) free (notes->step);
-  if (notes->event != NULL) free (notes->event);
-  if (notes->note  != NULL) free (notes->note);
-  if (notes->vel   != NULL) free (notes->vel);
+  if (notes->ev != NULL) free (notes->ev);
+  if (notes->pair != NULL) free (notes->pair);
   free (notes);
 }
 
+/* make room for one more event,
+ * where the allocation is doubled so that the appends are amortized O(1)
+ */
+static void
+WAON_notes_grow (struct WAON_notes *notes)
+{
+  if (notes->n < notes->nalloc) return;
+
+  if (notes->nalloc == 0) notes->nalloc = WAON_NOTES_NALLOC;
+  else                    notes->nalloc *= 2;
+  notes->ev = (struct WAON_note_event *)
+    realloc (notes->ev, sizeof (struct WAON_note_event) * notes->nalloc);
+  CHECK_MALLOC (notes->ev, "WAON_notes_grow");
+  notes->pair = (int *)realloc (notes->pair, sizeof (int) * notes->nalloc);
+  CHECK_MALLOC (notes->pair, "WAON_notes_grow");
+}
+
+/* link the event at index to the on-event of the note if it is off,
+ * and update the active-note table on[]
+ */
+static void
+WAON_notes_link (struct WAON_notes *notes, int index)
+{
+  struct WAON_note_event *ev = notes->ev + index;
+  int note = (int)ev->note;
+
+  notes->pair[index] = -1;
+  if (ev->event == 0)
+    {
+      // off event
+      if (notes->on[note] >= 0)
+	{
+	  notes->pair[index] = notes->on[note];
+	  notes->pair[notes->on[note]] = index;
+	}
+      notes->on[note] = -1;
+    }
+  else
+    {
+      // on event (the last on-event without off is left unpaired)
+      notes->on[note] = index;
+    }
+}
+
+/* make up the pairs and on[] from the scratch
+ * (for the changes in the middle of the events)
+ */
+static void
+WAON_notes_relink (struct WAON_notes *notes)
+{
+  int i;
+  for (i = 0; i < 128; i ++)
+    {
+      notes->on[i] = -1;
+    }
+  for (i = 0; i < notes->n; i ++)
+    {
+      WAON_notes_link (notes, i);
+    }
+}
+
 void
 WAON_notes_append (struct WAON_notes *notes,
 		   int step, char event, char note, char vel)
 {
+  WAON_notes_grow (notes);
+
+  struct WAON_note_event *ev = notes->ev + notes->n;
+  ev->step  = step;
+  ev->event = event;
+  ev->note  = note;
+  ev->vel   = vel;
+  ev->flag  = 0;
+
+  WAON_notes_link (notes, notes->n);
   notes->n ++;
-  notes->step  = (int  *)realloc (notes->step,  sizeof (int)  * (notes->n));
-  notes->event = (char *)realloc (notes->event, sizeof (char) * (notes->n));
-  notes->note  = (char *)realloc (notes->note,  sizeof (char) * (notes->n));
-  notes->vel   = (char *)realloc (notes->vel,   sizeof (char) * (notes->n));
-  CHECK_MALLOC (notes->step,  "WAON_notes_append");
-  CHECK_MALLOC (notes->event, "WAON_notes_append");
-  CHECK_MALLOC (notes->note,  "WAON_notes_append");
-  CHECK_MALLOC (notes->vel,   "WAON_notes_append");
-
-  int i = notes->n - 1; // the last element
-  notes->step [i] = step;
-  notes->event[i] = event;
-  notes->note [i] = note;
-  notes->vel  [i] = vel;
 }
 
 void
@@ -78,142 +143,117 @@ WAON_notes_insert (struct WAON_notes *notes,
 		   int index,
 		   int step, char event, char note, char vel)
 {
+  WAON_notes_grow (notes);
+
+  // shift elements (index, ..., n-1) into (index+1, ..., n)
+  memmove (notes->ev + index + 1, notes->ev + index,
+	   sizeof (struct WAON_note_event) * (notes->n - index));
   notes->n ++;
-  notes->step  = (int  *)realloc (notes->step,  sizeof (int)  * (notes->n));
-  notes->event = (char *)realloc (notes->event, sizeof (char) * (notes->n));
-  notes->note  = (char *)realloc (notes->note,  sizeof (char) * (notes->n));
-  notes->vel   = (char *)realloc (notes->vel,   sizeof (char) * (notes->n));
-  CHECK_MALLOC (notes->step,  "WAON_notes_insert");
-  CHECK_MALLOC (notes->event, "WAON_notes_insert");
-  CHECK_MALLOC (notes->note,  "WAON_notes_insert");
-  CHECK_MALLOC (notes->vel,   "WAON_notes_insert");
-
-  // copy elements (index, ..., n-2) into (index+1, ..., n-1), where
-  // n is incremented n
-  int i;
-  for (i = notes->n - 1; i > index; i --)
-    {
-      notes->step [i] = notes->step [i - 1];
-      notes->event[i] = notes->event[i - 1];
-      notes->note [i] = notes->note [i - 1];
-      notes->vel  [i] = notes->vel  [i - 1];
-    }
 
   // set data at index
-  notes->step [index] = step;
-  notes->event[index] = event;
-  notes->note [index] = note;
-  notes->vel  [index] = vel;
+  struct WAON_note_event *ev = notes->ev + index;
+  ev->step  = step;
+  ev->event = event;
+  ev->note  = note;
+  ev->vel   = vel;
+  ev->flag  = 0;
+
+  WAON_notes_relink (notes);
 }
 
 void
 WAON_notes_remove_at (struct WAON_notes *notes,
 		      int index)
 {
-  // copy elements (index+1, ..., n-1) into (index, ..., n-2)
-  int i;
-  for (i = index + 1; i < notes->n; i ++)
-    {
-      notes->step [i - 1] = notes->step [i];
-      notes->event[i - 1] = notes->event[i];
-      notes->note [i - 1] = notes->note [i];
-      notes->vel  [i - 1] = notes->vel  [i];
-    }
-
+  // shift elements (index+1, ..., n-1) into (index, ..., n-2)
+  // (the allocation is kept for the later appends)
+  memmove (notes->ev + index, notes->ev + index + 1,
+	   sizeof (struct WAON_note_event) * (notes->n - index - 1));
   notes->n --;
 
-  // resize the arrays
-  notes->step  = (int  *)realloc (notes->step,  sizeof (int)  * (notes->n));
-  notes->event = (char *)realloc (notes->event, sizeof (char) * (notes->n));
-  notes->note  = (char *)realloc (notes->note,  sizeof (char) * (notes->n));
-  notes->vel   = (char *)realloc (notes->vel,   sizeof (char) * (notes->n));
-  CHECK_MALLOC (notes->step,  "WAON_notes_remove_at");
-  CHECK_MALLOC (notes->event, "WAON_notes_remove_at");
-  CHECK_MALLOC (notes->note,  "WAON_notes_remove_at");
-  CHECK_MALLOC (notes->vel,   "WAON_notes_remove_at");
+  WAON_notes_relink (notes);
 }
 
-// shift indices in on_index[] larger than i_rm
-// where i_rm is the removed index
-void
-check_on_index_for_remove (int* on_index, int i_rm)
+/* duration of the note started by the on-event at index
+ * OUTPUT
+ *  returned value : duration in steps, or -1 if the event is not paired
+ */
+int
+WAON_notes_duration (struct WAON_notes *notes, int index)
 {
-  int i;
-  for (i = 0; i < 128; i ++)
-    {
-      if (on_index[i] > i_rm)
-	{
-	  on_index[i] --;
-	}
-    }
+  const struct WAON_note_event *ev = notes->ev + index;
+  int pair = notes->pair[index];
+  if (ev->event != 1 || pair < 0) return (-1);
+  return (notes->ev[pair].step - ev->step);
 }
-void
-WAON_notes_regulate (struct WAON_notes *notes)
-{
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_remove_regulate");
-  CHECK_MALLOC (on_index, "WAON_notes_remove_regulate");
 
+/* rebuild the events in one pass, where
+ *  - on-events flagged by drop[] are removed with their off-events,
+ *  - orphant off-events (without on-event) are removed,
+ *  - off-event is inserted before the on-event on the note already on.
+ * INPUT
+ *  drop[n] : 1 for the on-events to remove (NULL for no removal)
+ */
+static void
+WAON_notes_rebuild (struct WAON_notes *notes, const char *drop)
+{
+  struct WAON_notes *tmp = WAON_notes_init ();
   int i;
-  for (i = 0; i < 128; i ++)
-    {
-      on_step [i] = -1;
-      on_index[i] = -1;
-    }
-
-  int index;
-  for (index = 0; index < notes->n; index ++)
+  for (i = 0; i < notes->n; i ++)
     {
-      int note = (int)notes->note[index];
-
+      const struct WAON_note_event *ev = notes->ev + i;
+      int note = (int)ev->note;
+      int pair = notes->pair[i];
 
-      if (notes->event[index] == 0)
+      if (ev->event == 0)
 	{
 	  // off event
-	  if (on_step[note] < 0 || on_index[note] < 0)
-	    {
-	      // no on event on the note
-	      // so remove this orphant off event
-	      WAON_notes_remove_at (notes, index);
-	      index --;
-	    }
-
-	  // reset on_step[] and on_index[]
-	  on_step [note] = -1;
-	  on_index[note] = -1;
+	  if (drop != NULL && pair >= 0 && drop[pair] != 0) continue;
+	  if (tmp->on[note] < 0) continue; // orphant
 	}
-      else if (notes->event[index] == 1)
+      else if (ev->event == 1)
 	{
 	  // on event
-	  if (on_step[note] >= 0 && on_index[note] >= 0)
+	  if (tmp->on[note] >= 0)
 	    {
 	      // the note is already on
 	      // so, insert off event here
-	      WAON_notes_insert (notes, index,
-				 notes->step[index],
+	      WAON_notes_append (tmp, ev->step,
 				 0,    // off
 				 note,
 				 64);  // default
-	      index ++;
 	    }
-
-	  // set on_step[] and on_index[]
-	  on_step [note] = notes->step[index];
-	  on_index[note] = index;
+	  if (drop != NULL && drop[i] != 0) continue;
 	}
       else
 	{
 	  fprintf (stderr, "# error: invalid event type %d\n",
-		   notes->event[index]);
+		   ev->event);
+	  continue;
 	}
+
+      WAON_notes_append (tmp, ev->step, ev->event, ev->note, ev->vel);
     }
 
+  // swap the contents and free the old ones
+  struct WAON_notes swap = *notes;
+  *notes = *tmp;
+  *tmp = swap;
+  WAON_notes_free (tmp);
+}
+
+void
+WAON_notes_regulate (struct WAON_notes *notes)
+{
+  WAON_notes_rebuild (notes, NULL);
+
   // check if on note left
-  int last_step = notes->step[notes->n - 1];
+  if (notes->n == 0) return;
+  int last_step = notes->ev[notes->n - 1].step;
+  int i;
   for (i = 0; i < 128; i ++)
     {
-      if (on_step[i] < 0) continue;
+      if (notes->on[i] < 0) continue;
 
       WAON_notes_append (notes,
 			 last_step + 1,
@@ -221,9 +261,6 @@ WAON_notes_regulate (struct WAON_notes *notes)
 			 (char)i,
 			 64);
     }
-
-  free (on_step);
-  free (on_index);
 }
 
 void
@@ -231,86 +268,20 @@ WAON_notes_remove_shortnotes (struct WAON_notes *notes,
 			      int min_duration,
 			      int min_vel)
 {
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_remove_shortnotes");
-  CHECK_MALLOC (on_index, "WAON_notes_remove_shortnotes");
+  char *drop = (char *)malloc (sizeof (char) * (notes->n + 1));
+  CHECK_MALLOC (drop, "WAON_notes_remove_shortnotes");
 
   int i;
-  for (i = 0; i < 128; i ++)
+  for (i = 0; i < notes->n; i ++)
     {
-      on_step [i] = -1;
-      on_index[i] = -1;
+      int duration = WAON_notes_duration (notes, i);
+      drop[i] = (duration >= 0
+		 && duration <= min_duration
+		 && (int)notes->ev[i].vel <= min_vel);
     }
+  WAON_notes_rebuild (notes, drop);
 
-  int index;
-  for (index = 0; index < notes->n; index ++)
-    {
-      int note = (int)notes->note[index];
-
-
-      if (notes->event[index] == 0)
-	{
-	  // off event
-	  if (on_step[note] < 0 || on_index[note] < 0)
-	    {
-	      // no on event on the note
-	      // so remove this orphant off event
-	      WAON_notes_remove_at (notes, index);
-	      index --;
-	    }
-	  else
-	    {
-	      int vel = (int)notes->vel[on_index[note]];
-	      int duration = notes->step[index] - on_step[note];
-	      if (duration <= min_duration && vel <= min_vel)
-		{
-		  // remove these on and off events on the note
-		  WAON_notes_remove_at (notes, index);
-		  index --;
-
-		  int index_on = on_index[note];
-		  WAON_notes_remove_at (notes, index_on);
-		  index --;
-
-		  // need to shift indices on on_index[]
-		  check_on_index_for_remove (on_index, index_on);
-		}
-	    }
-
-	  // reset on_step[] and on_index[]
-	  on_step [note] = -1;
-	  on_index[note] = -1;
-	}
-      else if (notes->event[index] == 1)
-	{
-	  // on event
-	  if (on_step[note] >= 0 && on_index[note] >= 0)
-	    {
-	      // the note is already on
-	      // so, insert off event here
-	      WAON_notes_insert (notes, index,
-				 notes->step[index],
-				 0,    // off
-				 note,
-				 64);  // default
-	      index ++;
-	    }
-
-	  // set on_step[] and on_index[]
-	  on_step [note] = notes->step[index];
-	  on_index[note] = index;
-	}
-      else
-	{
-	  fprintf (stderr, "# error: invalid event type %d\n",
-		   notes->event[index]);
-	}
-    }
-
-
-  free (on_step);
-  free (on_index);
+  free (drop);
 }
 
 void
@@ -318,255 +289,264 @@ WAON_notes_remove_longnotes (struct WAON_notes *notes,
 			     int max_duration,
 			     int min_vel)
 {
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_remove_longnotes");
-  CHECK_MALLOC (on_index, "WAON_notes_remove_longnotes");
+  char *drop = (char *)malloc (sizeof (char) * (notes->n + 1));
+  CHECK_MALLOC (drop, "WAON_notes_remove_longnotes");
 
   int i;
-  for (i = 0; i < 128; i ++)
+  for (i = 0; i < notes->n; i ++)
     {
-      on_step [i] = -1;
-      on_index[i] = -1;
+      int duration = WAON_notes_duration (notes, i);
+      drop[i] = (duration >= 0
+		 && duration >= max_duration
+		 && (int)notes->ev[i].vel <= min_vel);
     }
+  WAON_notes_rebuild (notes, drop);
 
-  int index;
-  for (index = 0; index < notes->n; index ++)
-    {
-      int note = (int)notes->note[index];
-
-
-      if (notes->event[index] == 0)
-	{
-	  // off event
-	  if (on_step[note] < 0 || on_index[note] < 0)
-	    {
-	      // no on event on the note
-	      // so remove this orphant off event
-	      WAON_notes_remove_at (notes, index);
-	      index --;
-	    }
-	  else
-	    {
-	      int vel = (int)notes->vel[on_index[note]];
-	      int duration = notes->step[index] - on_step[note];
-	      if (duration >= max_duration && vel <= min_vel)
-		{
-		  // remove these on and off events on the note
-		  WAON_notes_remove_at (notes, index);
-		  index --;
-
-		  int index_on = on_index[note];
-		  WAON_notes_remove_at (notes, index_on);
-		  index --;
-
-		  // need to shift indices on on_index[]
-		  check_on_index_for_remove (on_index, index_on);
-		}
-	    }
+  free (drop);
+}
 
-	  // reset on_step[] and on_index[]
-	  on_step[note] = -1;
-	  on_index[note] = -1;
-	}
-      else if (notes->event[index] == 1)
-	{
-	  // on event
-	  if (on_step[note] >= 0 && on_index[note] >= 0)
-	    {
-	      // the note is already on
-	      // so, insert off event here
-	      WAON_notes_insert (notes, index,
-				 notes->step[index],
-				 0,    // off
-				 note,
-				 64);  // default
-	      index ++;
-	    }
+void
+WAON_notes_remove_smallnotes (struct WAON_notes *notes,
+			      int min_vel)
+{
+  char *drop = (char *)malloc (sizeof (char) * (notes->n + 1));
+  CHECK_MALLOC (drop, "WAON_notes_remove_smallnotes");
 
-	  // set on_step[] and on_index[]
-	  on_step[note] = notes->step[index];
-	  on_index[note] = index;
-	}
+  int i;
+  for (i = 0; i < notes->n; i ++)
+    {
+      drop[i] = (WAON_notes_duration (notes, i) >= 0
+		 && (int)notes->ev[i].vel <= min_vel);
     }
+  WAON_notes_rebuild (notes, drop);
 
-
-  free (on_step);
-  free (on_index);
+  free (drop);
 }
 
 void
-WAON_notes_remove_smallnotes (struct WAON_notes *notes,
-			      int min_vel)
+WAON_notes_remove_octaves (struct WAON_notes *notes)
 {
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_remove_smallnotes");
-  CHECK_MALLOC (on_index, "WAON_notes_remove_smallnotes");
+  char *drop = (char *)malloc (sizeof (char) * (notes->n + 1));
+  CHECK_MALLOC (drop, "WAON_notes_remove_octaves");
 
+  // index of the on-event for each note on at the step (-1 for off)
+  int on_index[128];
   int i;
   for (i = 0; i < 128; i ++)
     {
-      on_step [i] = -1;
       on_index[i] = -1;
     }
 
-  int index;
-  for (index = 0; index < notes->n; index ++)
+  for (i = 0; i < notes->n; i ++)
     {
-      int note = (int)notes->note[index];
+      const struct WAON_note_event *ev = notes->ev + i;
+      int note = (int)ev->note;
 
-
-      if (notes->event[index] == 0)
+      drop[i] = 0;
+      if (ev->event == 0)
 	{
-	  // off event
-	  if (on_step[note] < 0 || on_index[note] < 0)
-	    {
-	      // no on event on the note
-	      // so remove this orphant off event
-	      WAON_notes_remove_at (notes, index);
-	      index --;
-	    }
-	  else
-	    {
-	      int vel = (int)notes->vel[on_index[note]];
-	      if (vel <= min_vel)
-		{
-		  // remove these on and off events on the note
-		  WAON_notes_remove_at (notes, index);
-		  index --;
-
-		  int index_on = on_index[note];
-		  WAON_notes_remove_at (notes, index_on);
-		  index --;
-
-		  // need to shift indices on on_index[]
-		  check_on_index_for_remove (on_index, index_on);
-		}
-	    }
-
-	  // reset on_step[] and on_index[]
-	  on_step [note] = -1;
 	  on_index[note] = -1;
+	  continue;
 	}
-      else if (notes->event[index] == 1)
-	{
-	  // on event
-	  if (on_step[note] >= 0 && on_index[note] >= 0)
-	    {
-	      // the note is already on
-	      // so, insert off event here
-	      WAON_notes_insert (notes, index,
-				 notes->step[index],
-				 0,    // off
-				 note,
-				 64);  // default
-	      index ++;
-	    }
 
-	  // set on_step[] and on_index[]
-	  on_step[note] = notes->step[index];
-	  on_index[note] = index;
+      on_index[note] = i;
+
+      // remove the note smaller than the one an octave below
+      int note_down = note - 12;
+      if (note_down < 0 || on_index[note_down] < 0) continue;
+      if (notes->pair[i] >= 0
+	  && ev->vel < notes->ev[on_index[note_down]].vel)
+	{
+	  drop[i] = 1;
 	}
     }
+  WAON_notes_rebuild (notes, drop);
 
+  free (drop);
+}
 
-  free (on_step);
-  free (on_index);
+
+/** clean-up on the fly for the memory-bounded analysis **/
+
+struct WAON_notes_stream *
+WAON_notes_stream_init (int horizon,
+			void (*output) (void *data,
+					const struct WAON_note_event *ev),
+			void *data)
+{
+  struct WAON_notes_stream *st
+    = (struct WAON_notes_stream *)malloc (sizeof (struct WAON_notes_stream));
+  CHECK_MALLOC (st, "WAON_notes_stream_init");
+
+  // the same clean-up as waon at the end
+  st->nshort = 2;
+  st->short_duration[0] = 1;
+  st->short_vel[0] = 64;
+  st->short_duration[1] = 2;
+  st->short_vel[1] = 28;
+  st->flag_octaves = 1;
+
+  st->horizon = horizon;
+  st->output = output;
+  st->data = data;
+  st->iscan = 0;
+  int i;
+  for (i = 0; i < 128; i ++)
+    {
+      st->open_vel[i] = -1;
+    }
+
+  return (st);
 }
 
 void
-WAON_notes_remove_octaves (struct WAON_notes *notes)
+WAON_notes_stream_free (struct WAON_notes_stream *st)
 {
-  int *on_step  = (int *)malloc (sizeof (int) * 128);
-  int *on_index = (int *)malloc (sizeof (int) * 128);
-  int *flag_remove = (int *)malloc (sizeof (int) * 128);
-  CHECK_MALLOC (on_step,  "WAON_notes_remove_octaves");
-  CHECK_MALLOC (on_index, "WAON_notes_remove_octaves");
-  CHECK_MALLOC (flag_remove, "WAON_notes_remove_octaves");
+  if (st == NULL) return;
+  free (st);
+}
 
+/* remove the scanned events except for the on-events waiting for
+ * their off-events, which are moved to the head
+ */
+static void
+WAON_notes_stream_compact (struct WAON_notes *notes,
+			   struct WAON_notes_stream *st)
+{
   int i;
-  for (i = 0; i < 128; i ++)
+  int j = 0;
+  for (i = 0; i < st->iscan; i ++)
     {
-      on_step [i] = -1;
-      on_index[i] = -1;
-      flag_remove[i] = 0; // false
+      const struct WAON_note_event *ev = notes->ev + i;
+      if (ev->event == 1
+	  && (notes->pair[i] < 0 || notes->pair[i] >= st->iscan))
+	{
+	  notes->ev[j ++] = *ev;
+	}
     }
+  int nkeep = j;
+  memmove (notes->ev + nkeep, notes->ev + st->iscan,
+	   sizeof (struct WAON_note_event) * (notes->n - st->iscan));
+  notes->n -= st->iscan - nkeep;
+  st->iscan = nkeep;
+
+  WAON_notes_relink (notes);
+}
 
-  int index;
-  for (index = 0; index < notes->n; index ++)
+/* decide the events and give them to st->output() in the order
+ * INPUT
+ *  step : the present step, where the on-events older than st->horizon
+ *         are decided before their off-events.
+ *         -1 decides the paired events only, and the scan stops at the
+ *         on-event without its off-event, so that all the events are
+ *         decided only after the notes left on are closed
+ *         (as WAON_notes_stream_finish() does).
+ */
+static void
+WAON_notes_stream_scan (struct WAON_notes *notes,
+			struct WAON_notes_stream *st,
+			int step)
+{
+  int i;
+  for (i = st->iscan; i < notes->n; i ++)
     {
-      int note = (int)notes->note[index];
+      struct WAON_note_event *ev = notes->ev + i;
+      int note = (int)ev->note;
+      int pair = notes->pair[i];
+
+      if (ev->event == 0)
+	{
+	  // off event, which follows its on-event
+	  st->open_vel[note] = -1;
+	  if (pair < 0) continue; // orphant
+	  if (notes->ev[pair].flag == WAON_NOTE_DROP) continue;
+	  st->output (st->data, ev);
+	  continue;
+	}
 
+      // on event
+      if (pair < 0
+	  && (step < 0 || step - ev->step < st->horizon))
+	{
+	  // the note may still be short, and the velocity may change
+	  break;
+	}
 
-      if (notes->event[index] == 0)
+      // remove short notes
+      if (pair >= 0)
 	{
-	  // off event
-	  if (on_step[note] < 0 || on_index[note] < 0)
+	  int duration = notes->ev[pair].step - ev->step;
+	  int k;
+	  for (k = 0; k < st->nshort; k ++)
 	    {
-	      // no on event on the note
-	      // so remove this orphant off event
-	      WAON_notes_remove_at (notes, index);
-	      index --;
-	    }
-	  else
-	    {
-	      if (flag_remove[note] > 0)
+	      if (duration <= st->short_duration[k]
+		  && (int)ev->vel <= st->short_vel[k])
 		{
-		  // remove these on and off events on the note
-		  WAON_notes_remove_at (notes, index);
-		  index --;
-
-		  int index_on = on_index[note];
-		  WAON_notes_remove_at (notes, index_on);
-		  index --;
-
-		  // need to shift indices on on_index[]
-		  check_on_index_for_remove (on_index, index_on);
+		  ev->flag = WAON_NOTE_DROP;
+		  break;
 		}
 	    }
-
-	  // reset on_step[] and on_index[]
-	  on_step [note] = -1;
-	  on_index[note] = -1;
+	  if (ev->flag == WAON_NOTE_DROP) continue;
 	}
-      else if (notes->event[index] == 1)
+
+      // remove the note smaller than the one an octave below
+      st->open_vel[note] = (int)ev->vel;
+      int note_down = note - 12;
+      if (st->flag_octaves != 0
+	  && note_down >= 0
+	  && st->open_vel[note_down] >= 0
+	  && (int)ev->vel < st->open_vel[note_down])
 	{
-	  // on event
-	  if (on_step[note] >= 0 && on_index[note] >= 0)
-	    {
-	      // the note is already on
-	      // so, insert off event here
-	      WAON_notes_insert (notes, index,
-				 notes->step[index],
-				 0,    // off
-				 note,
-				 64);  // default
-	      index ++;
-	    }
+	  ev->flag = WAON_NOTE_DROP;
+	  continue;
+	}
 
-	  // set on_step[] and on_index[]
-	  on_step[note] = notes->step[index];
-	  on_index[note] = index;
+      ev->flag = WAON_NOTE_KEEP;
+      st->output (st->data, ev);
+    }
+  st->iscan = i;
+}
 
-	  flag_remove[note] = 0; // false
+void
+WAON_notes_stream_flush (struct WAON_notes *notes,
+			 struct WAON_notes_stream *st,
+			 int step)
+{
+  WAON_notes_stream_scan (notes, st, step);
 
-	  int note_down = note - 12;
-	  if (note_down < 0) continue;
+  // compact when the scanned part is large enough
+  if (st->iscan >= WAON_NOTES_NALLOC
+      || (st->iscan > 0 && st->iscan == notes->n))
+    {
+      WAON_notes_stream_compact (notes, st);
+    }
+}
 
-	  if (on_step[note_down] >= 0 && on_index[note_down] >= 0)
-	    {
-	      if (notes->vel[index] < notes->vel[on_index[note_down]])
-		{
-		  flag_remove[note] = 1; // true
-		}
-	    }
+void
+WAON_notes_stream_finish (struct WAON_notes *notes,
+			  struct WAON_notes_stream *st)
+{
+  // close the notes left on, as WAON_notes_regulate()
+  if (notes->n > 0)
+    {
+      int last_step = notes->ev[notes->n - 1].step;
+      int i;
+      for (i = 0; i < 128; i ++)
+	{
+	  if (notes->on[i] < 0) continue;
+
+	  WAON_notes_append (notes,
+			     last_step + 1,
+			     0, // off event
+			     (char)i,
+			     64);
 	}
     }
 
-
-  free (on_step);
-  free (on_index);
+  WAON_notes_stream_scan (notes, st, -1);
+  notes->n = 0;
+  st->iscan = 0;
+  WAON_notes_relink (notes);
 }
 
 
@@ -575,18 +555,17 @@ WAON_notes_remove_octaves (struct WAON_notes *notes)
  * INPUT
  *  step           : the present step
  *  vel[128]       : velocity at the present step
- *  on_event[128]  : index of notes at the last on-event for each note.
- *                   (-1) means the note is off at the last step.
  *  on_threshold   : note turns on if vel[i] > on_threshold.
  *  off_threshold  : note turns off if vel[i] <= off_threshold.
  *  peak_threshold : note turns off and on
  *                   if vel[i] >= (on_vel[i] + peak_threshold)
  * OUTPUT
  *  notes : struct WAON_notes. event(s) are appended if happens.
+ *          the notes on at the last step are given by notes->on[].
  */
 void
 WAON_notes_check (struct WAON_notes *notes,
-		  int step, char *vel, int *on_event,
+		  int step, char *vel,
 		  int on_threshold,
 		  int off_threshold,
 		  int peak_threshold)
@@ -595,7 +574,7 @@ WAON_notes_check (struct WAON_notes *notes,
   int i;
   for (i = 0; i < 128; i++)
     {
-      if (on_event[i] < 0) /* off at last step  */
+      if (notes->on[i] < 0) /* off at last step  */
 	{
 	  /* check the note-on event by on_threshold  */
 	  if (vel[i] > on_threshold)
@@ -606,11 +585,11 @@ WAON_notes_check (struct WAON_notes *notes,
 				 1, /* on */
 				 (char)i, // midi note
 				 vel[i]);
-	      on_event[i] = notes->n - 1; // event index of notes.
 	    }
 	}
       else /* on at last step  */
 	{
+	  struct WAON_note_event *on = notes->ev + notes->on[i];
 	  /* check the note-off event by off_threshold  */
 	  if (vel[i] <= off_threshold)
 	    {
@@ -620,11 +599,10 @@ WAON_notes_check (struct WAON_notes *notes,
 				 0, /* off */
 				 (char)i, // midi note
 				 64);
-	      on_event[i] = -1;
 	    }
 	  else /* now note is over off_threshold at least  */
 	    {
-	      if (vel[i] >= (notes->vel[on_event[i]] + peak_threshold))
+	      if (vel[i] >= (on->vel + peak_threshold))
 		{
 		  /* off  */
 		  WAON_notes_append (notes,
@@ -638,12 +616,11 @@ WAON_notes_check (struct WAON_notes *notes,
 				     1, /* on */
 				     (char)i, // midi note
 				     vel[i]);
-		  on_event[i] = notes->n - 1; // event index of notes.
 		}
-	      else if (vel[i] > notes->vel[on_event[i]])
+	      else if (vel[i] > on->vel)
 		{
 		  /* overwrite velocity  */
-		  notes->vel[on_event[i]] = vel[i];
+		  on->vel = vel[i];
 		}
 	    }
 	}
@@ -657,17 +634,17 @@ WAON_notes_dump (struct WAON_notes *notes)
   int i;
   for (i = 0; i < notes->n; i ++)
     {
-      if (notes->step[i] > last_step)
+      if (notes->ev[i].step > last_step)
 	{
-	  fprintf (stdout, "%5d : ", notes->step[i]);
-	  last_step = notes->step[i];
+	  fprintf (stdout, "%5d : ", notes->ev[i].step);
+	  last_step = notes->ev[i].step;
 	}
       else
 	{
 	  fprintf (stdout, "      : ");
 	}
 
-      if (notes->event[i] == 0)
+      if (notes->ev[i].event == 0)
 	{
 	  fprintf (stdout, "off ");
 	}
@@ -676,7 +653,7 @@ WAON_notes_dump (struct WAON_notes *notes)
 	  fprintf (stdout, "on  ");
 	}
 
-      fprintf (stdout, "%3d %3d\n", notes->note[i], notes->vel[i]);
+      fprintf (stdout, "%3d %3d\n", notes->ev[i].note, notes->ev[i].vel);
     }
 }
 void
@@ -697,9 +674,9 @@ WAON_notes_dump2 (struct WAON_notes *notes)
 
   for (i = 0; i < notes->n; i ++)
     {
-      int note = (int)notes->note[i];
+      int note = (int)notes->ev[i].note;
 
-      if (notes->event[i] == 0)
+      if (notes->ev[i].event == 0)
 	{
 	  // off event
 	  if (on_step[note] < 0 || on_index[note] < 0)
@@ -708,9 +685,9 @@ WAON_notes_dump2 (struct WAON_notes *notes)
 	    }
 	  else
 	    {
-	      int step = notes->step[on_index[note]];
-	      int duration = notes->step[i] - on_step[note];
-	      int vel = (int)notes->vel[on_index[note]];
+	      int step = notes->ev[on_index[note]].step;
+	      int duration = notes->ev[i].step - on_step[note];
+	      int vel = (int)notes->ev[on_index[note]].vel;
 	      fprintf (stdout,
 		       "%5d : note %3d, duration %3d, vel %3d\n",
 		       step,
@@ -722,15 +699,15 @@ WAON_notes_dump2 (struct WAON_notes *notes)
 	  on_step [note] = -1;
 	  on_index[note] = -1;
 	}
-      else if (notes->event[i] == 1)
+      else if (notes->ev[i].event == 1)
 	{
 	  // on event
 	  if (on_step[note] >= 0 && on_index[note] >= 0)
 	    {
 	      // the note is already on
-	      int step = notes->step[on_index[note]];
-	      int duration = notes->step[i] - on_step[note];
-	      int vel = (int)notes->vel[on_index[note]];
+	      int step = notes->ev[on_index[note]].step;
+	      int duration = notes->ev[i].step - on_step[note];
+	      int vel = (int)notes->ev[on_index[note]].vel;
 	      fprintf (stdout,
 		       "%5d : note %3d, duration %3d, vel %3d (* no-off)\n",
 		       step,
@@ -739,20 +716,20 @@ WAON_notes_dump2 (struct WAON_notes *notes)
 		       vel);
 	    }
 
-	  on_step [note] = notes->step[i];
+	  on_step [note] = notes->ev[i].step;
 	  on_index[note] = i;
 	}
     }
 
   // check if on note left
-  int last_step = notes->step[notes->n - 1];
+  int last_step = notes->ev[notes->n - 1].step;
   for (i = 0; i < 128; i ++)
     {
       if (on_step[i] < 0) continue;
 
-      int step = notes->step[on_index[i]];
+      int step = notes->ev[on_index[i]].step;
       int duration = last_step + 1 - on_step[i];
-      int vel = (int)notes->vel[on_index[i]];
+      int vel = (int)notes->ev[on_index[i]].vel;
       fprintf (stdout,
 	       "%5d : note %3d, duration %3d, vel %3d (* no-off at the end)\n",
 	       step,
@@ -20,14 +20,34 @@
 #define	_NOTES_H_
 
 
+/* one event packed in 8 bytes */
+struct WAON_note_event {
+  int  step;  // step for the event
+  char event; // event type (0 == off, 1 == on)
+  char note;  // midi note number (0-127)
+  char vel;   // velocity of the note (for on) (0-127)
+  char flag;  // WAON_NOTE_KEEP or WAON_NOTE_DROP if the on-event is
+              // decided by struct WAON_notes_stream (0 otherwise)
+};
+
 struct WAON_notes {
-  int n;       // number of events
-  int  *step;  // step for the events
-  char *event; // event type (0 == off, 1 == on)
-  char *note;  // midi note number (0-127)
-  char *vel;   // velocity of the note (for on) (0-127)
+  int n;      // number of events
+  int nalloc; // number of records allocated for ev[]
+  struct WAON_note_event *ev; // events ev[n] in the order of the steps
+  int *pair;  // pair[n] : index of the paired event of ev[i]
+              // (off for on, on for off), or -1 if it is not paired
+
+  int on[128]; // index of the on-event of the note sounding at the end
+               // of the events (-1 means off), maintained by the appends
 };
 
+/* iterate over the events of notes in the order, as
+ *   struct WAON_note_event *ev;
+ *   WAON_notes_foreach (notes, ev) { ... ev->step ... }
+ */
+#define WAON_notes_foreach(notes, ev) \
+  for ((ev) = (notes)->ev; (ev) < (notes)->ev + (notes)->n; (ev) ++)
+
 
 struct WAON_notes *
 WAON_notes_init (void);
@@ -47,6 +67,13 @@ void
 WAON_notes_remove_at (struct WAON_notes *notes,
 		      int index);
 
+/* duration of the note started by the on-event at index
+ * OUTPUT
+ *  returned value : duration in steps, or -1 if the event is not paired
+ */
+int
+WAON_notes_duration (struct WAON_notes *notes, int index);
+
 void
 WAON_notes_regulate (struct WAON_notes *notes);
 void
@@ -63,23 +90,80 @@ WAON_notes_remove_smallnotes (struct WAON_notes *notes,
 void
 WAON_notes_remove_octaves (struct WAON_notes *notes);
 
+/** clean-up on the fly for the memory-bounded analysis
+ * the events are decided as WAON_notes_regulate(),
+ * WAON_notes_remove_shortnotes() and WAON_notes_remove_octaves() do,
+ * and given to the output in the order and removed from notes.
+ * the on-event is decided when its off-event is appended, or when it is
+ * older than the horizon, where its velocity is fixed at that time.
+ * therefore, the result is the same as the clean-up at the end
+ * unless a note lasts longer than the horizon.
+ **/
+
+#define WAON_NOTE_KEEP 1
+#define WAON_NOTE_DROP 2
+
+struct WAON_notes_stream {
+  // parameters of the clean-up (set to those of waon by the init)
+  int nshort;             // number of the conditions for the short notes
+  int short_duration [4]; // remove notes of duration <= short_duration
+  int short_vel [4];      // and velocity <= short_vel
+  int flag_octaves;       // 1 = remove the octaves
+
+  int horizon; // age in steps to decide the on-event sounding
+               // (should be larger than short_duration[])
+  void (*output) (void *data, const struct WAON_note_event *ev);
+  void *data;
+
+  int iscan;          // index of the event to scan next
+  int open_vel [128]; // velocity of the note sounding (-1 == off)
+};
+
+/* INPUT
+ *  horizon : age in steps to decide the on-event sounding
+ *  output  : function called for each event decided, in the order
+ *  data    : passed to output()
+ */
+struct WAON_notes_stream *
+WAON_notes_stream_init (int horizon,
+			void (*output) (void *data,
+					const struct WAON_note_event *ev),
+			void *data);
+
+void
+WAON_notes_stream_free (struct WAON_notes_stream *st);
+
+/* decide the events up to the present step and remove them from notes
+ * (call after WAON_notes_check() at each step)
+ */
+void
+WAON_notes_stream_flush (struct WAON_notes *notes,
+			 struct WAON_notes_stream *st,
+			 int step);
+
+/* close the notes left on and decide all the events at the end
+ */
+void
+WAON_notes_stream_finish (struct WAON_notes *notes,
+			  struct WAON_notes_stream *st);
+
+
 /** for stage 3 : time-difference check for note-on/off **/
 /* check on and off events for each note comparing vel[] and on_vel[]
  * INPUT
  *  step           : the present step
  *  vel[128]       : velocity at the present step
- *  on_event[128]  : index of notes at the last on-event for each note.
- *                   (-1) means the note is off at the last step.
  *  on_threshold   : note turns on if vel[i] > on_threshold.
  *  off_threshold  : note turns off if vel[i] <= off_threshold.
  *  peak_threshold : note turns off and on
  *                   if vel[i] >= (on_vel[i] + peak_threshold)
  * OUTPUT
  *  notes : struct WAON_notes. event(s) are appended if happens.
+ *          the notes on at the last step are given by notes->on[].
  */
 void
 WAON_notes_check (struct WAON_notes *notes,
-		  int step, char *vel, int *on_step,
+		  int step, char *vel,
 		  int on_threshold,
 		  int off_threshold,
 		  int peak_threshold);
@@ -21,9 +21,10 @@
 #include <curses.h>
 
 #include <ao/ao.h>
-#include "ao-wrapper.h" // ao_init_16_stereo()
+#include "ao-wrapper.h" // ao_out_open()
 #include "pv-complex.h" // struct pv_complex
 #include "pv-conventional.h" // get_scale_factor_for_window()
+#include "pv-prefetch.h" // struct pv_prefetch
 
 #include "memory-check.h" // CHECK_MALLOC
 
@@ -33,56 +34,6 @@ int flag_nofft = 0;
 #include "pv-nofft.h"
 
 
-/* play 100 milisecond and return
- * INPUT
- *  pv        : struct pv_complex
- *  play_cur  : current frame
- *  frame0, frame1 : the loop range
- * OUTPUT
- */
-int
-play_100msec_curses (struct pv_complex *pv,
-		     long *play_cur,
-		     long frame0, long frame1)
-{
-  extern int flag_nofft;
-
-  long len_100msec = (long)(0.1 /* sec */ * pv->sfinfo->samplerate /* Hz */);
-
-  if (*play_cur <  frame0) *play_cur = frame0;
-  if (*play_cur >= frame1) *play_cur = frame1;
-
-
-  long l; // counting output frames
-  for (l = 0; l < len_100msec; l += pv->hop_syn)
-    {
-      long len_play;
-      if (flag_nofft == 0) len_play = pv_complex_play_step (pv, *play_cur);
-      else                 len_play = pv_nofft_play_step (pv, *play_cur);
-      if (len_play < pv->hop_res)
-	{
-	  // end of file
-	  // rewind
-	  if (pv->hop_ana >= 0.0) *play_cur = frame0;
-	  else                    *play_cur = frame1;
-	}
-
-      // increment play_cur
-      *play_cur += pv->hop_ana;
-
-      // check the boundary
-      if (*play_cur < frame0 ||
-	  *play_cur + pv->hop_ana >= frame1)
-	{
-	  // rewind
-	  if (pv->hop_ana >= 0.0) *play_cur = frame0;
-	  else                    *play_cur = frame1;
-	}
-    }
-  return 1; // TRUE
-}
-
-
 #define Y_file    (1)
 #define Y_frames  (2)
 #define Y_loop    (3)
@@ -99,6 +50,11 @@ play_100msec_curses (struct pv_complex *pv,
 #define Y_status  (16)
 #define Y_comment (18)
 
+/* range of the FFT length by F / f (len/8 to len*8) */
+#define PV_CURSES_LEN_RANGE (8)
+/* the output rendered ahead of the playback [msec] */
+#define PV_CURSES_PREFETCH (300.0)
+
 static void
 curses_print_window (int flag_window)
 {
@@ -222,6 +178,7 @@ curses_print_pv (const char *file,
   mvprintw (Y_loop,    41, "< > by cur, [ { expand } ]");
   mvprintw (Y_pitch,   41, "UP   / DOWN");
   mvprintw (Y_rate,    41, "LEFT / RIGHT");
+  mvprintw (Y_len,     41, "F / f");
   mvprintw (Y_hop_syn, 41, "H / h");
   mvprintw (Y_status,  41, "SPACE");
   mvprintw (Y_lock,    41, "L / N");
@@ -233,7 +190,8 @@ curses_print_pv (const char *file,
 /* phase vocoder by complex arithmetics with fixed hops.
  */
 void pv_complex_curses (const char *file,
-			long len, long hop_syn)
+			long len, long hop_syn,
+			int src_type)
 {
   extern int flag_nofft;
 
@@ -242,13 +200,17 @@ void pv_complex_curses (const char *file,
   raw();                 /* Line buffering disabled */
   keypad(stdscr, TRUE);  /* We get F1, F2 etc.. */
   noecho();              /* Don't echo() while we do getch */
-  nodelay(stdscr, TRUE); /* Don't wait the key press */
+  timeout(50);           /* Wait the key press up to 50 msec */
 
 
   int flag_window = 3;
+  // the FFT length is changed by F / f in the pool of len/8 to len*8
   struct pv_complex *pv
-    = pv_complex_init (len, hop_syn, flag_window);
+    = pv_complex_init_pool (len, len / PV_CURSES_LEN_RANGE,
+			    len * PV_CURSES_LEN_RANGE,
+			    hop_syn, flag_window);
   CHECK_MALLOC (pv, "pv_complex_curses");
+  pv_complex_set_src_type (pv, src_type);
 
   // open input file
   SNDFILE *sf = NULL;
@@ -264,9 +226,8 @@ void pv_complex_curses (const char *file,
 
   pv_complex_set_input (pv, sf, &sfinfo);
 
-  ao_device *ao = NULL;
-  ao = ao_init_16_stereo (sfinfo.samplerate, 0);
-  pv_complex_set_output_ao (pv, ao);
+  struct ao_out *ao = NULL;
+  ao = ao_out_open (sfinfo.samplerate, 0);
 
 
   // initial values
@@ -278,7 +239,11 @@ void pv_complex_curses (const char *file,
   long frame1 = (long)pv->sfinfo->frames - 1;
   pv->flag_lock = 0; // no phase-lock
   int flag_play = 1;
-  long play_cur = 0;
+
+  // the playback runs in the background threads
+  struct pv_prefetch *pp = pv_prefetch_init (pv, ao, PV_CURSES_PREFETCH);
+  pv_prefetch_set_range (pp, frame0, frame1);
+  pv_prefetch_play (pp, flag_play);
 
   long len_1sec  = (long)(pv->sfinfo->samplerate /* Hz */);
   long len_10sec = (long)(10 * pv->sfinfo->samplerate /* Hz */);
@@ -291,13 +256,11 @@ void pv_complex_curses (const char *file,
   long status = 1; // TRUE
   do
     {
-      if (flag_play != 0)
-	{
-	  status = play_100msec_curses (pv, &play_cur,
-					frame0, frame1);
-	}
       // scan keyboard
       int ch = getch();
+      long play_cur = pv_prefetch_get_cur (pp);
+      // the parameters of pv are changed between the steps
+      if (ch != ERR) pv_prefetch_lock (pp);
       switch (ch)
 	{
 	case ERR: // no key event
@@ -363,19 +326,31 @@ void pv_complex_curses (const char *file,
 
 	case 'W':
 	case 'w':
-	  pv->flag_window++;
-	  pv->flag_window = pv->flag_window % 7; // 0 to 6
-
-	  // reset scale factor
-	  pv->window_scale
-	    = get_scale_factor_for_window (pv->len, pv->hop_syn,
-					   pv->flag_window);
+	  // 0 to 6 (the scale factor is reset)
+	  pv_complex_change_window (pv, (pv->flag_window + 1) % 7);
 	  curses_print_window (pv->flag_window);
 	  break;
 
+	case 'F':
+	case 'f':
+	  // swap the plans in the pool (crossfaded over the former len)
+	  if (pv_complex_change_len (pv, (ch == 'F' ? pv->len * 2
+					  : pv->len / 2)) != 0)
+	    {
+	      mvprintw (Y_comment, 1, "fft-len is out of the range             ");
+	      break;
+	    }
+	  // hop_res, hop_ana depend on hop_syn
+	  pv_complex_change_rate_pitch (pv, pv_rate, pv_pitch);
+	  mvprintw (Y_len,    1, "fft-len    : %06ld", pv->len);
+	  mvprintw (Y_hop_syn,1, "hop(syn)   : %06ld", pv->hop_syn);
+	  mvprintw (Y_hop_ana,1, "hop(ana)   : %06ld", pv->hop_ana);
+	  mvprintw (Y_hop_res,1, "hop(res)   : %06ld", pv->hop_res);
+	  break;
+
 	case 'H':
 	  pv->hop_syn *= 2;
-	  if (pv->hop_syn > len) pv->hop_syn = len;
+	  if (pv->hop_syn > pv->len) pv->hop_syn = pv->len;
 	  // hop_res, hop_ana depend on hop_syn
 	  pv_complex_change_rate_pitch (pv, pv_rate, pv_pitch);
 	  mvprintw (Y_hop_syn,1, "hop(syn)   : %06ld", pv->hop_syn);
@@ -436,7 +411,9 @@ void pv_complex_curses (const char *file,
 	  frame1 = (long)pv->sfinfo->frames - 1;
 	  pv_rate = 1.0;
 	  pv_pitch = 0.0;
+	  pv_complex_change_len (pv, len); // value in the argument
 	  pv->hop_syn = hop_syn; // value in the argument
+	  pv_complex_change_window (pv, pv->flag_window); // reset the scale
 	  pv_complex_change_rate_pitch (pv, pv_rate, pv_pitch);
 	  curses_print_pv (file, pv, flag_play, frame0, frame1,
 			   pv_pitch, pv_rate);
@@ -453,6 +430,8 @@ void pv_complex_curses (const char *file,
 	case 'n':
 	  flag_nofft ++;
 	  if (flag_nofft == 2) flag_nofft = 0;
+	  pp->play_step = (flag_nofft == 0 ? pv_complex_play_step
+			   : pv_nofft_play_step);
 
 	  if (flag_nofft == 0)    mvprintw(Y_lock, 21, "      ");
 	  else                    mvprintw(Y_lock, 21, "no-FFT");
@@ -464,11 +443,20 @@ void pv_complex_curses (const char *file,
 	  break;
 	  */
 	}
+      if (ch != ERR)
+	{
+	  pp->frame0 = frame0;
+	  pp->frame1 = frame1;
+	  pv_prefetch_unlock (pp);
+	  if (ch == ' ') pv_prefetch_play (pp, flag_play);
+	}
       mvprintw (Y_frames, 1, "current    : %010ld", play_cur);
       refresh();
     }
   while (status == 1);
 
+  pv_prefetch_free (pp);
+  ao_out_close (ao);
   pv_complex_free (pv);
   sf_close (sf) ;
 
@@ -22,21 +22,12 @@
 #include "pv-complex.h" // struct pv_complex
 
 
-/* play 100 milisecond and return
- * INPUT
- *  pv        : struct pv_complex
- *  play_cur  : current frame
- *  frame0, frame1 : the loop range
- * OUTPUT
- */
-int
-play_100msec_curses (struct pv_complex *pv,
-		     long *play_cur,
-		     long frame0, long frame1);
-
 /* phase vocoder by complex arithmetics with fixed hops.
+ * INPUT
+ *  src_type : converter of libsamplerate for the pitch shift
  */
 void pv_complex_curses (const char *file,
-			long len, long hop_syn);
+			long len, long hop_syn,
+			int src_type);
 
 #endif /* !_PV_COMPLEX_CURSES_H_ */
@@ -24,7 +24,7 @@
 #include <fftw3.h>
 // half-complex format handling routines
 #include "hc.h"
-#include "fft.h" // windowing()
+#include "fft.h" // windowing(), windowing_f()
 
 // libsndfile
 #include <sndfile.h>
@@ -46,58 +46,206 @@
 
 struct pv_complex *
 pv_complex_init (long len, long hop_syn, int flag_window)
+{
+  return (pv_complex_init_pool (len, len, len, hop_syn, flag_window));
+}
+
+static void
+pv_complex_fft_init (struct pv_complex_fft *fft, long len)
+{
+  fft->len = len;
+
+#ifdef WAON_FLOAT
+  fft->time = (float *)fftwf_malloc (len * sizeof(float));
+  fft->freq = (float *)fftwf_malloc (len * sizeof(float));
+  fft->f_out = (float *)fftwf_malloc (len * sizeof(float));
+  fft->t_out = (float *)fftwf_malloc (len * sizeof(float));
+#else // !WAON_FLOAT
+  fft->time = (double *)fftw_malloc (len * sizeof(double));
+  fft->freq = (double *)fftw_malloc (len * sizeof(double));
+  fft->f_out = (double *)fftw_malloc (len * sizeof(double));
+  fft->t_out = (double *)fftw_malloc (len * sizeof(double));
+#endif // WAON_FLOAT
+  CHECK_MALLOC (fft->time, "pv_complex_fft_init");
+  CHECK_MALLOC (fft->freq, "pv_complex_fft_init");
+  CHECK_MALLOC (fft->f_out, "pv_complex_fft_init");
+  CHECK_MALLOC (fft->t_out, "pv_complex_fft_init");
+
+#ifdef WAON_FLOAT
+  fft->plan = fftwf_plan_r2r_1d (len, fft->time, fft->freq,
+				 FFTW_R2HC, FFTW_ESTIMATE);
+  fft->plan_inv = fftwf_plan_r2r_1d (len, fft->f_out, fft->t_out,
+				     FFTW_HC2R, FFTW_ESTIMATE);
+#else // !WAON_FLOAT
+  fft->plan = fftw_plan_r2r_1d (len, fft->time, fft->freq,
+				FFTW_R2HC, FFTW_ESTIMATE);
+  fft->plan_inv = fftw_plan_r2r_1d (len, fft->f_out, fft->t_out,
+				    FFTW_HC2R, FFTW_ESTIMATE);
+#endif // WAON_FLOAT
+}
+
+static void
+pv_complex_fft_free (struct pv_complex_fft *fft)
+{
+#ifdef WAON_FLOAT
+  if (fft->time != NULL) fftwf_free (fft->time);
+  if (fft->freq != NULL) fftwf_free (fft->freq);
+  if (fft->plan != NULL) fftwf_destroy_plan (fft->plan);
+
+  if (fft->t_out != NULL) fftwf_free (fft->t_out);
+  if (fft->f_out != NULL) fftwf_free (fft->f_out);
+  if (fft->plan_inv != NULL) fftwf_destroy_plan (fft->plan_inv);
+#else // !WAON_FLOAT
+  if (fft->time != NULL) fftw_free (fft->time);
+  if (fft->freq != NULL) fftw_free (fft->freq);
+  if (fft->plan != NULL) fftw_destroy_plan (fft->plan);
+
+  if (fft->t_out != NULL) fftw_free (fft->t_out);
+  if (fft->f_out != NULL) fftw_free (fft->f_out);
+  if (fft->plan_inv != NULL) fftw_destroy_plan (fft->plan_inv);
+#endif // WAON_FLOAT
+}
+
+/* set the pointers of pv to the plans and buffers of fft */
+static void
+pv_complex_fft_select (struct pv_complex *pv, struct pv_complex_fft *fft)
+{
+  pv->len = fft->len;
+
+  pv->time = fft->time;
+  pv->freq = fft->freq;
+  pv->plan = fft->plan;
+
+  pv->t_out = fft->t_out;
+  pv->f_out = fft->f_out;
+  pv->plan_inv = fft->plan_inv;
+}
+
+struct pv_complex *
+pv_complex_init_pool (long len, long len_min, long len_max,
+		      long hop_syn, int flag_window)
 {
   struct pv_complex *pv
     = (struct pv_complex *) malloc (sizeof (struct pv_complex));
-  CHECK_MALLOC (pv, "pv_complex_init");
+  CHECK_MALLOC (pv, "pv_complex_init_pool");
+
+  // the pool of len * 2^i in [len_min, len_max]
+  long l;
+  long l0 = len;
+  while (l0 / 2 >= len_min && l0 % 2 == 0) l0 /= 2;
+  pv->npool = 0;
+  for (l = l0; l <= len_max || l == len; l *= 2) pv->npool ++;
+  pv->pool = (struct pv_complex_fft *)malloc
+    (sizeof (struct pv_complex_fft) * pv->npool);
+  CHECK_MALLOC (pv->pool, "pv_complex_init_pool");
+  int k;
+  for (k = 0, l = l0; k < pv->npool; k ++, l *= 2)
+    {
+      pv_complex_fft_init (pv->pool + k, l);
+      if (l == len) pv_complex_fft_select (pv, pv->pool + k);
+    }
+  pv->len_max = pv->pool[pv->npool - 1].len;
+  pv->len_tail = 0;
 
-  pv->len = len;
   pv->hop_syn = hop_syn;
 
   pv->flag_window = flag_window;
 
   pv->window_scale = get_scale_factor_for_window (len, hop_syn, flag_window);
 
-  pv->time = (double *)fftw_malloc (len * sizeof(double));
-  pv->freq = (double *)fftw_malloc (len * sizeof(double));
-  CHECK_MALLOC (pv->time, "pv_complex_init");
-  CHECK_MALLOC (pv->freq, "pv_complex_init");
-  pv->plan = fftw_plan_r2r_1d (len, pv->time, pv->freq,
-			       FFTW_R2HC, FFTW_ESTIMATE);
-
-  pv->f_out = (double *)fftw_malloc (len * sizeof(double));
-  pv->t_out = (double *)fftw_malloc (len * sizeof(double));
-  CHECK_MALLOC (pv->f_out, "pv_complex_init");
-  CHECK_MALLOC (pv->t_out, "pv_complex_init");
-  pv->plan_inv = fftw_plan_r2r_1d (len, pv->f_out, pv->t_out,
-				   FFTW_HC2R, FFTW_ESTIMATE);
-
-  pv->l_f_old = (double *)malloc (len * sizeof(double));
-  pv->r_f_old = (double *)malloc (len * sizeof(double));
-  CHECK_MALLOC (pv->l_f_old, "pv_complex_init");
-  CHECK_MALLOC (pv->r_f_old, "pv_complex_init");
-
-  pv->l_out = (double *) malloc ((hop_syn + len) * sizeof(double));
-  pv->r_out = (double *) malloc ((hop_syn + len) * sizeof(double));
-  CHECK_MALLOC (pv->l_out, "pv_complex_init");
-  CHECK_MALLOC (pv->r_out, "pv_complex_init");
+  pv->l_f_old = (pv_real *)malloc (pv->len_max * sizeof(pv_real));
+  pv->r_f_old = (pv_real *)malloc (pv->len_max * sizeof(pv_real));
+  CHECK_MALLOC (pv->l_f_old, "pv_complex_init_pool");
+  CHECK_MALLOC (pv->r_f_old, "pv_complex_init_pool");
+
+  // hop_syn is up to len_max (and the original hop_syn)
+  long nout = pv->len_max
+    + (hop_syn > pv->len_max ? hop_syn : pv->len_max);
+  pv->l_out = (double *) malloc (nout * sizeof(double));
+  pv->r_out = (double *) malloc (nout * sizeof(double));
+  CHECK_MALLOC (pv->l_out, "pv_complex_init_pool");
+  CHECK_MALLOC (pv->r_out, "pv_complex_init_pool");
   int i;
-  for (i = 0; i < (hop_syn + len); i ++)
+  for (i = 0; i < nout; i ++)
     {
       pv->l_out [i] = 0.0;
       pv->r_out [i] = 0.0;
     }
 
+  pv_real **work[] = {&pv->l_in, &pv->r_in, &pv->l_fs, &pv->r_fs,
+		      &pv->l_ft, &pv->r_ft, &pv->l_tmp, &pv->r_tmp,
+		      &pv->hc_tmp1, &pv->hc_tmp2};
+  for (i = 0; i < (int)(sizeof (work) / sizeof (work[0])); i ++)
+    {
+      *(work[i]) = (pv_real *)malloc (pv->len_max * sizeof (pv_real));
+      CHECK_MALLOC (*(work[i]), "pv_complex_init_pool");
+    }
+  pv->sf_buf = NULL; // by pv_complex_set_input()
+
   pv->flag_left  = 0; // l_f_old[] is not initialized yet
   pv->flag_right = 0; // r_f_old[] is not initialized yet
 
+  pv->src_type = SRC_SINC_FASTEST;
+  pv->src = NULL; // made at the first pv_complex_resample()
+  pv->poly = NULL;
+  pv->src_flag = 0;
+  pv->src_in  = NULL;
+  pv->src_nin = 0;
+  pv->src_out  = NULL;
+  pv->src_nout = 0;
+  pv->src_left = 0;
+  pv->l_resamp = NULL;
+  pv->r_resamp = NULL;
+  pv->nresamp = 0;
+
   pv->flag_lock = 0; // no phase lock (for default)
 
+  pv->silence = 0.0; // skip only the digital silence (for default)
+
   //pv->pitch_shift = 0.0; // no pitch-shift
 
   return (pv);
 }
 
+int
+pv_complex_change_len (struct pv_complex *pv, long len)
+{
+  if (len == pv->len) return (0);
+
+  int k;
+  for (k = 0; k < pv->npool; k ++)
+    {
+      if (pv->pool[k].len == len) break;
+    }
+  if (k == pv->npool) return (-1);
+
+  // the tail of the former frames to be shifted out
+  if (pv->len > pv->len_tail) pv->len_tail = pv->len;
+
+  // keep the overlap
+  long hop_syn = pv->hop_syn * len / pv->len;
+  if (hop_syn < 1) hop_syn = 1;
+  pv->hop_syn = hop_syn;
+
+  pv_complex_fft_select (pv, pv->pool + k);
+  pv->window_scale
+    = get_scale_factor_for_window (pv->len, pv->hop_syn, pv->flag_window);
+
+  // the phases start again from the frames of the new len
+  pv->flag_left  = 0;
+  pv->flag_right = 0;
+
+  return (0);
+}
+
+void
+pv_complex_change_window (struct pv_complex *pv, int flag_window)
+{
+  pv->flag_window = flag_window;
+  pv->window_scale
+    = get_scale_factor_for_window (pv->len, pv->hop_syn, pv->flag_window);
+}
+
 /* change rate and pitch (note that hop_syn is fixed)
  * INPUT
  *  pv : struct pv_complex
@@ -125,11 +273,35 @@ pv_complex_set_input (struct pv_complex *pv,
 {
   pv->sf = sf;
   pv->sfinfo = sfinfo;
+
+  pv->sf_buf = (pv_real *)realloc (pv->sf_buf, sizeof (pv_real)
+				   * pv->len_max * sfinfo->channels);
+  CHECK_MALLOC (pv->sf_buf, "pv_complex_set_input");
+}
+
+int
+pv_complex_set_src_type (struct pv_complex *pv, int src_type)
+{
+  if (src_type != PV_SRC_POLYPHASE
+      && src_get_name (src_type) == NULL)
+    {
+      fprintf (stderr, "invalid converter type %d\n", src_type);
+      return (-1);
+    }
+  pv->src_type = src_type;
+  pv->src_flag = 0; // the new converter starts from the reset
+  if (pv->src != NULL)
+    {
+      // made again for the new type at the next step
+      src_delete (pv->src);
+      pv->src = NULL;
+    }
+  return (0);
 }
 
 void
 pv_complex_set_output_ao (struct pv_complex *pv,
-			  ao_device *ao)
+			  struct ao_out *ao)
 {
   pv->flag_out = 0;
   pv->ao = ao;
@@ -144,18 +316,29 @@ pv_complex_set_output_sf (struct pv_complex *pv,
   pv->sfout_info = sfinfo;
 }
 
+void
+pv_complex_set_output_func (struct pv_complex *pv,
+			    int (*func) (void *data,
+					 const double *l, const double *r,
+					 int n),
+			    void *data)
+{
+  pv->flag_out = 2;
+  pv->out_func = func;
+  pv->out_data = data;
+}
+
 void
 pv_complex_free (struct pv_complex *pv)
 {
   if (pv == NULL) return;
 
-  if (pv->time != NULL) free (pv->time);
-  if (pv->freq != NULL) free (pv->freq);
-  if (pv->plan != NULL) fftw_destroy_plan (pv->plan);
-
-  if (pv->t_out != NULL) free (pv->t_out);
-  if (pv->f_out != NULL) free (pv->f_out);
-  if (pv->plan_inv != NULL) fftw_destroy_plan (pv->plan_inv);
+  int k;
+  for (k = 0; k < pv->npool; k ++)
+    {
+      pv_complex_fft_free (pv->pool + k);
+    }
+  free (pv->pool);
 
   if (pv->l_f_old != NULL) free (pv->l_f_old);
   if (pv->r_f_old != NULL) free (pv->r_f_old);
@@ -163,50 +346,146 @@ pv_complex_free (struct pv_complex *pv)
   if (pv->l_out != NULL) free (pv->l_out);
   if (pv->r_out != NULL) free (pv->r_out);
 
+  free (pv->l_in);
+  free (pv->r_in);
+  free (pv->l_fs);
+  free (pv->r_fs);
+  free (pv->l_ft);
+  free (pv->r_ft);
+  free (pv->l_tmp);
+  free (pv->r_tmp);
+  free (pv->hc_tmp1);
+  free (pv->hc_tmp2);
+  if (pv->sf_buf != NULL) free (pv->sf_buf);
+
+  if (pv->src != NULL) src_delete (pv->src);
+  pv_polyphase_free (pv->poly);
+  if (pv->src_in  != NULL) free (pv->src_in);
+  if (pv->src_out != NULL) free (pv->src_out);
+  if (pv->l_resamp != NULL) free (pv->l_resamp);
+  if (pv->r_resamp != NULL) free (pv->r_resamp);
+
   free (pv);
 }
 
 
-long
-read_and_FFT_stereo (struct pv_complex *pv,
-		     long frame,
-		     double *f_left, double *f_right)
+/*
+ * OUTPUT
+ *  returned value : max |x[i]| for i = 0 to n-1
+ */
+static double
+peak_amplitude (int n, const pv_real *x)
 {
-  static double *left  = NULL;
-  static double *right = NULL;
-  if (left == NULL)
-    {
-      left  = (double *)malloc (sizeof (double) * pv->len);
-      right = (double *)malloc (sizeof (double) * pv->len);
-      CHECK_MALLOC (left,  "read_and_FFT_stereo");
-      CHECK_MALLOC (right, "read_and_FFT_stereo");
-    }
+  double peak = 0.0;
+  int i;
 
-  long status;
-  status = sndfile_read_at (pv->sf, *(pv->sfinfo), frame,
-			    left, right, pv->len);
-  if (status != pv->len)
+  for (i = 0; i < n; i ++)
     {
-      return (status);
+      if (fabs ((double)x[i]) > peak) peak = fabs ((double)x[i]);
     }
+  return (peak);
+}
 
-  // FFT for left channel
-  windowing (pv->len, left, pv->flag_window, 1.0, pv->time);
+/* windowing() and the FFT of pv->time[] into pv->freq[]
+ * (by fftwf for WAON_FLOAT) */
+static void
+pv_complex_FFT (struct pv_complex *pv, const pv_real *x)
+{
+#ifdef WAON_FLOAT
+  windowing_f (pv->len, x, pv->flag_window, 1.0, pv->time);
+  fftwf_execute (pv->plan); // FFT: time[] -> freq[]
+#else // !WAON_FLOAT
+  windowing (pv->len, x, pv->flag_window, 1.0, pv->time);
   fftw_execute (pv->plan); // FFT: time[] -> freq[]
+#endif // WAON_FLOAT
+}
+
+/* apply FFT on each channel of pv->len frames in left[] and right[],
+ * where the silent channel is not transformed.
+ * OUTPUT
+ *  f_left[len], f_right[len] : FFT of the active channel
+ *  flag_left, flag_right : 1 == active, 0 == silent
+ *                          (peak amplitude <= pv->silence)
+ */
+void
+FFT_stereo (struct pv_complex *pv,
+	    const pv_real *left, const pv_real *right,
+	    pv_real *f_left, pv_real *f_right,
+	    int *flag_left, int *flag_right)
+{
   int i;
-  for (i = 0; i < pv->len; i ++)
+
+  // FFT for left channel
+  if (peak_amplitude (pv->len, left) <= pv->silence)
+    {
+      *flag_left = 0;
+    }
+  else
     {
-      f_left [i] = pv->freq [i];
+      *flag_left = 1;
+      pv_complex_FFT (pv, left);
+      for (i = 0; i < pv->len; i ++)
+	{
+	  f_left [i] = pv->freq [i];
+	}
     }
 
   // FFT for right channel
-  windowing (pv->len, right, pv->flag_window, 1.0, pv->time);
-  fftw_execute (pv->plan); // FFT: time[] -> freq[]
-  for (i = 0; i < pv->len; i ++)
+  if (peak_amplitude (pv->len, right) <= pv->silence)
+    {
+      *flag_right = 0;
+    }
+  else
+    {
+      *flag_right = 1;
+      pv_complex_FFT (pv, right);
+      for (i = 0; i < pv->len; i ++)
+	{
+	  f_right [i] = pv->freq [i];
+	}
+    }
+}
+
+/* read pv->len frames from frame into pv->l_in[] and pv->r_in[]
+ * OUTPUT
+ *  returned value : frames read
+ */
+long
+pv_complex_read (struct pv_complex *pv, long frame)
+{
+#ifdef WAON_FLOAT
+  return (sndfile_read_at_f (pv->sf, *(pv->sfinfo), frame,
+			     pv->l_in, pv->r_in, pv->len, pv->sf_buf));
+#else // !WAON_FLOAT
+  return (sndfile_read_at (pv->sf, *(pv->sfinfo), frame,
+			   pv->l_in, pv->r_in, pv->len, pv->sf_buf));
+#endif // WAON_FLOAT
+}
+
+/* read pv->len frames from frame and apply FFT on each channel,
+ * where the silent channel is not transformed.
+ * OUTPUT
+ *  f_left[len], f_right[len] : FFT of the active channel
+ *  flag_left, flag_right : 1 == active, 0 == silent
+ *                          (peak amplitude <= pv->silence)
+ *  returned value : frames read
+ */
+long
+read_and_FFT_stereo (struct pv_complex *pv,
+		     long frame,
+		     pv_real *f_left, pv_real *f_right,
+		     int *flag_left, int *flag_right)
+{
+  long status;
+  status = pv_complex_read (pv, frame);
+  if (status != pv->len)
     {
-      f_right [i] = pv->freq [i];
+      return (status);
     }
 
+  FFT_stereo (pv, pv->l_in, pv->r_in, f_left, f_right,
+	      flag_left, flag_right);
+
   return (status);
 }
 
@@ -216,7 +495,7 @@ read_and_FFT_stereo (struct pv_complex *pv,
  */
 void
 apply_invFFT_mono (struct pv_complex *pv,
-		   const double *f, double scale,
+		   const pv_real *f, double scale,
 		   double *out)
 {
   int i;
@@ -226,104 +505,252 @@ apply_invFFT_mono (struct pv_complex *pv,
     {
       pv->f_out [i] = f [i];
     }
-  fftw_execute (pv->plan_inv); // iFFT: f_out[] -> t_out[]
   // scale by len and windowing
+#ifdef WAON_FLOAT
+  fftwf_execute (pv->plan_inv); // iFFT: f_out[] -> t_out[]
+  windowing_f (pv->len, pv->t_out, pv->flag_window, (double)pv->len * scale,
+	       pv->t_out);
+#else // !WAON_FLOAT
+  fftw_execute (pv->plan_inv); // iFFT: f_out[] -> t_out[]
   windowing (pv->len, pv->t_out, pv->flag_window, (double)pv->len * scale,
 	     pv->t_out);
+#endif // WAON_FLOAT
   // superimpose
   for (i = 0; i < pv->len; i ++)
     {
-      out [pv->hop_syn + i] += pv->t_out [i];
+      out [pv->hop_syn + i] += (double)pv->t_out [i];
     }
 }
 
-/*
- * OUTPUT
- *  returned value : 1 if x[i] = 0 for i = 0 to n-1
- *                   0 otherwise
+void
+pv_complex_phase_vocoder (struct pv_complex *pv,
+			  const pv_real *fs, const pv_real *ft,
+			  const pv_real *f_out_old,
+			  pv_real *f_out)
+{
+#ifdef WAON_FLOAT
+  HC_complex_phase_vocoder_f (pv->len, fs, ft, f_out_old, f_out,
+			      pv->hc_tmp1, pv->hc_tmp2);
+#else // !WAON_FLOAT
+  HC_complex_phase_vocoder (pv->len, fs, ft, f_out_old, f_out,
+			    pv->hc_tmp1, pv->hc_tmp2);
+#endif // WAON_FLOAT
+}
+
+void
+pv_complex_phase_lock (struct pv_complex *pv,
+		       const pv_real *y, pv_real *z)
+{
+#ifdef WAON_FLOAT
+  HC_puckette_lock_f (pv->len, y, z);
+#else // !WAON_FLOAT
+  HC_puckette_lock (pv->len, y, z);
+#endif // WAON_FLOAT
+}
+
+/* run the converter on n frames of pv->src_in[] (end_of_input for n == 0)
+ * and append the output to pv->src_out[] after pv->src_left
  */
-static int
-check_zero (int n, const double *x)
+static void
+pv_complex_src_process (struct pv_complex *pv, long n)
 {
-  int i;
+  SRC_DATA srdata;
+  srdata.data_in = pv->src_in;
+  srdata.input_frames = n;
+  srdata.end_of_input = (n == 0 ? 1 : 0);
+  srdata.src_ratio = (double)(pv->hop_res) / (double)(pv->hop_syn);
+  /* change the ratio at once (not ramped over the block),
+   * so that the output of the step is hop_res for the new ratio */
+  src_set_ratio (pv->src, srdata.src_ratio);
 
-  for (i = 0; i < n; i ++)
+  for (;;)
     {
-      if (x[i] != 0.0) return 1;
+      // room for the whole block (and a margin for the ratio changed)
+      long need = pv->src_left
+	+ (long)((double)srdata.input_frames * srdata.src_ratio) + 64;
+      if (pv->src_nout < need)
+	{
+	  pv->src_out = (float *)realloc (pv->src_out,
+					  sizeof (float) * 2 * need);
+	  CHECK_MALLOC (pv->src_out, "pv_complex_src_process");
+	  pv->src_nout = need;
+	}
+      srdata.data_out = pv->src_out + 2 * pv->src_left;
+      srdata.output_frames = pv->src_nout - pv->src_left;
+
+      int status = src_process (pv->src, &srdata);
+      if (status != 0)
+	{
+	  fprintf (stderr, "fail to samplerate conversion: %s\n",
+		   src_strerror (status));
+	  exit (1);
+	}
+      pv->src_left += srdata.output_frames_gen;
+
+      srdata.data_in += 2 * srdata.input_frames_used;
+      srdata.input_frames -= srdata.input_frames_used;
+      if (srdata.input_frames > 0) continue;
+      // at the end, until the converter is empty
+      if (srdata.end_of_input == 0 || srdata.output_frames_gen == 0) break;
     }
-  return 0;
 }
 
-
-/* resample pv->[rl]_out[i] for i = 0 to pv->hop_syn
- *       to [left,right][i] for i = 0 to pv->hop_res
- * INPUT
- * OUTPUT
- */
-void
-pv_complex_resample (struct pv_complex *pv,
-		     double *left, double *right)
+/* pv_complex_resample() by struct pv_polyphase */
+static long
+pv_complex_resample_polyphase (struct pv_complex *pv,
+			       double *left, double *right)
 {
-  // samplerate conversion
-  SRC_DATA srdata;
-  static float  *fl_in  = NULL;
-  static float  *fl_out = NULL;
-  static int hop_syn0 = 0;
-  static int hop_res0 = 0;
-  if (fl_in == NULL)
-    {
-      fl_in  = (float *)malloc (sizeof (float) * 2 * pv->hop_syn);
-      fl_out = (float *)malloc (sizeof (float) * 2 * pv->hop_res);
-      CHECK_MALLOC (fl_in,  "pv_complex_resample");
-      CHECK_MALLOC (fl_out, "pv_complex_resample");
-      hop_syn0 = pv->hop_syn;
-      hop_res0 = pv->hop_res;
+  int flag_prime = 0;
+  if (pv->poly == NULL)
+    {
+      pv->poly = pv_polyphase_init (pv->hop_res, pv->hop_syn);
+      flag_prime = 1;
     }
   else
     {
-      if (hop_syn0 < pv->hop_syn)
+      pv_polyphase_set_ratio (pv->poly, pv->hop_res, pv->hop_syn);
+      if (pv->src_flag == 0)
 	{
-	  fl_in = (float *)realloc (fl_in, sizeof (float) * 2 * pv->hop_syn);
-	  CHECK_MALLOC (fl_in,  "pv_complex_resample");
-	  hop_syn0 = pv->hop_syn;
+	  // the steps before did not go through the resampler
+	  pv_polyphase_reset (pv->poly);
+	  flag_prime = 1;
 	}
-      if (hop_res0 < pv->hop_res)
+    }
+  pv->src_flag = 1;
+
+  long n = pv_polyphase_process (pv->poly,
+				 pv->l_out, pv->r_out, pv->hop_syn,
+				 left, right, pv->hop_res);
+  long i;
+  if (flag_prime != 0)
+    {
+      // the delay of the filter is discarded at the first step,
+      // and PV_SRC_RESERVE zeros are put ahead as the FIFO of libsamplerate
+      long nz = PV_SRC_RESERVE;
+      if (nz > pv->hop_res - n) nz = pv->hop_res - n;
+      memmove (left + nz,  left,  sizeof (double) * n);
+      memmove (right + nz, right, sizeof (double) * n);
+      for (i = 0; i < nz; i ++)
 	{
-	  fl_out =
-	    (float *)realloc (fl_out, sizeof (float) * 2 * pv->hop_res);
-	  CHECK_MALLOC (fl_out, "pv_complex_resample");
-	  hop_res0 = pv->hop_res;
+	  left  [i] = 0.0;
+	  right [i] = 0.0;
 	}
+      return (n + nz);
     }
 
-  srdata.input_frames  = pv->hop_syn;
-  srdata.output_frames = pv->hop_res;
-  srdata.src_ratio = (double)(pv->hop_res) / (double)(pv->hop_syn);
-  srdata.data_in  = fl_in;
-  srdata.data_out = fl_out;
+  // n is hop_res except the step where the ratio is changed
+  for (i = n; i < pv->hop_res; i ++)
+    {
+      left [i]  = (n > 0 ? left  [n - 1] : 0.0);
+      right [i] = (n > 0 ? right [n - 1] : 0.0);
+    }
+  return (pv->hop_res);
+}
 
-  // samplerate conversion (time fixed)
-  int i;
+long
+pv_complex_resample (struct pv_complex *pv,
+		     double *left, double *right)
+{
+  if (pv->src_type == PV_SRC_POLYPHASE)
+    {
+      return (pv_complex_resample_polyphase (pv, left, right));
+    }
+
+  if (pv->src == NULL)
+    {
+      int err;
+      pv->src = src_new (pv->src_type, 2, &err);
+      if (pv->src == NULL)
+	{
+	  fprintf (stderr, "fail to samplerate conversion: %s\n",
+		   src_strerror (err));
+	  exit (1);
+	}
+      pv->src_flag = 0;
+    }
+  int flag_prime = 0;
+  if (pv->src_flag == 0)
+    {
+      // the steps before did not go through the converter
+      src_reset (pv->src);
+      pv->src_left = 0;
+      pv->src_flag = 1;
+      flag_prime = 1;
+    }
+
+  if (pv->src_nin < pv->hop_syn)
+    {
+      pv->src_in = (float *)realloc (pv->src_in,
+				     sizeof (float) * 2 * pv->hop_syn);
+      CHECK_MALLOC (pv->src_in, "pv_complex_resample");
+      pv->src_nin = pv->hop_syn;
+    }
+
+  long i;
   for (i = 0; i < pv->hop_syn; i ++)
     {
-      fl_in [i*2 + 0] = (float)(pv->l_out [i]);
-      fl_in [i*2 + 1] = (float)(pv->r_out [i]);
+      pv->src_in [i*2 + 0] = (float)(pv->l_out [i]);
+      pv->src_in [i*2 + 1] = (float)(pv->r_out [i]);
     }
-  int status;
-  //status = src_simple (&srdata, SRC_SINC_BEST_QUALITY, 2);
-  status = src_simple (&srdata, SRC_SINC_FASTEST, 2);
-  // this works better
-  if (status != 0)
+  pv_complex_src_process (pv, pv->hop_syn);
+
+  if (flag_prime != 0)
     {
-      fprintf (stderr, "fail to samplerate conversion\n");
-      exit (1);
+      // zeros at the start for the latency of the converter
+      long npad = pv->hop_res + PV_SRC_RESERVE - pv->src_left;
+      if (npad > 0)
+	{
+	  if (pv->src_nout < pv->src_left + npad)
+	    {
+	      pv->src_nout = pv->src_left + npad;
+	      pv->src_out = (float *)realloc (pv->src_out,
+					      sizeof (float) * 2 * pv->src_nout);
+	      CHECK_MALLOC (pv->src_out, "pv_complex_resample");
+	    }
+	  memmove (pv->src_out + 2 * npad, pv->src_out,
+		   sizeof (float) * 2 * pv->src_left);
+	  for (i = 0; i < 2 * npad; i ++)
+	    {
+	      pv->src_out [i] = 0.0;
+	    }
+	  pv->src_left += npad;
+	}
     }
 
-  for (i = 0; i < pv->hop_res; i ++)
+  // take hop_res frames from the FIFO
+  long n = pv->hop_res;
+  if (n > pv->src_left) n = pv->src_left; // not for the reserve
+  for (i = 0; i < n; i ++)
+    {
+      left  [i] = (double)(pv->src_out [i*2 + 0]);
+      right [i] = (double)(pv->src_out [i*2 + 1]);
+    }
+  for (; i < pv->hop_res; i ++)
+    {
+      // hold the last frame
+      left  [i] = (n > 0 ? left  [n - 1] : 0.0);
+      right [i] = (n > 0 ? right [n - 1] : 0.0);
+    }
+  pv->src_left -= n;
+  if (pv->src_left > 0)
     {
-      left [i]  = (double)(fl_out [i*2 + 0]);
-      right [i] = (double)(fl_out [i*2 + 1]);
+      memmove (pv->src_out, pv->src_out + 2 * n,
+	       sizeof (float) * 2 * pv->src_left);
     }
+  return (pv->hop_res);
+}
+
+/* pv->[lr]_resamp[] for n frames */
+static void
+pv_complex_resamp_alloc (struct pv_complex *pv, long n)
+{
+  if (pv->nresamp >= n) return;
+
+  pv->l_resamp = (double *)realloc (pv->l_resamp, sizeof (double) * n);
+  pv->r_resamp = (double *)realloc (pv->r_resamp, sizeof (double) * n);
+  CHECK_MALLOC (pv->l_resamp, "pv_complex_resamp_alloc");
+  CHECK_MALLOC (pv->r_resamp, "pv_complex_resamp_alloc");
+  pv->nresamp = n;
 }
 
 /* play l[n] and r[n] into ao or snd devices
@@ -338,14 +765,17 @@ pv_complex_play (struct pv_complex *pv,
   int status = 0;
   if (pv->flag_out == 0)
     {
-      status = ao_write (pv->ao, l, r, n);
-      status /= 4; // 2 bytes for 2 channels
+      status = ao_out_write (pv->ao, l, r, n);
     }
   else if (pv->flag_out == 1)
     {
       status = sndfile_write (pv->sfout, *(pv->sfout_info),
 			      l, r, n);
     }
+  else if (pv->flag_out == 2)
+    {
+      status = pv->out_func (pv->out_data, l, r, n);
+    }
   else
     {
       fprintf (stderr, "invalid output device\n");
@@ -354,6 +784,66 @@ pv_complex_play (struct pv_complex *pv,
   return (status);
 }
 
+void
+pv_complex_shift_out (struct pv_complex *pv)
+{
+  long n = pv->len;
+  if (pv->len_tail > n)
+    {
+      // the tail of the larger len before, which is gone in len_tail
+      n = pv->len_tail;
+      pv->len_tail -= pv->hop_syn;
+    }
+
+  long i;
+  for (i = 0; i < n; i ++)
+    {
+      pv->l_out [i] = pv->l_out [i + pv->hop_syn];
+      pv->r_out [i] = pv->r_out [i + pv->hop_syn];
+    }
+  for (i = n; i < n + pv->hop_syn; i ++)
+    {
+      pv->l_out [i] = 0.0;
+      pv->r_out [i] = 0.0;
+    }
+}
+
+int
+pv_complex_play_resample_flush (struct pv_complex *pv)
+{
+  if (pv->src_flag == 0) return (0);
+
+  long n;
+  if (pv->src_type == PV_SRC_POLYPHASE)
+    {
+      // the input delayed in the filter
+      long nmax = (long)PV_POLYPHASE_HALF * pv->poly->up / pv->poly->down
+	+ 2;
+      pv_complex_resamp_alloc (pv, nmax);
+      n = pv_polyphase_process (pv->poly,
+				NULL, NULL, (long)PV_POLYPHASE_HALF,
+				pv->l_resamp, pv->r_resamp, nmax);
+    }
+  else
+    {
+      pv_complex_src_process (pv, 0);
+
+      n = pv->src_left;
+      pv_complex_resamp_alloc (pv, n);
+      long i;
+      for (i = 0; i < n; i ++)
+	{
+	  pv->l_resamp [i] = (double)(pv->src_out [i*2 + 0]);
+	  pv->r_resamp [i] = (double)(pv->src_out [i*2 + 1]);
+	}
+      pv->src_left = 0;
+    }
+  pv->src_flag = 0;
+
+  if (n == 0) return (0);
+  return (pv_complex_play (pv, (int)n, pv->l_resamp, pv->r_resamp));
+}
+
 /* play the segment of pv->[lr]_out[] for pv->hop_syn
  * pv->pitch_shift is taken into account, so that 
  * the output frames are pv->hop_res.
@@ -368,33 +858,17 @@ pv_complex_play_resample (struct pv_complex *pv)
   if (pv->hop_syn != pv->hop_res)
     {
       // samplerate conversion
-      static double *l_resamp = NULL;
-      static double *r_resamp = NULL;
-      static int hop_res0 = 0;
-      if (l_resamp == NULL)
-	{
-	  l_resamp = (double *)malloc (sizeof (double) * pv->hop_res);
-	  r_resamp = (double *)malloc (sizeof (double) * pv->hop_res);
-	  CHECK_MALLOC (l_resamp, "pv_complex_play_resample");
-	  CHECK_MALLOC (r_resamp, "pv_complex_play_resample");
-	  hop_res0 = pv->hop_res;
-	}
-      else if (hop_res0 < pv->hop_res)
-	{
-	  l_resamp =
-	    (double *)realloc (l_resamp, sizeof (double) * pv->hop_res);
-	  r_resamp =
-	    (double *)realloc (r_resamp, sizeof (double) * pv->hop_res);
-	  CHECK_MALLOC (l_resamp, "pv_complex_play_resample");
-	  CHECK_MALLOC (r_resamp, "pv_complex_play_resample");
-	  hop_res0 = pv->hop_res;
-	}
-
-      pv_complex_resample (pv, l_resamp, r_resamp);
-      status = pv_complex_play (pv, pv->hop_res, l_resamp, r_resamp);
+      pv_complex_resamp_alloc (pv, pv->hop_res);
+      long n = pv_complex_resample (pv, pv->l_resamp, pv->r_resamp);
+      status = pv_complex_play (pv, (int)n, pv->l_resamp, pv->r_resamp);
+      // the frames discarded for the delay of the polyphase filter
+      // are counted as played
+      if (status == (int)n) status = (int)pv->hop_res;
     }
   else
     {
+      // the rest in the converter since the pitch was shifted
+      pv_complex_play_resample_flush (pv);
       status = pv_complex_play (pv, pv->hop_syn, pv->l_out, pv->r_out);
     }
 
@@ -421,58 +895,21 @@ long
 pv_complex_play_step (struct pv_complex *pv,
 		      long cur)
 {
-  static int len = 0;
-  static double *l_fs  = NULL;
-  static double *r_fs  = NULL;
-  static double *l_ft  = NULL;
-  static double *r_ft  = NULL;
-  static double *l_tmp = NULL;
-  static double *r_tmp = NULL;
-
-  if (l_fs == NULL)
-    {
-      l_fs = (double *)malloc (pv->len * sizeof (double));
-      r_fs = (double *)malloc (pv->len * sizeof (double));
-      CHECK_MALLOC (l_fs, "pv_complex_play_step");
-      CHECK_MALLOC (r_fs, "pv_complex_play_step");
-
-      l_ft = (double *)malloc (pv->len * sizeof (double));
-      r_ft = (double *)malloc (pv->len * sizeof (double));
-      CHECK_MALLOC (l_ft, "pv_complex_play_step");
-      CHECK_MALLOC (r_ft, "pv_complex_play_step");
-
-      l_tmp = (double *)malloc (pv->len * sizeof (double));
-      r_tmp = (double *)malloc (pv->len * sizeof (double));
-      CHECK_MALLOC (l_tmp, "pv_complex_play_step");
-      CHECK_MALLOC (r_tmp, "pv_complex_play_step");
-
-      len = pv->len;
-    }
-  else if (len < pv->len)
-    {
-      l_fs = (double *)realloc (l_fs, pv->len * sizeof (double));
-      r_fs = (double *)realloc (r_fs, pv->len * sizeof (double));
-      CHECK_MALLOC (l_fs, "pv_complex_play_step");
-      CHECK_MALLOC (r_fs, "pv_complex_play_step");
-
-      l_ft = (double *)realloc (l_ft, pv->len * sizeof (double));
-      r_ft = (double *)realloc (r_ft, pv->len * sizeof (double));
-      CHECK_MALLOC (l_ft, "pv_complex_play_step");
-      CHECK_MALLOC (r_ft, "pv_complex_play_step");
-
-      l_tmp = (double *)realloc (l_tmp, pv->len * sizeof (double));
-      r_tmp = (double *)realloc (r_tmp, pv->len * sizeof (double));
-      CHECK_MALLOC (l_tmp, "pv_complex_play_step");
-      CHECK_MALLOC (r_tmp, "pv_complex_play_step");
-
-      len = pv->len;
-    }
+  pv_real *l_fs  = pv->l_fs;
+  pv_real *r_fs  = pv->r_fs;
+  pv_real *l_ft  = pv->l_ft;
+  pv_real *r_ft  = pv->r_ft;
+  pv_real *l_tmp = pv->l_tmp;
+  pv_real *r_tmp = pv->r_tmp;
 
   long status;
+  int flag_left_s, flag_right_s;
+  int flag_left_t, flag_right_t;
   /* read starting data [cur, cur + len]
    * ==> FFT ==> fs[len] 
    */
-  status = read_and_FFT_stereo (pv, cur, l_fs, r_fs);
+  status = read_and_FFT_stereo (pv, cur, l_fs, r_fs,
+				&flag_left_s, &flag_right_s);
   if (status != pv->len)
     {
       return 0; // no output
@@ -481,33 +918,16 @@ pv_complex_play_step (struct pv_complex *pv,
   /* read terminal data [cur + hop_syn, cur + hop_syn + len]
    * ==> FFT ==> ft[len]
    */
-  status = read_and_FFT_stereo (pv, cur + pv->hop_syn, l_ft, r_ft);
+  status = read_and_FFT_stereo (pv, cur + pv->hop_syn, l_ft, r_ft,
+				&flag_left_t, &flag_right_t);
   if (status != pv->len)
     {
       return 0; // no output
     }
 
-  // check zero
-  int flag_left_cur;
-  int flag_right_cur;
-  if (check_zero (pv->len, l_fs) == 0 ||
-      check_zero (pv->len, l_ft) == 0)
-    {
-      flag_left_cur = 0; // inactive
-    }
-  else
-    {
-      flag_left_cur = 1; // active
-    }
-  if (check_zero (pv->len, r_fs) == 0 ||
-      check_zero (pv->len, r_ft) == 0)
-    {
-      flag_right_cur = 0; // inactive
-    }
-  else
-    {
-      flag_right_cur = 1; // active
-    }
+  // the channel is active only if both frames are not silent
+  int flag_left_cur  = (flag_left_s  && flag_left_t);
+  int flag_right_cur = (flag_right_s && flag_right_t);
 
 
   /* phase vocoder process
@@ -530,7 +950,7 @@ pv_complex_play_step (struct pv_complex *pv,
 	  else // loose phase lock
 	    {
 	      // apply loose phase lock
-	      HC_puckette_lock (pv->len, l_fs, pv->l_f_old);
+	      pv_complex_phase_lock (pv, l_fs, pv->l_f_old);
 	    }
 
 	  pv->flag_left = 1;
@@ -540,7 +960,7 @@ pv_complex_play_step (struct pv_complex *pv,
       if (pv->flag_lock == 0) // no phase lock
 	{
 	  // Y[u_i] = X[t_i] (Y[u_{i-1}]/X[s_i]) / |Y[u_{i-1}]/X[s_i]|
-	  HC_complex_phase_vocoder (pv->len, l_fs, l_ft, pv->l_f_old,
+	  pv_complex_phase_vocoder (pv, l_fs, l_ft, pv->l_f_old,
 				    pv->l_f_old);
 	  // already backed up for the next step in [lr]_f_old[]
 	  apply_invFFT_mono (pv, pv->l_f_old, pv->window_scale, pv->l_out);
@@ -548,10 +968,10 @@ pv_complex_play_step (struct pv_complex *pv,
       else // loose phase lock
 	{
 	  // Y[u_i] = X[t_i] (Z[u_{i-1}]/X[s_i]) / |Z[u_{i-1}]/X[s_i]|
-	  HC_complex_phase_vocoder (pv->len, l_fs, l_ft, pv->l_f_old,
+	  pv_complex_phase_vocoder (pv, l_fs, l_ft, pv->l_f_old,
 				    l_tmp);
 	  // apply loose phase lock and store for the next step
-	  HC_puckette_lock (pv->len, l_tmp, pv->l_f_old);
+	  pv_complex_phase_lock (pv, l_tmp, pv->l_f_old);
 
 	  apply_invFFT_mono (pv, l_tmp, pv->window_scale, pv->l_out);
 	}
@@ -574,7 +994,7 @@ pv_complex_play_step (struct pv_complex *pv,
 	  else // loose phase lock
 	    {
 	      // apply loose phase lock
-	      HC_puckette_lock (pv->len, r_fs, pv->r_f_old);
+	      pv_complex_phase_lock (pv, r_fs, pv->r_f_old);
 	    }
 	  pv->flag_right = 1;
 	}
@@ -583,7 +1003,7 @@ pv_complex_play_step (struct pv_complex *pv,
       if (pv->flag_lock == 0) // no phase lock
 	{
 	  // Y[u_i] = X[t_i] (Y[u_{i-1}]/X[s_i]) / |Y[u_{i-1}]/X[s_i]|
-	  HC_complex_phase_vocoder (pv->len, r_fs, r_ft, pv->r_f_old,
+	  pv_complex_phase_vocoder (pv, r_fs, r_ft, pv->r_f_old,
 				    pv->r_f_old);
 	  // already backed up for the next step in [lr]_f_old[]
 	  apply_invFFT_mono (pv, pv->r_f_old, pv->window_scale, pv->r_out);
@@ -591,10 +1011,10 @@ pv_complex_play_step (struct pv_complex *pv,
       else // loose phase lock
 	{
 	  // Y[u_i] = X[t_i] (Z[u_{i-1}]/X[s_i]) / |Z[u_{i-1}]/X[s_i]|
-	  HC_complex_phase_vocoder (pv->len, r_fs, r_ft, pv->r_f_old,
+	  pv_complex_phase_vocoder (pv, r_fs, r_ft, pv->r_f_old,
 				    r_tmp);
 	  // apply loose phase lock and store for the next step
-	  HC_puckette_lock (pv->len, r_tmp, pv->r_f_old);
+	  pv_complex_phase_lock (pv, r_tmp, pv->r_f_old);
 
 	  apply_invFFT_mono (pv, r_tmp, pv->window_scale, pv->r_out);
 	}
@@ -610,16 +1030,7 @@ pv_complex_play_step (struct pv_complex *pv,
   /* shift
    * out[hop_syn, hop_syn + len] ==> out[0, len]
    */
-  for (i = 0; i < pv->len; i ++)
-    {
-      pv->l_out [i] = pv->l_out [i + pv->hop_syn];
-      pv->r_out [i] = pv->r_out [i + pv->hop_syn];
-    }
-  for (i = pv->len; i < pv->len + pv->hop_syn; i ++)
-    {
-      pv->l_out [i] = 0.0;
-      pv->r_out [i] = 0.0;
-    }
+  pv_complex_shift_out (pv);
 
   return (status);
 }
@@ -638,17 +1049,21 @@ pv_complex_play_step (struct pv_complex *pv,
  *              1 == loose phase lock is applied
  *  rate : time-streching rate
  *  pitch_shift : in the unit of half-note
+ *  silence : peak amplitude at or below which the input is silent
  */
 void pv_complex (const char *file, const char *outfile,
 		  double rate, double pitch_shift,
 		  long len, long hop_syn,
 		  int flag_window,
-		  int flag_lock)
+		  int flag_lock,
+		  double silence,
+		  int src_type)
 {
   long hop_res = (long)((double)hop_syn * pow (2.0, - pitch_shift / 12.0));
   long hop_ana = (long)((double)hop_res * rate);
 
   struct pv_complex *pv = pv_complex_init (len, hop_syn, flag_window);
+  pv_complex_set_src_type (pv, src_type);
   pv->hop_res = hop_res;
   pv->hop_ana = hop_ana;
   //pv->pitch_shift = pitch_shift;
@@ -668,12 +1083,12 @@ void pv_complex (const char *file, const char *outfile,
   pv_complex_set_input (pv, sf, &sfinfo);
 
 
-  ao_device *ao = NULL;
+  struct ao_out *ao = NULL;
   SNDFILE *sfout = NULL;
   SF_INFO sfout_info;
   if (outfile == NULL)
     {
-      ao = ao_init_16_stereo (sfinfo.samplerate, 1 /* verbose */);
+      ao = ao_out_open (sfinfo.samplerate, 1 /* verbose */);
       pv_complex_set_output_ao (pv, ao);
     }
   else
@@ -690,6 +1105,7 @@ void pv_complex (const char *file, const char *outfile,
       pv_complex_set_output_sf (pv, sfout, &sfout_info);
     }
   pv->flag_lock = flag_lock;
+  pv->silence = silence;
 
   long cur;
   for (cur = 0; cur < (long)sfinfo.frames; cur += pv->hop_ana)
@@ -700,10 +1116,12 @@ void pv_complex (const char *file, const char *outfile,
 	  break;
 	}
     }
+  // frames left in the converter
+  pv_complex_play_resample_flush (pv);
 
   if (outfile == NULL)
     {
-      ao_close (ao);
+      ao_out_close (ao);
     }
   else
     {
@@ -29,22 +29,67 @@
 
 // ao device
 #include <ao/ao.h>
+#include "ao-wrapper.h" // struct ao_out
 
+// samplerate
+#include <samplerate.h> // SRC_STATE
+#include "pv-polyphase.h" // struct pv_polyphase
+
+/* src_type for the built-in polyphase resampler (pv-polyphase.c)
+ * next to the converters of libsamplerate (0 to 4) */
+#define PV_SRC_POLYPHASE (5)
+
+/* frames kept in pv->src_out[] over hop_res against the jitter
+ * of the output of the converter per step (one frame or so) */
+#define PV_SRC_RESERVE (4)
+
+/* WAON_FLOAT : the input, the FFT and the spectra of the vocoder are
+ *              in single precision by fftwf (link with fftw3f),
+ *              while the output [lr]_out[] to the devices is in double
+ */
+#ifdef WAON_FLOAT
+typedef float pv_real;
+#else // !WAON_FLOAT
+typedef double pv_real;
+#endif // WAON_FLOAT
+
+
+/* FFT plans and buffers for one length in the pool of struct pv_complex */
+struct pv_complex_fft {
+  long len;
+
+  pv_real *time;
+  pv_real *freq;
+  pv_real *t_out;
+  pv_real *f_out;
+#ifdef WAON_FLOAT
+  fftwf_plan plan;
+  fftwf_plan plan_inv;
+#else // !WAON_FLOAT
+  fftw_plan plan;
+  fftw_plan plan_inv;
+#endif // WAON_FLOAT
+};
 
 struct pv_complex {
   // input (just reference purpose only)
   SNDFILE *sf;
   SF_INFO *sfinfo;
+  pv_real *sf_buf; // [len_max * channels] interleaved data of sndfile_read()
 
   // output (just reference purpose only)
-  int flag_out; // 0 = ao, 1 = sf
+  int flag_out; // 0 = ao, 1 = sf, 2 = func
 
-  ao_device *ao;
+  struct ao_out *ao;
 
   SNDFILE *sfout;
   SF_INFO *sfout_info;
 
-  long len; // FFT length
+  // returns the frames taken (should be n)
+  int (*out_func) (void *data, const double *l, const double *r, int n);
+  void *out_data;
+
+  long len; // FFT length (one of pool[])
 
   long hop_ana;
   long hop_syn;
@@ -53,24 +98,66 @@ struct pv_complex {
   int flag_window;
   double window_scale;
 
-  double *time;
-  double *freq;
+  // plans and buffers of the present len (pointers into pool[])
+  pv_real *time;
+  pv_real *freq;
+  pv_real *t_out;
+  pv_real *f_out;
+#ifdef WAON_FLOAT
+  fftwf_plan plan;
+  fftwf_plan plan_inv;
+#else // !WAON_FLOAT
   fftw_plan plan;
-
-  double *t_out;
-  double *f_out;
   fftw_plan plan_inv;
+#endif // WAON_FLOAT
+
+  /* pool of the FFT lengths len_min * 2^i up to len_max, all planned
+   * by the init, so that pv_complex_change_len() is a pointer swap */
+  int npool;
+  struct pv_complex_fft *pool;
+  long len_max;
+  long len_tail; // extent of [lr]_out[] left by the larger len before
 
   int flag_left;  // whether l_f_old[] is ready (1) or not (0)
   int flag_right; // whether r_f_old[] is ready (1) or not (0)
 
-  double *l_f_old;
-  double *r_f_old;
+  pv_real *l_f_old;
+  pv_real *r_f_old;
 
-  double *l_out;
+  double *l_out; // [2 * len_max] for hop_syn up to len_max
   double *r_out;
 
+  // work area of pv_complex_play_step() [len_max]
+  pv_real *l_in;
+  pv_real *r_in;
+  pv_real *l_fs;
+  pv_real *r_fs;
+  pv_real *l_ft;
+  pv_real *r_ft;
+  pv_real *l_tmp;
+  pv_real *r_tmp;
+  pv_real *hc_tmp1; // for HC_complex_phase_vocoder()
+  pv_real *hc_tmp2;
+
+  /* samplerate conversion of hop_syn into hop_res for the pitch shift
+   * by the converter kept through the steps (pv_complex_resample()) */
+  int src_type;   // converter type of libsamplerate (SRC_SINC_FASTEST)
+                  // or PV_SRC_POLYPHASE
+  SRC_STATE *src; // for 2 channels (NULL == not made yet)
+  struct pv_polyphase *poly; // for PV_SRC_POLYPHASE (NULL == not yet)
+  int src_flag;   // 0 == reset the converter at the next step
+  float *src_in;  // [2 * src_nin] interleaved
+  long src_nin;
+  float *src_out; // [2 * src_nout] interleaved, where the frames
+  long src_nout;  //   more than hop_res are kept for the next step
+  long src_left;  // frames kept in src_out[]
+  double *l_resamp; // [nresamp] output of pv_complex_play_resample()
+  double *r_resamp;
+  long nresamp;
+
   int flag_lock; // 0 = no phase lock, 1 = loose phase lock
+
+  double silence; // peak amplitude at or below which the input is silent
 };
 
 
@@ -79,6 +166,32 @@ struct pv_complex {
 struct pv_complex *
 pv_complex_init (long len, long hop_syn, int flag_window);
 
+/* initialize with the pool of the FFT lengths, len * 2^i,
+ * from len_min to len_max, whose plans and buffers are made here
+ * so that the length can be changed during the playback
+ * without any allocation nor planning.
+ * (pv_complex_init() is the pool of len only)
+ */
+struct pv_complex *
+pv_complex_init_pool (long len, long len_min, long len_max,
+		      long hop_syn, int flag_window);
+
+/* change the FFT length to one in the pool by swapping the pointers,
+ * where hop_syn is scaled to keep the overlap
+ * (call pv_complex_change_rate_pitch() after this).
+ * the tail of the former frames left in [lr]_out[] fades out
+ * by the overlap-add while the frames of the new len fade in,
+ * that is, the change is crossfaded over the former len.
+ * OUTPUT
+ *  returned value : 0 on success, -1 if len is not in the pool
+ */
+int
+pv_complex_change_len (struct pv_complex *pv, long len);
+
+/* change the window (and its scale factor for the present len) */
+void
+pv_complex_change_window (struct pv_complex *pv, int flag_window);
+
 /* change rate and pitch (note that hop_syn is fixed)
  * INPUT
  *  pv : struct pv_complex
@@ -103,33 +216,116 @@ pv_complex_set_output_sf (struct pv_complex *pv,
 			  SNDFILE *sf, SF_INFO *sfinfo);
 void
 pv_complex_set_output_ao (struct pv_complex *pv,
-			  ao_device *ao);
+			  struct ao_out *ao);
+/* set the converter of libsamplerate for the pitch shift
+ * INPUT
+ *  src_type : SRC_SINC_BEST_QUALITY, SRC_SINC_MEDIUM_QUALITY,
+ *             SRC_SINC_FASTEST (default), SRC_ZERO_ORDER_HOLD, SRC_LINEAR
+ *             or PV_SRC_POLYPHASE
+ * OUTPUT
+ *  returned value : 0 on success, -1 for the invalid type
+ */
+int
+pv_complex_set_src_type (struct pv_complex *pv, int src_type);
+/* give the output to func() instead of the device,
+ * where func() returns the frames taken (should be n)
+ */
+void
+pv_complex_set_output_func (struct pv_complex *pv,
+			    int (*func) (void *data,
+					 const double *l, const double *r,
+					 int n),
+			    void *data);
 
 void
 pv_complex_free (struct pv_complex *pv);
 
 
+/* apply FFT on each channel of pv->len frames in left[] and right[],
+ * where the silent channel is not transformed.
+ * OUTPUT
+ *  f_left[len], f_right[len] : FFT of the active channel
+ *  flag_left, flag_right : 1 == active, 0 == silent
+ *                          (peak amplitude <= pv->silence)
+ */
+void
+FFT_stereo (struct pv_complex *pv,
+	    const pv_real *left, const pv_real *right,
+	    pv_real *f_left, pv_real *f_right,
+	    int *flag_left, int *flag_right);
+/* read pv->len frames from frame into pv->l_in[] and pv->r_in[]
+ * OUTPUT
+ *  returned value : frames read
+ */
+long
+pv_complex_read (struct pv_complex *pv, long frame);
+/* read pv->len frames from frame and apply FFT on each channel,
+ * where the silent channel is not transformed.
+ * OUTPUT
+ *  f_left[len], f_right[len] : FFT of the active channel
+ *  flag_left, flag_right : 1 == active, 0 == silent
+ *                          (peak amplitude <= pv->silence)
+ *  returned value : frames read
+ */
 long
 read_and_FFT_stereo (struct pv_complex *pv,
 		     long frame,
-		     double *f_left, double *f_right);
+		     pv_real *f_left, pv_real *f_right,
+		     int *flag_left, int *flag_right);
 /* the results are stored in out [i] for i = hop_syn to (hop_syn + len)
  * INPUT
  *  scale : for safety (give 0.5, for example)
  */
 void
 apply_invFFT_mono (struct pv_complex *pv,
-		   const double *f, double scale,
+		   const pv_real *f, double scale,
 		   double *out);
+/* HC_complex_phase_vocoder() in the precision of pv_real
+ * on the work area of pv
+ */
+void
+pv_complex_phase_vocoder (struct pv_complex *pv,
+			  const pv_real *fs, const pv_real *ft,
+			  const pv_real *f_out_old,
+			  pv_real *f_out);
+/* HC_puckette_lock() in the precision of pv_real
+ * NOTE: y cannot be z!
+ */
+void
+pv_complex_phase_lock (struct pv_complex *pv,
+		       const pv_real *y, pv_real *z);
 /* resample pv->[rl]_out[i] for i = 0 to pv->hop_syn
  *       to [left,right][i] for i = 0 to pv->hop_res
- * INPUT
+ * by the converter continued from the last step, so that the blocks
+ * are joined smoothly. the output is taken from the FIFO pv->src_out[],
+ * which is primed by zeros only at the first step after the reset
+ * up to hop_res plus PV_SRC_RESERVE frames (for the converter latency),
+ * so that the output is delayed but never broken by zeros afterwards.
+ * for PV_SRC_POLYPHASE, the delay of the filter is discarded instead,
+ * where the first step gives PV_SRC_RESERVE zeros and the output
+ * aligned to the input (less than hop_res).
  * OUTPUT
+ *  left [hop_res], right [hop_res] :
+ *  returned value : frames in left[] and right[], which is hop_res
+ *                   except the first step of PV_SRC_POLYPHASE
  */
-void
+long
 pv_complex_resample (struct pv_complex *pv,
 		     double *left, double *right);
 
+/* play the frames left in the converter at the end of the input
+ * OUTPUT
+ *  returned value : frames played
+ */
+int
+pv_complex_play_resample_flush (struct pv_complex *pv);
+
+/* shift pv->[lr]_out[] by pv->hop_syn after the segment is played,
+ * including the tail of the larger len before pv_complex_change_len()
+ */
+void
+pv_complex_shift_out (struct pv_complex *pv);
+
 /* play the segment of pv->[lr]_out[] for pv->hop_syn
  * pv->pitch_shift is taken into account, so that 
  * the output frames are pv->hop_res.
@@ -172,12 +368,16 @@ pv_complex_play_step (struct pv_complex *pv,
  *              1 == loose phase lock is applied
  *  rate : time-streching rate
  *  pitch_shift : in the unit of half-note
+ *  silence : peak amplitude at or below which the input is silent
+ *  src_type : converter of libsamplerate for the pitch shift
  */
 void pv_complex (const char *file, const char *outfile,
 		 double rate, double pitch_shift,
 		 long len, long hop_syn,
 		 int flag_window,
-		 int flag_lock);
+		 int flag_lock,
+		 double silence,
+		 int src_type);
 
 
 #endif /* !_PV_COMPLEX_H_ */
@@ -52,7 +52,7 @@
 int
 pv_play_resample (long hop_res, long hop_syn,
 		  double *l_out, double *r_out,
-		  ao_device *ao, SNDFILE *sfout, SF_INFO *sfout_info)
+		  struct ao_out *ao, SNDFILE *sfout, SF_INFO *sfout_info)
 {
   int status = 0;
 
@@ -107,8 +107,7 @@ pv_play_resample (long hop_res, long hop_syn,
       // output
       if (sfout == NULL)
 	{
-	  status = ao_write (ao, l_out_src, r_out_src, hop_res);
-	  status /= 4; // 2 bytes for 2 channels
+	  status = ao_out_write (ao, l_out_src, r_out_src, hop_res);
 	}
       else
 	{
@@ -128,8 +127,7 @@ pv_play_resample (long hop_res, long hop_syn,
       // output
       if (sfout == NULL)
 	{
-	  status = ao_write (ao, l_out, r_out, hop_syn);
-	  status /= 4; // 2 bytes for 2 channels
+	  status = ao_out_write (ao, l_out, r_out, hop_syn);
 	}
       else
 	{
@@ -227,12 +225,12 @@ void pv_conventional (const char *file, const char *outfile,
 
   // prepare the output
   int status;
-  ao_device *ao = NULL;
+  struct ao_out *ao = NULL;
   SNDFILE *sfout = NULL;
   SF_INFO sfout_info;
   if (outfile == NULL)
     {
-      ao = ao_init_16_stereo (sfinfo.samplerate, 1 /* verbose */);
+      ao = ao_out_open (sfinfo.samplerate, 1 /* verbose */);
     }
   else
     {
@@ -325,7 +323,7 @@ void pv_conventional (const char *file, const char *outfile,
 
 
   // read the first frame
-  read_status = sndfile_read (sf, sfinfo, left, right, len);
+  read_status = sndfile_read (sf, sfinfo, left, right, len, NULL);
   if (read_status != len)
     {
       exit (1);
@@ -359,8 +357,7 @@ void pv_conventional (const char *file, const char *outfile,
 	      double dphi;
 	      dphi = ph_in [k] - l_ph_in_old [k]
 		- omega [k] * (double)hop_ana;
-	      for (; dphi >= M_PI; dphi -= twopi);
-	      for (; dphi < -M_PI; dphi += twopi);
+	      dphi = principal_argument (dphi);
 
 	      l_ph_out [k] += dphi * (double)hop_syn / (double)hop_ana
 		+ omega [k] * (double)hop_syn;
@@ -403,8 +400,7 @@ void pv_conventional (const char *file, const char *outfile,
 	      double dphi;
 	      dphi = ph_in [k] - r_ph_in_old [k]
 		- omega [k] * (double)hop_ana;
-	      for (; dphi >= M_PI; dphi -= twopi);
-	      for (; dphi < -M_PI; dphi += twopi);
+	      dphi = principal_argument (dphi);
 
 	      r_ph_out [k] += dphi * (double)hop_syn / (double)hop_ana
 		+ omega [k] * (double)hop_syn;
@@ -453,7 +449,7 @@ void pv_conventional (const char *file, const char *outfile,
       read_status = sndfile_read (sf, sfinfo,
 				  left  + len - hop_ana,
 				  right + len - hop_ana,
-				  hop_ana);
+				  hop_ana, NULL);
       if (read_status != hop_ana)
 	{
 	  // most likely, it is EOF.
@@ -465,7 +461,7 @@ void pv_conventional (const char *file, const char *outfile,
   sf_close (sf);
   if (outfile == NULL)
     {
-      ao_close (ao);
+      ao_out_close (ao);
     }
   else
     {
@@ -33,7 +33,7 @@
 int
 pv_play_resample (long hop_res, long hop_syn,
 		  double *l_out, double *r_out,
-		  ao_device *ao, SNDFILE *sfout, SF_INFO *sfout_info);
+		  struct ao_out *ao, SNDFILE *sfout, SF_INFO *sfout_info);
 
 
 /* estimate the superposing weight for the window with hop
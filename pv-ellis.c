@@ -54,7 +54,7 @@ read_and_FFT_stereo (SNDFILE *sf, SF_INFO *sfinfo,
 
   long status;
   status = sndfile_read_at (sf, *sfinfo, frame,
-			    left, right, len);
+			    left, right, len, NULL);
   if (status != len)
     {
       free (left);
@@ -127,12 +127,12 @@ void pv_ellis (const char *file, const char *outfile,
 
   // prepare the output
   int status;
-  ao_device *ao = NULL;
+  struct ao_out *ao = NULL;
   SNDFILE *sfout = NULL;
   SF_INFO sfout_info;
   if (outfile == NULL)
     {
-      ao = ao_init_16_stereo (sfinfo.samplerate, 1 /* verbose */);
+      ao = ao_out_open (sfinfo.samplerate, 1 /* verbose */);
     }
   else
     {
@@ -400,14 +400,12 @@ void pv_ellis (const char *file, const char *outfile,
 	  // while the phase increment is for hop_syn frames.
 
 	  dp = l_phs [k] - l_ph0 [k] - omega [k] * (double)hop_syn;
-	  for (; dp >= M_PI; dp -= twopi);
-	  for (; dp < -M_PI; dp += twopi);
+	  dp = principal_argument (dp);
 	  l_ph [k] += (omega [k] + dp / (double)hop_syn) * (double) hop_syn;
 	  l_ph [k] -= twopi * (double)((int)(l_ph [k] / twopi));
 
 	  dp = r_phs [k] - r_ph0 [k] - omega [k] * (double)hop_syn;
-	  for (; dp >= M_PI; dp -= twopi);
-	  for (; dp < -M_PI; dp += twopi);
+	  dp = principal_argument (dp);
 	  r_ph [k] += (omega [k] + dp / (double)hop_syn) * (double) hop_syn;
 	  r_ph [k] -= twopi * (double)((int)(r_ph [k] / twopi));
 	}
@@ -441,7 +439,7 @@ void pv_ellis (const char *file, const char *outfile,
   sf_close (sf) ;
   if (outfile == NULL)
     {
-      ao_close (ao);
+      ao_out_close (ao);
     }
   else
     {
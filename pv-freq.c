@@ -80,12 +80,12 @@ void pv_freq (const char *file, const char *outfile,
 
   // prepare the output
   int status;
-  ao_device *ao = NULL;
+  struct ao_out *ao = NULL;
   SNDFILE *sfout = NULL;
   SF_INFO sfout_info;
   if (outfile == NULL)
     {
-      ao = ao_init_16_stereo (sfinfo.samplerate, 1 /* verbose */);
+      ao = ao_out_open (sfinfo.samplerate, 1 /* verbose */);
     }
   else
     {
@@ -145,7 +145,7 @@ void pv_freq (const char *file, const char *outfile,
 
 
   int step = 0;
-  while (sndfile_read (sf, sfinfo, left, right, len) != 0)
+  while (sndfile_read (sf, sfinfo, left, right, len, NULL) != 0)
     {
       // left channel
       apply_FFT (len, left, flag_window, plan, time, freq, 2.0, amp, phs);
@@ -186,8 +186,8 @@ void pv_freq (const char *file, const char *outfile,
       // output
       if (outfile == NULL)
 	{
-	  status = ao_write (ao, l_out, r_out, hop_syn);
-	  status /= 4; // 2 bytes for 2 channels
+	  status = ao_out_write (ao, l_out, r_out, hop_syn);
+	  if (status != hop_syn) break; // the device failed
 	}
       else
 	{
@@ -201,7 +201,7 @@ void pv_freq (const char *file, const char *outfile,
   sf_close (sf);
   if (outfile == NULL)
     {
-      ao_close (ao);
+      ao_out_close (ao);
     }
   else
     {
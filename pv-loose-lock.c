@@ -84,12 +84,12 @@ void pv_loose_lock (const char *file, const char *outfile,
 
   // prepare the output
   int status;
-  ao_device *ao = NULL;
+  struct ao_out *ao = NULL;
   SNDFILE *sfout = NULL;
   SF_INFO sfout_info;
   if (outfile == NULL)
     {
-      ao = ao_init_16_stereo (sfinfo.samplerate, 1 /* verbose */);
+      ao = ao_out_open (sfinfo.samplerate, 1 /* verbose */);
     }
   else
     {
@@ -189,7 +189,7 @@ void pv_loose_lock (const char *file, const char *outfile,
 
 
   // read the first frame
-  read_status = sndfile_read (sf, sfinfo, left, right, len);
+  read_status = sndfile_read (sf, sfinfo, left, right, len, NULL);
   if (read_status != len)
     {
       exit (1);
@@ -225,8 +225,7 @@ void pv_loose_lock (const char *file, const char *outfile,
 	      // standard phase vocoder
 	      double dphi;
 	      dphi = ph_in [k] - l_ph_in_old [k] - omega [k] * (double)hop_ana;
-	      for (; dphi >= M_PI; dphi -= twopi);
-	      for (; dphi < -M_PI; dphi += twopi);
+	      dphi = principal_argument (dphi);
 
 	      ph_out [k] = l_ph_z [k]
 		+ dphi * (double)hop_syn / (double)hop_ana
@@ -280,8 +279,7 @@ void pv_loose_lock (const char *file, const char *outfile,
 	      // standard phase vocoder
 	      double dphi;
 	      dphi = ph_in [k] - r_ph_in_old [k] - omega [k] * (double)hop_ana;
-	      for (; dphi >= M_PI; dphi -= twopi);
-	      for (; dphi < -M_PI; dphi += twopi);
+	      dphi = principal_argument (dphi);
 
 	      ph_out [k] = r_ph_z [k]
 		+ dphi * (double)hop_syn / (double)hop_ana
@@ -337,7 +335,7 @@ void pv_loose_lock (const char *file, const char *outfile,
       read_status = sndfile_read (sf, sfinfo,
 				  left  + len - hop_ana,
 				  right + len - hop_ana,
-				  hop_ana);
+				  hop_ana, NULL);
       if (read_status != hop_ana)
 	{
 	  // most likely, it is EOF.
@@ -349,7 +347,7 @@ void pv_loose_lock (const char *file, const char *outfile,
   sf_close (sf);
   if (outfile == NULL)
     {
-      ao_close (ao);
+      ao_out_close (ao);
     }
   else
     {
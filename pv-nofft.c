@@ -21,11 +21,11 @@
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 #include "pv-complex.h" // struct pv_complex, pv_complex_play_resample()
-#include "fft.h"        // windowing()
+#include "fft.h"        // windowing(), windowing_f()
 
 // libsndfile
 #include <sndfile.h>
-#include "snd.h" // sndfile_read_at()
+#include "snd.h" // sndfile_open_for_write()
 
 // ao device
 #include <ao/ao.h>
@@ -49,43 +49,29 @@ long
 pv_nofft_play_step (struct pv_complex *pv,
 		    long cur)
 {
-  int n = 0;
-  static double *left  = NULL;
-  static double *right = NULL;
-  if (left == NULL)
-    {
-      left  = (double *)malloc (sizeof (double) * pv->len);
-      right = (double *)malloc (sizeof (double) * pv->len);
-      CHECK_MALLOC (left,  "read_and_FFT_stereo");
-      CHECK_MALLOC (right, "read_and_FFT_stereo");
-      n = pv->len;
-    }
-  else if (n < pv->len)
-    {
-      left  = (double *)realloc (left,  sizeof (double) * pv->len);
-      right = (double *)realloc (right, sizeof (double) * pv->len);
-      CHECK_MALLOC (left,  "read_and_FFT_stereo");
-      CHECK_MALLOC (right, "read_and_FFT_stereo");
-      n = pv->len;
-    }
+  pv_real *left  = pv->l_in;
+  pv_real *right = pv->r_in;
 
   // read [cur, cur+len] => left, right [len]
-  long status
-    = sndfile_read_at (pv->sf, *(pv->sfinfo), cur,
-		       left, right, pv->len);
+  long status = pv_complex_read (pv, cur);
   if (status != pv->len)
     {
       return 0; // no output
     }
 
+#ifdef WAON_FLOAT
+  windowing_f (pv->len, left,  pv->flag_window, pv->window_scale, left);
+  windowing_f (pv->len, right, pv->flag_window, pv->window_scale, right);
+#else // !WAON_FLOAT
   windowing (pv->len, left,  pv->flag_window, pv->window_scale, left);
   windowing (pv->len, right, pv->flag_window, pv->window_scale, right);
+#endif // WAON_FLOAT
   // left, right [len] ==> superimposing out[hop_syn, hop_syn + len]
   int i;
   for (i = 0; i < pv->len; i ++)
     {
-      pv->l_out[pv->hop_syn + i] += left[i];
-      pv->r_out[pv->hop_syn + i] += right[i];
+      pv->l_out[pv->hop_syn + i] += (double)left[i];
+      pv->r_out[pv->hop_syn + i] += (double)right[i];
     }
 
   /* output
@@ -97,16 +83,7 @@ pv_nofft_play_step (struct pv_complex *pv,
   /* shift
    * out[hop_syn, hop_syn + len] ==> out[0, len]
    */
-  for (i = 0; i < pv->len; i ++)
-    {
-      pv->l_out [i] = pv->l_out [i + pv->hop_syn];
-      pv->r_out [i] = pv->r_out [i + pv->hop_syn];
-    }
-  for (i = pv->len; i < pv->len + pv->hop_syn; i ++)
-    {
-      pv->l_out [i] = 0.0;
-      pv->r_out [i] = 0.0;
-    }
+  pv_complex_shift_out (pv);
 
   return (status);
 }
@@ -118,16 +95,19 @@ pv_nofft_play_step (struct pv_complex *pv,
  *              1 == loose phase lock is applied
  *  rate : time-streching rate
  *  pitch_shift : in the unit of half-note
+ *  src_type : converter of libsamplerate for the pitch shift
  */
 void pv_nofft (const char *file, const char *outfile,
 	       double rate, double pitch_shift,
 	       long len, long hop_syn,
-	       int flag_window)
+	       int flag_window,
+	       int src_type)
 {
   long hop_res = (long)((double)hop_syn * pow (2.0, - pitch_shift / 12.0));
   long hop_ana = (long)((double)hop_res * rate);
 
   struct pv_complex *pv = pv_complex_init (len, hop_syn, flag_window);
+  pv_complex_set_src_type (pv, src_type);
   pv->hop_res = hop_res;
   pv->hop_ana = hop_ana;
   //pv->pitch_shift = pitch_shift;
@@ -147,12 +127,12 @@ void pv_nofft (const char *file, const char *outfile,
   pv_complex_set_input (pv, sf, &sfinfo);
 
 
-  ao_device *ao = NULL;
+  struct ao_out *ao = NULL;
   SNDFILE *sfout = NULL;
   SF_INFO sfout_info;
   if (outfile == NULL)
     {
-      ao = ao_init_16_stereo (sfinfo.samplerate, 1 /* verbose */);
+      ao = ao_out_open (sfinfo.samplerate, 1 /* verbose */);
       pv_complex_set_output_ao (pv, ao);
     }
   else
@@ -178,10 +158,12 @@ void pv_nofft (const char *file, const char *outfile,
 	  break;
 	}
     }
+  // frames left in the converter
+  pv_complex_play_resample_flush (pv);
 
   if (outfile == NULL)
     {
-      ao_close (ao);
+      ao_out_close (ao);
     }
   else
     {
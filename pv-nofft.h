@@ -40,11 +40,13 @@ pv_nofft_play_step (struct pv_complex *pv,
  *              1 == loose phase lock is applied
  *  rate : time-streching rate
  *  pitch_shift : in the unit of half-note
+ *  src_type : converter of libsamplerate for the pitch shift
  */
 void pv_nofft (const char *file, const char *outfile,
 	       double rate, double pitch_shift,
 	       long len, long hop_syn,
-	       int flag_window);
+	       int flag_window,
+	       int src_type);
 
 
 #endif /* !_PV_NOFFT_H_ */
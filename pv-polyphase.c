@@ -0,0 +1,228 @@
+/* polyphase resampler for the rational ratio of the pitch shift
+ * Copyright (C) 2007-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> // memmove()
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+// FFTW library
+#include <fftw3.h> // fftw_malloc()
+
+#include "pv-polyphase.h"
+
+
+static long
+pv_polyphase_gcd (long a, long b)
+{
+  while (b != 0)
+    {
+      long r = a % b;
+      a = b;
+      b = r;
+    }
+  return (a);
+}
+
+/* make the filter pp->h[] for pp->up and pp->down.
+ * the output of the phase p is at (nhalf - 1 + p/up) from the first tap,
+ * where the cut-off is the lower nyquist frequency of the input and
+ * the output, and the sinc is windowed by blackman in [-nhalf, nhalf].
+ */
+static void
+pv_polyphase_make_filter (struct pv_polyphase *pp)
+{
+  int nhalf = pp->ntaps / 2;
+  double fc = 1.0;
+  if (pp->up < pp->down) fc = (double)pp->up / (double)pp->down;
+
+  if (pp->h != NULL) fftw_free (pp->h);
+  pp->h = (float *)fftw_malloc (sizeof (float) * pp->up * pp->ntaps);
+  CHECK_MALLOC (pp->h, "pv_polyphase_make_filter");
+
+  int p;
+  for (p = 0; p < pp->up; p ++)
+    {
+      float *h = pp->h + p * pp->ntaps;
+      double sum = 0.0;
+      int k;
+      for (k = 0; k < pp->ntaps; k ++)
+	{
+	  double d = (double)(k - (nhalf - 1))
+	    - (double)p / (double)pp->up;
+	  double s;
+	  if (d == 0.0)
+	    {
+	      s = 1.0;
+	    }
+	  else
+	    {
+	      s = sin (M_PI * fc * d) / (M_PI * fc * d);
+	    }
+	  double w = 0.0;
+	  if (fabs (d) < (double)nhalf)
+	    {
+	      w = 0.42
+		+ 0.5  * cos (M_PI * d / (double)nhalf)
+		+ 0.08 * cos (2.0 * M_PI * d / (double)nhalf);
+	    }
+	  h [k] = (float)(s * w);
+	  sum += s * w;
+	}
+      // normalize for the unit gain at DC in each phase
+      for (k = 0; k < pp->ntaps; k ++)
+	{
+	  h [k] = (float)((double)h [k] / sum);
+	}
+    }
+}
+
+struct pv_polyphase *
+pv_polyphase_init (long up, long down)
+{
+  struct pv_polyphase *pp
+    = (struct pv_polyphase *)malloc (sizeof (struct pv_polyphase));
+  CHECK_MALLOC (pp, "pv_polyphase_init");
+
+  long g = pv_polyphase_gcd (up, down);
+  pp->up   = (int)(up / g);
+  pp->down = (int)(down / g);
+  pp->ntaps = 2 * PV_POLYPHASE_HALF;
+  pp->h = NULL;
+  pv_polyphase_make_filter (pp);
+
+  pp->nbuf = 0;
+  pp->l_x = NULL;
+  pp->r_x = NULL;
+  pv_polyphase_reset (pp);
+
+  return (pp);
+}
+
+void
+pv_polyphase_free (struct pv_polyphase *pp)
+{
+  if (pp == NULL) return;
+
+  if (pp->h != NULL) fftw_free (pp->h);
+  if (pp->l_x != NULL) free (pp->l_x);
+  if (pp->r_x != NULL) free (pp->r_x);
+  free (pp);
+}
+
+void
+pv_polyphase_set_ratio (struct pv_polyphase *pp, long up, long down)
+{
+  long g = pv_polyphase_gcd (up, down);
+  up   /= g;
+  down /= g;
+  if (up == pp->up && down == pp->down) return;
+
+  // the position is kept within 1/up sample
+  pp->t = pp->t * up / pp->up;
+  pp->up   = (int)up;
+  pp->down = (int)down;
+  pv_polyphase_make_filter (pp);
+}
+
+/* pp->[lr]_x[] for n samples */
+static void
+pv_polyphase_alloc (struct pv_polyphase *pp, long n)
+{
+  if (pp->nbuf >= n) return;
+
+  pp->l_x = (float *)realloc (pp->l_x, sizeof (float) * n);
+  pp->r_x = (float *)realloc (pp->r_x, sizeof (float) * n);
+  CHECK_MALLOC (pp->l_x, "pv_polyphase_alloc");
+  CHECK_MALLOC (pp->r_x, "pv_polyphase_alloc");
+  pp->nbuf = n;
+}
+
+void
+pv_polyphase_reset (struct pv_polyphase *pp)
+{
+  pv_polyphase_alloc (pp, pp->ntaps - 1);
+  long i;
+  for (i = 0; i < pp->ntaps - 1; i ++)
+    {
+      pp->l_x [i] = 0.0;
+      pp->r_x [i] = 0.0;
+    }
+  pp->nx = pp->ntaps - 1;
+  // the first output is at the first input (after the zeros),
+  // where the outputs before it (the delay of the filter) are discarded
+  pp->t = (long)PV_POLYPHASE_HALF * pp->up;
+}
+
+long
+pv_polyphase_process (struct pv_polyphase *pp,
+		      const double *l_in, const double *r_in, long n,
+		      double *l_out, double *r_out, long nmax)
+{
+  pv_polyphase_alloc (pp, pp->nx + n);
+  long i;
+  for (i = 0; i < n; i ++)
+    {
+      pp->l_x [pp->nx + i] = (l_in == NULL ? 0.0 : (float)l_in [i]);
+      pp->r_x [pp->nx + i] = (r_in == NULL ? 0.0 : (float)r_in [i]);
+    }
+  pp->nx += n;
+
+  long o;
+  for (o = 0; o < nmax; o ++)
+    {
+      long i0 = pp->t / pp->up;
+      if (i0 + pp->ntaps > pp->nx) break;
+
+      const float *h  = pp->h + (pp->t % pp->up) * pp->ntaps;
+      const float *xl = pp->l_x + i0;
+      const float *xr = pp->r_x + i0;
+      // four sums for the SIMD (ntaps is a multiple of 4)
+      float l0 = 0.0, l1 = 0.0, l2 = 0.0, l3 = 0.0;
+      float r0 = 0.0, r1 = 0.0, r2 = 0.0, r3 = 0.0;
+      int k;
+      for (k = 0; k < pp->ntaps; k += 4)
+	{
+	  l0 += h [k+0] * xl [k+0];
+	  l1 += h [k+1] * xl [k+1];
+	  l2 += h [k+2] * xl [k+2];
+	  l3 += h [k+3] * xl [k+3];
+	  r0 += h [k+0] * xr [k+0];
+	  r1 += h [k+1] * xr [k+1];
+	  r2 += h [k+2] * xr [k+2];
+	  r3 += h [k+3] * xr [k+3];
+	}
+      l_out [o] = (double)((l0 + l1) + (l2 + l3));
+      r_out [o] = (double)((r0 + r1) + (r2 + r3));
+
+      pp->t += pp->down;
+    }
+
+  // discard the input before the next output
+  long d = pp->t / pp->up;
+  if (d > pp->nx) d = pp->nx;
+  if (d > 0)
+    {
+      memmove (pp->l_x, pp->l_x + d, sizeof (float) * (pp->nx - d));
+      memmove (pp->r_x, pp->r_x + d, sizeof (float) * (pp->nx - d));
+      pp->nx -= d;
+      pp->t -= d * pp->up;
+    }
+
+  return (o);
+}
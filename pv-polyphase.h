@@ -0,0 +1,89 @@
+/* header file for pv-polyphase.c --
+ * polyphase resampler for the rational ratio of the pitch shift
+ * Copyright (C) 2007-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#ifndef	_PV_POLYPHASE_H_
+#define	_PV_POLYPHASE_H_
+
+
+/* half length of the filter in the input samples,
+ * so that each phase has 2 * PV_POLYPHASE_HALF taps (a multiple of 4) */
+#define PV_POLYPHASE_HALF (16)
+
+/* resampler by the ratio up/down (hop_res/hop_syn), whose output k is
+ * the input at k * down / up filtered by the windowed sinc.
+ * the filter of each phase (k * down mod up) is made in advance,
+ * so that an output is a dot product of ntaps input samples.
+ */
+struct pv_polyphase {
+  int up;    // L
+  int down;  // M
+  int ntaps; // taps for one phase (= 2 * PV_POLYPHASE_HALF)
+  float *h;  // [up * ntaps] filter of the phase p at h + p * ntaps
+             // (by fftw_malloc() for the alignment of SIMD)
+
+  /* input buffers, where the first (ntaps - 1) samples are
+   * carried over from the last call (zero at the start) */
+  long nbuf;  // allocated length
+  long nx;    // samples in the buffers
+  float *l_x;
+  float *r_x;
+  long t;     // position of the next output in the unit of 1/up sample
+};
+
+
+/* initialize for the ratio up/down
+ * INPUT
+ *  up, down : positive, which are reduced by the common divisor
+ */
+struct pv_polyphase *
+pv_polyphase_init (long up, long down);
+
+void
+pv_polyphase_free (struct pv_polyphase *pp);
+
+/* change the ratio, where the filter is made again (unless the same)
+ * and the input in the buffer is kept
+ */
+void
+pv_polyphase_set_ratio (struct pv_polyphase *pp, long up, long down);
+
+/* clear the input buffer as at the start
+ * (the delay of the filter is discarded again at the next output) */
+void
+pv_polyphase_reset (struct pv_polyphase *pp);
+
+/* resample n input samples, where the output is aligned to the input.
+ * the first call after the reset gives (PV_POLYPHASE_HALF * up / down)
+ * samples less, as the filter waits for PV_POLYPHASE_HALF input samples
+ * ahead (given by the input of NULL at the end); afterwards the output
+ * is exactly (n * up / down) if n is a multiple of down (such as hop_syn).
+ * INPUT
+ *  l_in [n], r_in [n] : input (NULL == zeros)
+ *  nmax : size of the output buffers
+ * OUTPUT
+ *  l_out [nmax], r_out [nmax] :
+ *  returned value : number of output samples
+ *                   (up to nmax, where the rest waits for the next call)
+ */
+long
+pv_polyphase_process (struct pv_polyphase *pp,
+		      const double *l_in, const double *r_in, long n,
+		      double *l_out, double *r_out, long nmax);
+
+
+#endif /* !_PV_POLYPHASE_H_ */
@@ -0,0 +1,325 @@
+/* playback of the phase vocoder rendered ahead in the background
+ * Copyright (C) 2007-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <ao/ao.h>
+#include "ao-wrapper.h" // ao_out_write()
+#include "pv-complex.h" // struct pv_complex, pv_complex_play_step()
+#include "memory-check.h" // CHECK_MALLOC
+
+#include "pv-prefetch.h"
+
+
+/* output of pv into the ring, called by the step in the producer
+ * (under pp->lock), where the frames are discarded in the pause
+ * OUTPUT
+ *  returned value : n, so that the step is not taken as the end
+ */
+static int
+pv_prefetch_output (void *data, const double *l, const double *r, int n)
+{
+  struct pv_prefetch *pp = (struct pv_prefetch *)data;
+
+  pthread_mutex_lock (&pp->ring_lock);
+  if (pp->flag_play != 0)
+    {
+      // the space is checked before the step (unless hop_res is grown)
+      long m = pp->nring - pp->ring_n;
+      if (m > n) m = n;
+      long w = (pp->ring_r + pp->ring_n) % pp->nring;
+      long i;
+      for (i = 0; i < m; i ++)
+	{
+	  pp->l_ring [w] = l [i];
+	  pp->r_ring [w] = r [i];
+	  w ++;
+	  if (w == pp->nring) w = 0;
+	}
+      pp->ring_n += m;
+      pthread_cond_broadcast (&pp->ring_cond);
+    }
+  pthread_mutex_unlock (&pp->ring_lock);
+
+  return (n);
+}
+
+/* play one step at pp->play_cur in the loop range (under pp->lock)
+ * as play_100msec() did for each step
+ */
+static void
+pv_prefetch_step (struct pv_prefetch *pp)
+{
+  struct pv_complex *pv = pp->pv;
+  long cur = pp->play_cur;
+
+  if (cur <  pp->frame0) cur = pp->frame0;
+  if (cur >= pp->frame1) cur = pp->frame1;
+
+  long len_play = pp->play_step (pv, cur);
+  if (len_play < pv->hop_res)
+    {
+      // end of file
+      // rewind
+      if (pv->hop_ana >= 0.0) cur = pp->frame0;
+      else                    cur = pp->frame1;
+    }
+
+  // increment play_cur
+  cur += pv->hop_ana;
+
+  // check the boundary
+  if (cur < pp->frame0 ||
+      cur + pv->hop_ana >= pp->frame1)
+    {
+      // rewind
+      if (pv->hop_ana >= 0.0) cur = pp->frame0;
+      else                    cur = pp->frame1;
+    }
+  pp->play_cur = cur;
+}
+
+/* producer thread, which runs the steps while the ring has the space
+ * for one step (pv->hop_res frames)
+ */
+static void *
+pv_prefetch_producer (void *arg)
+{
+  struct pv_prefetch *pp = (struct pv_prefetch *)arg;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&pp->lock);
+      long need = pp->pv->hop_res;
+      pthread_mutex_unlock (&pp->lock);
+      if (need > pp->nring) need = pp->nring;
+
+      pthread_mutex_lock (&pp->ring_lock);
+      while (pp->flag_exit == 0
+	     && (pp->flag_play == 0 || pp->nring - pp->ring_n < need))
+	{
+	  pthread_cond_wait (&pp->ring_cond, &pp->ring_lock);
+	}
+      int flag_exit = pp->flag_exit;
+      pthread_mutex_unlock (&pp->ring_lock);
+      if (flag_exit != 0) break;
+
+      pthread_mutex_lock (&pp->lock);
+      pv_prefetch_step (pp);
+      pthread_mutex_unlock (&pp->lock);
+    }
+
+  return (NULL);
+}
+
+/* writer thread, which plays the ring into the ao device
+ * by PV_PREFETCH_CHUNK frames
+ */
+static void *
+pv_prefetch_writer (void *arg)
+{
+  struct pv_prefetch *pp = (struct pv_prefetch *)arg;
+
+  for (;;)
+    {
+      pthread_mutex_lock (&pp->ring_lock);
+      while (pp->flag_exit == 0 && pp->ring_n == 0)
+	{
+	  pthread_cond_wait (&pp->ring_cond, &pp->ring_lock);
+	}
+      if (pp->flag_exit != 0)
+	{
+	  pthread_mutex_unlock (&pp->ring_lock);
+	  break;
+	}
+
+      long n = pp->ring_n;
+      if (n > PV_PREFETCH_CHUNK) n = PV_PREFETCH_CHUNK;
+      long i;
+      for (i = 0; i < n; i ++)
+	{
+	  pp->l_chunk [i] = pp->l_ring [pp->ring_r];
+	  pp->r_chunk [i] = pp->r_ring [pp->ring_r];
+	  pp->ring_r ++;
+	  if (pp->ring_r == pp->nring) pp->ring_r = 0;
+	}
+      pp->ring_n -= n;
+      pthread_cond_broadcast (&pp->ring_cond);
+      pthread_mutex_unlock (&pp->ring_lock);
+
+      // the device blocks here, out of the locks
+      ao_out_write (pp->ao, pp->l_chunk, pp->r_chunk, (int)n);
+    }
+
+  return (NULL);
+}
+
+struct pv_prefetch *
+pv_prefetch_init (struct pv_complex *pv, struct ao_out *ao, double msec)
+{
+  struct pv_prefetch *pp
+    = (struct pv_prefetch *)malloc (sizeof (struct pv_prefetch));
+  CHECK_MALLOC (pp, "pv_prefetch_init");
+
+  pp->pv = pv;
+  pp->ao = ao;
+  pp->play_step = pv_complex_play_step;
+
+  pp->frame0 = 0;
+  pp->frame1 = (long)pv->sfinfo->frames - 1;
+  pp->play_cur = 0;
+
+  pp->nring = (long)(msec / 1000.0 * (double)pv->sfinfo->samplerate);
+  if (pp->nring < 2 * PV_PREFETCH_CHUNK) pp->nring = 2 * PV_PREFETCH_CHUNK;
+  pp->l_ring = (double *)malloc (sizeof (double) * pp->nring);
+  pp->r_ring = (double *)malloc (sizeof (double) * pp->nring);
+  CHECK_MALLOC (pp->l_ring, "pv_prefetch_init");
+  CHECK_MALLOC (pp->r_ring, "pv_prefetch_init");
+  pp->ring_r = 0;
+  pp->ring_n = 0;
+  pp->flag_play = 0;
+  pp->flag_exit = 0;
+
+  pp->l_chunk = (double *)malloc (sizeof (double) * PV_PREFETCH_CHUNK);
+  pp->r_chunk = (double *)malloc (sizeof (double) * PV_PREFETCH_CHUNK);
+  CHECK_MALLOC (pp->l_chunk, "pv_prefetch_init");
+  CHECK_MALLOC (pp->r_chunk, "pv_prefetch_init");
+
+  pthread_mutex_init (&pp->lock, NULL);
+  pthread_mutex_init (&pp->ring_lock, NULL);
+  pthread_cond_init (&pp->ring_cond, NULL);
+
+  pv_complex_set_output_func (pv, pv_prefetch_output, pp);
+
+  if (pthread_create (&pp->producer, NULL, pv_prefetch_producer, pp) != 0
+      || pthread_create (&pp->writer, NULL, pv_prefetch_writer, pp) != 0)
+    {
+      fprintf (stderr, "cannot create the playback threads\n");
+      exit (1);
+    }
+
+  return (pp);
+}
+
+void
+pv_prefetch_free (struct pv_prefetch *pp)
+{
+  if (pp == NULL) return;
+
+  pthread_mutex_lock (&pp->ring_lock);
+  pp->flag_exit = 1;
+  pthread_cond_broadcast (&pp->ring_cond);
+  pthread_mutex_unlock (&pp->ring_lock);
+
+  pthread_join (pp->producer, NULL);
+  pthread_join (pp->writer, NULL);
+
+  pthread_cond_destroy (&pp->ring_cond);
+  pthread_mutex_destroy (&pp->ring_lock);
+  pthread_mutex_destroy (&pp->lock);
+
+  free (pp->l_ring);
+  free (pp->r_ring);
+  free (pp->l_chunk);
+  free (pp->r_chunk);
+  free (pp);
+}
+
+void
+pv_prefetch_lock (struct pv_prefetch *pp)
+{
+  pthread_mutex_lock (&pp->lock);
+}
+
+void
+pv_prefetch_unlock (struct pv_prefetch *pp)
+{
+  pthread_mutex_unlock (&pp->lock);
+}
+
+void
+pv_prefetch_set_rate_pitch (struct pv_prefetch *pp,
+			    double rate, double pitch)
+{
+  pthread_mutex_lock (&pp->lock);
+  pv_complex_change_rate_pitch (pp->pv, rate, pitch);
+  pthread_mutex_unlock (&pp->lock);
+
+  // the producer may wait for the space of the former hop_res
+  pthread_mutex_lock (&pp->ring_lock);
+  pthread_cond_broadcast (&pp->ring_cond);
+  pthread_mutex_unlock (&pp->ring_lock);
+}
+
+void
+pv_prefetch_set_range (struct pv_prefetch *pp, long frame0, long frame1)
+{
+  pthread_mutex_lock (&pp->lock);
+  pp->frame0 = frame0;
+  pp->frame1 = frame1;
+  pthread_mutex_unlock (&pp->lock);
+}
+
+/* pp->play_cur less the frames in the ring and those queued in ao
+ * (under both locks)
+ */
+static long
+pv_prefetch_heard (struct pv_prefetch *pp)
+{
+  struct pv_complex *pv = pp->pv;
+  long cur = pp->play_cur;
+  if (pv->hop_res > 0)
+    {
+      long n = pp->ring_n + ao_out_get_queued (pp->ao);
+      cur -= (long)((double)n
+		    * (double)pv->hop_ana / (double)pv->hop_res);
+    }
+  // the ring may be across the rewind
+  if (cur < pp->frame0) cur = pp->frame0;
+  if (cur > pp->frame1) cur = pp->frame1;
+  return (cur);
+}
+
+void
+pv_prefetch_play (struct pv_prefetch *pp, int flag_play)
+{
+  pthread_mutex_lock (&pp->lock);
+  pthread_mutex_lock (&pp->ring_lock);
+  if (pp->flag_play != 0 && flag_play == 0)
+    {
+      // resume from the frame heard last
+      pp->play_cur = pv_prefetch_heard (pp);
+      pp->ring_n = 0;
+    }
+  pp->flag_play = flag_play;
+  pthread_cond_broadcast (&pp->ring_cond);
+  pthread_mutex_unlock (&pp->ring_lock);
+  pthread_mutex_unlock (&pp->lock);
+}
+
+long
+pv_prefetch_get_cur (struct pv_prefetch *pp)
+{
+  pthread_mutex_lock (&pp->lock);
+  pthread_mutex_lock (&pp->ring_lock);
+  long cur = pv_prefetch_heard (pp);
+  pthread_mutex_unlock (&pp->ring_lock);
+  pthread_mutex_unlock (&pp->lock);
+  return (cur);
+}
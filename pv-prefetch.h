@@ -0,0 +1,112 @@
+/* header file for pv-prefetch.c --
+ * playback of the phase vocoder rendered ahead in the background
+ * Copyright (C) 2007-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+#ifndef	_PV_PREFETCH_H_
+#define	_PV_PREFETCH_H_
+
+
+#include <pthread.h> // pthread_t, pthread_mutex_t, pthread_cond_t
+#include "ao-wrapper.h" // struct ao_out
+#include "pv-complex.h" // struct pv_complex
+
+/* frames given to ao_out_write() at once by the writer thread */
+#define PV_PREFETCH_CHUNK (1024)
+
+/* the producer thread runs the steps of the phase vocoder ahead of
+ * the playback into the ring buffer, and the writer thread plays the
+ * ring into the ao device, so that neither the redraw of the UI nor
+ * a slow read of the file stalls the audio.
+ * the UI thread changes pv only under pv_prefetch_lock()
+ * (or by pv_prefetch_set_rate_pitch()), which waits for one step
+ * at most.
+ */
+struct pv_prefetch {
+  struct pv_complex *pv;
+  struct ao_out *ao;
+
+  // step function (pv_complex_play_step() for default)
+  long (*play_step) (struct pv_complex *pv, long cur);
+
+  pthread_t producer;
+  pthread_t writer;
+  pthread_mutex_t lock; // for pv and the parameters below (by the producer)
+  long frame0; // loop range
+  long frame1;
+  volatile long play_cur; // next frame to analyse (by the producer)
+
+  // ring buffer of the output
+  pthread_mutex_t ring_lock; // for the ring and the state below
+  pthread_cond_t ring_cond;  // signalled on any change of them
+  long nring;   // size of the ring in frames
+  double *l_ring;
+  double *r_ring;
+  long ring_r;  // position to read (by the writer)
+  long ring_n;  // number of frames in the ring
+  int flag_play; // 0 == pause, 1 == play
+  int flag_exit; // 1 == stop the threads
+
+  double *l_chunk; // [PV_PREFETCH_CHUNK] for the writer
+  double *r_chunk;
+};
+
+
+/* start the producer and the writer threads (in pause)
+ * INPUT
+ *  pv   : the output is set to the ring (pv_complex_set_output_func())
+ *  ao   : device to play
+ *  msec : length of the ring buffer, that is, how far ahead to render
+ */
+struct pv_prefetch *
+pv_prefetch_init (struct pv_complex *pv, struct ao_out *ao, double msec);
+
+/* stop the threads (pv and ao are not closed) */
+void
+pv_prefetch_free (struct pv_prefetch *pp);
+
+/* lock (unlock) pv against the producer to change its parameters */
+void
+pv_prefetch_lock (struct pv_prefetch *pp);
+void
+pv_prefetch_unlock (struct pv_prefetch *pp);
+
+/* change rate and pitch by pv_complex_change_rate_pitch()
+ * between the steps of the producer
+ */
+void
+pv_prefetch_set_rate_pitch (struct pv_prefetch *pp,
+			    double rate, double pitch);
+
+/* set the loop range of the playback */
+void
+pv_prefetch_set_range (struct pv_prefetch *pp, long frame0, long frame1);
+
+/* play (flag_play = 1) or pause (0),
+ * where the frames rendered ahead are discarded by the pause
+ * and the playback resumes from the frame heard last.
+ */
+void
+pv_prefetch_play (struct pv_prefetch *pp, int flag_play);
+
+/* frame of the input heard now, that is, pp->play_cur less the frames
+ * waiting in the ring (scaled by the rate)
+ */
+long
+pv_prefetch_get_cur (struct pv_prefetch *pp);
+
+
+#endif /* !_PV_PREFETCH_H_ */
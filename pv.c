@@ -22,6 +22,7 @@
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 
+#include "ao-wrapper.h" // ao_out_set_format()
 #include "pv-complex.h"
 #include "pv-conventional.h"
 #include "pv-ellis.h"
@@ -29,8 +30,10 @@
 #include "pv-loose-lock.h"
 #include "pv-complex-curses.h"
 
-// experimental
-//#include "jack-pv.h"
+// experimental (define ENABLE_JACK to build with jack-pv.o)
+#ifdef ENABLE_JACK
+#include "jack-pv.h"
+#endif // ENABLE_JACK
 #include "pv-nofft.h"
 
 #include "VERSION.h"
@@ -60,6 +63,12 @@ void print_pv_usage (char * argv0)
   fprintf (stdout, "  -i, --input\tinput file (default: stdin)\n");
   fprintf (stdout, "  -o, --output\toutput file in flac"
 	   " (default: play audio by ao)\n");
+  fprintf (stdout, "  -bits      \tbits per sample to play by ao; 16, 24 or 32."
+	   "\n\t\t16 is taken if the driver does not support it."
+	   " (default: 16)\n");
+  fprintf (stdout, "  -nbuf      \tnumber of buffers played by ao"
+	   " in the background,\n"
+	   "\t\twhere 0 plays in the vocoder loop. (default: 3)\n");
   fprintf (stdout, "FFT OPTIONS\n");
   fprintf (stdout, "  -n         \tFFT data number (default: 2048)\n");
   fprintf (stdout, "  -w --window\t0 no window\n");
@@ -75,6 +84,20 @@ void print_pv_usage (char * argv0)
 	   " (default: 1.0)\n");
   fprintf (stdout, "  -pitch\tpitch shift. +1/-1 is half-note up/down"
 	   " (default: 0)\n");
+  fprintf (stdout, "  -silence\tpeak amplitude at or below which"
+	   " the input is regarded as silence\n"
+	   "\t\tand skipped without FFT, for the schemes 2 and 4."
+	   " (default: 0)\n");
+  fprintf (stdout, "  -src       \tconverter of libsamplerate for the pitch"
+	   " shift\n"
+	   "\t\tfor the schemes 0, 2, 4, 7, 8 and 9\n");
+  fprintf (stdout, "\t\t0 : best quality sinc\n");
+  fprintf (stdout, "\t\t1 : medium quality sinc\n");
+  fprintf (stdout, "\t\t2 : fastest sinc (default)\n");
+  fprintf (stdout, "\t\t3 : zero order hold\n");
+  fprintf (stdout, "\t\t4 : linear\n");
+  fprintf (stdout, "\t\t5 : built-in polyphase filter"
+	   " for the ratio of the hops\n");
   fprintf (stdout, "  -scheme    \tgive the number for PV scheme\n");
   fprintf (stdout, "\t\t1 : conventional PV\n");
   fprintf (stdout, "\t\t2 : PV by complex arithmetics with fixed hops\n");
@@ -85,12 +108,19 @@ void print_pv_usage (char * argv0)
   fprintf (stdout, "\t\t6 : PV in freq. domain\n");
   fprintf (stdout, "\t\t7 : plain superimpose (no-FFT)\n");
   fprintf (stdout, "\t\t0 : interactive PV with curses (default)\n");
+#ifdef ENABLE_JACK
+  fprintf (stdout, "\t\t8 : interactive PV with curses on JACK\n");
+  fprintf (stdout, "\t\t9 : pitch-shifter of the live input on JACK"
+	   " (no -i option)\n"
+	   "\t\t    with the latency of (len + hop) plus one period\n");
+#endif // ENABLE_JACK
   fprintf (stdout, "KEY BINDINGS IN CURSES MODE (with -scheme 0, the default)\n"
 	   "\tSPACE        : play / stop\n"
 	   "\t< >          : set loop range\n"
 	   "\t[{ }]        : expand the loop range\n"
 	   "\tL l          : phase-lock on / off\n"
 	   "\tW w          : change window\n"
+	   "\tF f          : fft-length up / down (len/8 to len*8)\n"
 	   "\tH h          : hop-size up / down\n"
 	   "\tUP / DOWN    : pitch up / down\n"
 	   "\tLEFT / RIGHT : pitch up / down\n"
@@ -113,6 +143,10 @@ int main (int argc, char** argv)
   double pitch_shift = 0.0;
   int scheme = 0;
   int flag_window = 3; // hanning window
+  double silence = 0.0; // digital silence only
+  int bits = AO_OUT_BITS;
+  int nbuf = AO_OUT_NBUF;
+  int src_type = SRC_SINC_FASTEST;
 
   int i;
   for (i = 1; i < argc; i++)
@@ -167,6 +201,34 @@ int main (int argc, char** argv)
 	      pitch_shift = atof (argv [++i]);
 	    }
 	}
+      else if (strcmp (argv[i], "-silence" ) == 0)
+	{
+	  if (i+1 < argc)
+	    {
+	      silence = atof (argv [++i]);
+	    }
+	}
+      else if (strcmp (argv[i], "-bits" ) == 0)
+	{
+	  if (i+1 < argc)
+	    {
+	      bits = atoi (argv [++i]);
+	    }
+	}
+      else if (strcmp (argv[i], "-nbuf" ) == 0)
+	{
+	  if (i+1 < argc)
+	    {
+	      nbuf = atoi (argv [++i]);
+	    }
+	}
+      else if (strcmp (argv[i], "-src" ) == 0)
+	{
+	  if (i+1 < argc)
+	    {
+	      src_type = atoi (argv [++i]);
+	    }
+	}
       else if (strcmp (argv[i], "-scheme" ) == 0)
 	{
 	  if (i+1 < argc)
@@ -195,17 +257,23 @@ int main (int argc, char** argv)
 	}
     }
 
-  if (file_in == NULL)
+  if (file_in == NULL
+#ifdef ENABLE_JACK
+      && scheme != 9 // live input
+#endif // ENABLE_JACK
+      )
     {
       print_pv_usage (argv [0]);
       exit (1);
     }
 
+  // format of the ao device opened by the schemes
+  ao_out_set_format (bits, nbuf);
 
   switch (scheme)
     {
     case 0:
-      pv_complex_curses (file_in, len, hop);
+      pv_complex_curses (file_in, len, hop, src_type);
       break;
 
     case 1:
@@ -216,8 +284,8 @@ int main (int argc, char** argv)
     case 2:
       pv_complex (file_in, file_out, rate, pitch_shift,
 		  len, hop, flag_window,
-		  0 /* no phase lock */
-		  );
+		  0 /* no phase lock */,
+		  silence, src_type);
       break;
 
     case 3:
@@ -228,8 +296,8 @@ int main (int argc, char** argv)
     case 4:
       pv_complex (file_in, file_out, rate, pitch_shift,
 		  len, hop, flag_window,
-		  1 /* loose phase lock */
-		  );
+		  1 /* loose phase lock */,
+		  silence, src_type);
       break;
 
     case 5:
@@ -248,13 +316,18 @@ int main (int argc, char** argv)
 
     case 7:
       pv_nofft (file_in, file_out, rate, pitch_shift,
-		len, hop, flag_window);
+		len, hop, flag_window, src_type);
       break;
-      /*
+#ifdef ENABLE_JACK
     case 8:
-      pv_complex_curses_jack (file_in, len, hop);
+      pv_complex_curses_jack (file_in, len, hop, src_type);
+      break;
+
+    case 9:
+      pv_complex_curses_jack (NULL /* live input */, len, hop,
+			      src_type);
       break;
-      */
+#endif // ENABLE_JACK
 
     default:
       fprintf (stderr, "invalid scheme number\n");
@@ -22,26 +22,18 @@
 #include "memory-check.h" // CHECK_MALLOC() macro
 
 
+/* read len frames into left[] and right[] (right[] is not used for mono)
+ * INPUT
+ *  buf[len * sfinfo.channels] : work area for the interleaved data
+ *                               (NULL to allocate it in the call)
+ * OUTPUT
+ *  returned value : frames read
+ */
 long sndfile_read (SNDFILE *sf, SF_INFO sfinfo,
 		   double * left, double * right,
-		   int len)
+		   int len,
+		   double * buf)
 {
-  static double *buf = NULL;
-  static int nbuf = 0;
-
-  if (buf == NULL)
-    {
-      buf = (double *)malloc (sizeof (double) * len * sfinfo.channels);
-      CHECK_MALLOC (buf, "sndfile_read");
-      nbuf = len * sfinfo.channels;
-    }
-  if (len * sfinfo.channels > nbuf)
-    {
-      buf = (double *)realloc (buf, sizeof (double) * len * sfinfo.channels);
-      CHECK_MALLOC (buf, "sndfile_read");
-      nbuf = len * sfinfo.channels;
-    }
-
   sf_count_t status;
 
   if (sfinfo.channels == 1)
@@ -50,13 +42,20 @@ long sndfile_read (SNDFILE *sf, SF_INFO sfinfo,
     }
   else
     {
-      status = sf_readf_double (sf, buf, (sf_count_t)len);
+      double *tmp = buf;
+      if (tmp == NULL)
+	{
+	  tmp = (double *)malloc (sizeof (double) * len * sfinfo.channels);
+	  CHECK_MALLOC (tmp, "sndfile_read");
+	}
+      status = sf_readf_double (sf, tmp, (sf_count_t)len);
       int i;
-      for (i = 0; i < len; i ++)
+      for (i = 0; i < status; i ++)
 	{
-	  left  [i] = buf [i * sfinfo.channels];
-	  right [i] = buf [i * sfinfo.channels + 1];
+	  left  [i] = tmp [i * sfinfo.channels];
+	  right [i] = tmp [i * sfinfo.channels + 1];
 	}
+      if (buf == NULL) free (tmp);
     }
 
   return ((long) status);
@@ -65,7 +64,8 @@ long sndfile_read (SNDFILE *sf, SF_INFO sfinfo,
 long sndfile_read_at (SNDFILE *sf, SF_INFO sfinfo,
 		      long start,
 		      double * left, double * right,
-		      int len)
+		      int len,
+		      double * buf)
 {
   sf_count_t status;
 
@@ -81,7 +81,125 @@ long sndfile_read_at (SNDFILE *sf, SF_INFO sfinfo,
       exit (1);
     }
 
-  return (sndfile_read (sf, sfinfo, left, right, len));
+  return (sndfile_read (sf, sfinfo, left, right, len, buf));
+}
+
+/* single-precision version of sndfile_read()
+ * INPUT
+ *  buf[len * sfinfo.channels] : work area for the interleaved data
+ *                               (NULL to allocate it in the call)
+ */
+long sndfile_read_f (SNDFILE *sf, SF_INFO sfinfo,
+		     float * left, float * right,
+		     int len,
+		     float * buf)
+{
+  sf_count_t status;
+
+  if (sfinfo.channels == 1)
+    {
+      status = sf_readf_float (sf, left, (sf_count_t)len);
+    }
+  else
+    {
+      float *tmp = buf;
+      if (tmp == NULL)
+	{
+	  tmp = (float *)malloc (sizeof (float) * len * sfinfo.channels);
+	  CHECK_MALLOC (tmp, "sndfile_read_f");
+	}
+      status = sf_readf_float (sf, tmp, (sf_count_t)len);
+      int i;
+      for (i = 0; i < status; i ++)
+	{
+	  left  [i] = tmp [i * sfinfo.channels];
+	  right [i] = tmp [i * sfinfo.channels + 1];
+	}
+      if (buf == NULL) free (tmp);
+    }
+
+  return ((long) status);
+}
+
+/* single-precision version of sndfile_read_at()
+ */
+long sndfile_read_at_f (SNDFILE *sf, SF_INFO sfinfo,
+			long start,
+			float * left, float * right,
+			int len,
+			float * buf)
+{
+  // check the range
+  if (start < 0) return 0;
+  else if (start >= sfinfo.frames) return 0;
+
+  // seek the point start
+  if (sf_seek  (sf, (sf_count_t)start, SEEK_SET) == -1)
+    {
+      fprintf (stderr, "seek error\n");
+      exit (1);
+    }
+
+  return (sndfile_read_f (sf, sfinfo, left, right, len, buf));
+}
+
+/* read len frames from start, mix down the channels and multiply
+ * the window, directly from the interleaved data of libsndfile.
+ * INPUT
+ *  window[len] : window function (NULL for no window)
+ *  buf[len * sfinfo.channels] : work area for the interleaved data
+ *                               (NULL to allocate it in the call)
+ * OUTPUT
+ *  out[len] : average of the channels times window[],
+ *             where the frames beyond the end of the file are zero.
+ *  returned value : frames read
+ */
+long sndfile_read_mix_at (SNDFILE *sf, SF_INFO sfinfo,
+			  long start,
+			  const double * window,
+			  double * out,
+			  int len,
+			  double * buf)
+{
+  double *tmp = buf;
+  if (tmp == NULL)
+    {
+      tmp = (double *)malloc (sizeof (double) * len * sfinfo.channels);
+      CHECK_MALLOC (tmp, "sndfile_read_mix_at");
+    }
+
+  sf_count_t status = 0;
+  if (start >= 0 && start < sfinfo.frames)
+    {
+      if (sf_seek  (sf, (sf_count_t)start, SEEK_SET) == -1)
+	{
+	  fprintf (stderr, "seek error\n");
+	  exit (1);
+	}
+      status = sf_readf_double (sf, tmp, (sf_count_t)len);
+      if (status < 0) status = 0;
+    }
+
+  int i, j;
+  int ch = sfinfo.channels;
+  double fac = 1.0 / (double)ch;
+  for (i = 0; i < status; i ++)
+    {
+      double x = 0.0;
+      for (j = 0; j < ch; j ++)
+	{
+	  x += tmp [i * ch + j];
+	}
+      if (window != NULL) x *= window [i];
+      out [i] = x * fac;
+    }
+  for (; i < len; i ++)
+    {
+      out [i] = 0.0;
+    }
+  if (buf == NULL) free (tmp);
+
+  return ((long) status);
 }
 
 
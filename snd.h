@@ -20,14 +20,56 @@
 #define	_SND_H_
 
 
+/* read len frames into left[] and right[] (right[] is not used for mono)
+ * INPUT
+ *  buf[len * sfinfo.channels] : work area for the interleaved data
+ *                               (NULL to allocate it in the call)
+ * OUTPUT
+ *  returned value : frames read
+ */
 long sndfile_read (SNDFILE *sf, SF_INFO sfinfo,
 		   double * left, double * right,
-		   int len);
+		   int len,
+		   double * buf);
 
+/* sndfile_read() from the frame start
+ */
 long sndfile_read_at (SNDFILE *sf, SF_INFO sfinfo,
 		      long start,
 		      double * left, double * right,
-		      int len);
+		      int len,
+		      double * buf);
+
+/* single-precision versions of sndfile_read() and sndfile_read_at()
+ * (for the vocoder in WAON_FLOAT)
+ */
+long sndfile_read_f (SNDFILE *sf, SF_INFO sfinfo,
+		     float * left, float * right,
+		     int len,
+		     float * buf);
+long sndfile_read_at_f (SNDFILE *sf, SF_INFO sfinfo,
+			long start,
+			float * left, float * right,
+			int len,
+			float * buf);
+
+/* read len frames from start, mix down the channels and multiply
+ * the window, directly from the interleaved data of libsndfile.
+ * INPUT
+ *  window[len] : window function (NULL for no window)
+ *  buf[len * sfinfo.channels] : work area for the interleaved data
+ *                               (NULL to allocate it in the call)
+ * OUTPUT
+ *  out[len] : average of the channels times window[],
+ *             where the frames beyond the end of the file are zero.
+ *  returned value : frames read
+ */
+long sndfile_read_mix_at (SNDFILE *sf, SF_INFO sfinfo,
+			  long start,
+			  const double * window,
+			  double * out,
+			  int len,
+			  double * buf);
 
 /* print sfinfo
  */
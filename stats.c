@@ -0,0 +1,161 @@
+/* timing of the stages of the analysis
+ * Copyright (C) 1998-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h> // fprintf()
+#include <stdlib.h> // malloc()
+#ifdef __MINGW32__
+#include <sys/time.h> // gettimeofday()
+#else
+#include <time.h> // clock_gettime()
+#endif
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+#include "stats.h"
+
+
+/* names of the stages for the report */
+static const char *stage_name [WAON_STAT_N] = {
+  "read",
+  "window",
+  "fft",
+  "polar",
+  "phase",
+  "psub_oct",
+  "note_intensity",
+  "notes_check",
+  "cleanup",
+  "midi_write",
+};
+
+
+struct WAON_stats *
+WAON_stats_init (void)
+{
+  struct WAON_stats *stats
+    = (struct WAON_stats *)malloc (sizeof (struct WAON_stats));
+  CHECK_MALLOC (stats, "WAON_stats_init");
+
+  int i;
+  for (i = 0; i < WAON_STAT_N; i ++)
+    {
+      stats->t [i] = 0.0;
+      stats->n [i] = 0;
+    }
+  stats->nframes = 0;
+  stats->t0 = WAON_stats_clock ();
+  stats->t1 = 0.0;
+
+  return (stats);
+}
+
+void
+WAON_stats_free (struct WAON_stats *stats)
+{
+  if (stats == NULL) return;
+  free (stats);
+}
+
+double
+WAON_stats_clock (void)
+{
+#ifdef __MINGW32__
+  struct timeval tv;
+  gettimeofday (&tv, NULL);
+  return ((double)tv.tv_sec + 1.0e-6 * (double)tv.tv_usec);
+#else
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ((double)ts.tv_sec + 1.0e-9 * (double)ts.tv_nsec);
+#endif
+}
+
+void
+WAON_stats_lap (struct WAON_stats *stats, int stage, double *t)
+{
+  double now = WAON_stats_clock ();
+  stats->t [stage] += now - *t;
+  stats->n [stage] ++;
+  *t = now;
+}
+
+void
+WAON_stats_stop (struct WAON_stats *stats)
+{
+  stats->t1 = WAON_stats_clock ();
+}
+
+/* total time since the init (up to WAON_stats_stop(), if called) */
+static double
+WAON_stats_total (const struct WAON_stats *stats)
+{
+  double t1 = (stats->t1 > 0.0 ? stats->t1 : WAON_stats_clock ());
+  return (t1 - stats->t0);
+}
+
+void
+WAON_stats_print (const struct WAON_stats *stats, double duration,
+		  FILE *fp)
+{
+  double total = WAON_stats_total (stats);
+  double sum = 0.0;
+  int i;
+
+  fprintf (fp, "WaoN stats :\n");
+  fprintf (fp, "  %-16s %10s %10s %8s\n",
+	   "stage", "time[s]", "count", "share");
+  for (i = 0; i < WAON_STAT_N; i ++)
+    {
+      fprintf (fp, "  %-16s %10.4f %10ld %7.1f%%\n",
+	       stage_name [i], stats->t [i], stats->n [i],
+	       (total > 0.0 ? 100.0 * stats->t [i] / total : 0.0));
+      sum += stats->t [i];
+    }
+  fprintf (fp, "  %-16s %10.4f %10s %7.1f%%\n",
+	   "(other)", total - sum, "",
+	   (total > 0.0 ? 100.0 * (total - sum) / total : 0.0));
+  fprintf (fp, "  total %.4f s for %ld frames (%.1f frames/s)\n",
+	   total, stats->nframes,
+	   (total > 0.0 ? (double)stats->nframes / total : 0.0));
+  fprintf (fp, "  input %.2f s, realtime factor %.1f\n",
+	   duration, (total > 0.0 ? duration / total : 0.0));
+}
+
+void
+WAON_stats_print_json (const struct WAON_stats *stats, double duration,
+		       FILE *fp)
+{
+  double total = WAON_stats_total (stats);
+  int i;
+
+  fprintf (fp, "{\n");
+  fprintf (fp, "  \"stages\": {\n");
+  for (i = 0; i < WAON_STAT_N; i ++)
+    {
+      fprintf (fp, "    \"%s\": {\"time\": %.6f, \"count\": %ld}%s\n",
+	       stage_name [i], stats->t [i], stats->n [i],
+	       (i < WAON_STAT_N - 1 ? "," : ""));
+    }
+  fprintf (fp, "  },\n");
+  fprintf (fp, "  \"total_time\": %.6f,\n", total);
+  fprintf (fp, "  \"frames\": %ld,\n", stats->nframes);
+  fprintf (fp, "  \"frames_per_sec\": %.3f,\n",
+	   (total > 0.0 ? (double)stats->nframes / total : 0.0));
+  fprintf (fp, "  \"input_duration\": %.6f,\n", duration);
+  fprintf (fp, "  \"realtime_factor\": %.3f\n",
+	   (total > 0.0 ? duration / total : 0.0));
+  fprintf (fp, "}\n");
+}
@@ -0,0 +1,92 @@
+/* header file for stats.c --
+ * timing of the stages of the analysis
+ * Copyright (C) 1998-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_STATS_H_
+#define	_STATS_H_
+
+#include <stdio.h> // FILE
+
+
+/* stages to measure */
+enum {
+  WAON_STAT_READ,    // reading (and decimating) the input
+  WAON_STAT_WINDOW,  // mixdown and windowing (with the silence gate)
+  WAON_STAT_FFT,     // FFT
+  WAON_STAT_POLAR,   // power (and phase) spectrum from the FFT
+  WAON_STAT_PHASE,   // frequency correction by the phase difference
+  WAON_STAT_PSUB,    // drum- and octave-removal
+  WAON_STAT_NOTES,   // spectral flux and note_intensity()
+  WAON_STAT_CHECK,   // WAON_notes_check()
+  WAON_STAT_CLEANUP, // clean-up of the notes at the end
+  WAON_STAT_MIDI,    // writing the MIDI file
+  WAON_STAT_N
+};
+
+struct WAON_stats {
+  double t [WAON_STAT_N]; // elapsed time of each stage [sec]
+  long   n [WAON_STAT_N]; // number of times of each stage
+  long nframes;  // number of steps analysed
+  double t0;     // time at the init
+  double t1;     // time at WAON_stats_stop() (0 == not yet)
+};
+
+/* add the time since *t to the stage, where *t is reset to the present */
+#define WAON_STATS_LAP(stats, stage, t) \
+  do { if ((stats) != NULL) WAON_stats_lap ((stats), (stage), (t)); } \
+  while (0)
+
+
+struct WAON_stats *
+WAON_stats_init (void);
+
+void
+WAON_stats_free (struct WAON_stats *stats);
+
+/* monotonic clock in sec */
+double
+WAON_stats_clock (void);
+
+/* add the time since *t to the stage, where *t is reset to the present
+ */
+void
+WAON_stats_lap (struct WAON_stats *stats, int stage, double *t);
+
+/* fix the total time at the present */
+void
+WAON_stats_stop (struct WAON_stats *stats);
+
+/* print the report
+ * INPUT
+ *  duration : length of the input [sec] for the realtime factor
+ *  fp       : output stream
+ */
+void
+WAON_stats_print (const struct WAON_stats *stats, double duration,
+		  FILE *fp);
+
+/* print the report in JSON
+ * INPUT
+ *  duration : length of the input [sec] for the realtime factor
+ *  fp       : output stream
+ */
+void
+WAON_stats_print_json (const struct WAON_stats *stats, double duration,
+		       FILE *fp);
+
+
+#endif /* !_STATS_H_ */
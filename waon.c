@@ -0,0 +1,489 @@
+/* C API of the transcription engine (libwaon)
+ * Copyright (C) 1998-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#include <stdio.h> /* fprintf()  */
+#include <stdlib.h> /* malloc(), free()  */
+#include <string.h> /* memmove()  */
+#include "memory-check.h" // CHECK_MALLOC() macro
+
+#include "midi.h" // WAON_notes_output_midi()
+#include "analyse.h" // struct WAON_analyse, init_patch()
+#include "notes.h" // struct WAON_notes
+#include "band.h" // struct WAON_band
+#include "stats.h" // struct WAON_stats
+
+#include "waon.h"
+
+
+struct WAON {
+  struct WAON_params params;
+  double samplerate;
+  int channels;
+  long hop;
+
+  struct WAON_analyse *an; // settings of the note selection and the patch
+
+  /* bands to analyse, where vel[] of band[i] is taken
+   * for the notes in [band_low[i], band_top[i]] */
+  int nband;
+  struct WAON_band *band[3];
+  int band_low[3];
+  int band_top[3];
+
+  // input buffers for all bands
+  long len_max;
+  double *left;
+  double *right;
+  long nbuf; // number of samples in the buffers
+
+  long icnt; // number of steps analysed
+  char vel[128]; // velocity at the current step
+  struct WAON_notes *notes;
+  int flag_finished;
+
+  // for the events written during the analysis (NULL if not)
+  struct WAON_notes_stream *stream;
+  struct WAON_midi *midi;
+
+  struct WAON_stats *stats; // timing of the stages (NULL == off)
+};
+
+
+void
+WAON_params_default (struct WAON_params *params)
+{
+  params->len = 2048;
+  params->hop = 0;
+  params->flag_window = 3; // hanning window
+  /* for 76 keys piano  */
+  params->notelow = 28; /* E2  */
+  params->notetop = 103; /* G8  */
+
+  params->flag_phase = 1; // use the phase correction
+  params->flag_fast_phase = 0; // use the exact atan2()
+
+  params->flag_multi = 0; // single resolution
+  params->multi_l = 48; // C3
+  params->multi_h = 72; // C5
+
+  params->abs_flg = 1;
+  params->cut_ratio = -5.0;
+  params->rel_cut_ratio = 1.0; // this value is ignored when abs_flg == 1
+  params->peak_threshold = 128; /* this means no peak search  */
+  params->adj_pitch = 0.0;
+
+  params->psub_n = 0;
+  params->psub_f = 0.0;
+  params->oct_f = 0.0;
+  params->harm3_f = 0.0;
+  params->harm5_f = 0.0;
+  params->flux_th = 0.0;
+  params->silence = 0.0;
+
+  params->file_patch = NULL;
+}
+
+struct WAON *
+WAON_init (const struct WAON_params *params,
+	   double samplerate, int channels)
+{
+  if (channels != 1 && channels != 2) return (NULL);
+
+  struct WAON *waon = (struct WAON *)malloc (sizeof (struct WAON));
+  CHECK_MALLOC (waon, "WAON_init");
+
+  waon->params = *params;
+  waon->samplerate = samplerate;
+  waon->channels = channels;
+
+  struct WAON_params *p = &(waon->params);
+  if (p->flag_window < 0 || p->flag_window > 6)
+    {
+      p->flag_window = 0;
+    }
+  if (p->hop == 0)
+    {
+      if (p->flag_multi == 0)
+	{
+	  p->hop = p->len / 4;
+	}
+      else
+	{
+	  // 1/4 of the FFT length of the treble band
+	  p->hop = p->len / 8;
+	}
+    }
+  if (p->psub_n == 0) p->psub_f = 0.0;
+  if (p->psub_f == 0.0) p->psub_n = 0;
+  waon->hop = p->hop;
+
+  // the settings of the note selection, shared by the bands
+  waon->an = WAON_analyse_init (p->abs_flg, p->adj_pitch);
+
+
+  /* set the bands to analyse
+   * for the single resolution, one band covers [notelow, notetop].
+   * for the multi resolution, the range is split at multi_l and multi_h
+   * and the bands without any note are skipped.
+   */
+  int i;
+  waon->nband = 0;
+  if (p->flag_multi == 0)
+    {
+      waon->band[0] = WAON_band_init (p->len, p->hop, samplerate,
+				      p->notelow, p->notetop,
+				      p->flag_window, p->flag_phase);
+      waon->nband = 1;
+    }
+  else
+    {
+      long len_multi[3];
+      int low_multi[3];
+      int top_multi[3];
+      len_multi[0] = p->len * 8; // bass
+      len_multi[1] = p->len * 2; // mid
+      len_multi[2] = p->len / 2; // treble
+      low_multi[0] = p->notelow;
+      top_multi[0] = p->multi_l - 1;
+      low_multi[1] = p->multi_l;
+      top_multi[1] = p->multi_h - 1;
+      low_multi[2] = p->multi_h;
+      top_multi[2] = p->notetop;
+      if (top_multi[0] > p->notetop) top_multi[0] = p->notetop;
+      if (low_multi[1] < p->notelow) low_multi[1] = p->notelow;
+      if (top_multi[1] > p->notetop) top_multi[1] = p->notetop;
+      if (low_multi[2] < p->notelow) low_multi[2] = p->notelow;
+
+      for (i = 0; i < 3; i ++)
+	{
+	  if (low_multi[i] > top_multi[i]) continue;
+
+	  // hop of each band is scaled with the FFT length
+	  waon->band[waon->nband]
+	    = WAON_band_init (len_multi[i],
+			      p->hop * len_multi[i] / len_multi[2],
+			      samplerate,
+			      low_multi[i], top_multi[i],
+			      p->flag_window, p->flag_phase);
+	  waon->nband ++;
+	}
+    }
+  if (waon->nband == 0)
+    {
+      // no note to analyse
+      WAON_analyse_free (waon->an);
+      free (waon);
+      return (NULL);
+    }
+  waon->len_max = 0;
+  for (i = 0; i < waon->nband; i ++)
+    {
+      struct WAON_band *b = waon->band[i];
+      b->cut_ratio = p->cut_ratio;
+      b->rel_cut_ratio = p->rel_cut_ratio;
+      b->psub_n = p->psub_n;
+      b->psub_f = p->psub_f;
+      b->oct_f = p->oct_f;
+      b->harm3_f = p->harm3_f;
+      b->harm5_f = p->harm5_f;
+      b->flux_th = p->flux_th;
+      b->silence = p->silence;
+      b->flag_fast_phase = p->flag_fast_phase;
+      b->an = waon->an;
+
+      waon->band_low[i] = b->notelow;
+      waon->band_top[i] = b->notetop;
+
+      if (b->len > waon->len_max) waon->len_max = b->len;
+    }
+  // the lowest and highest bands cover the rest of the notes
+  waon->band_low[0] = 0;
+  waon->band_top[waon->nband - 1] = 127;
+
+  // allocate buffers
+  waon->left  = (double *)malloc (sizeof (double) * waon->len_max);
+  waon->right = (double *)malloc (sizeof (double) * waon->len_max);
+  CHECK_MALLOC (waon->left,  "WAON_init");
+  CHECK_MALLOC (waon->right, "WAON_init");
+
+  /* for the multi resolution, pad zeros at the beginning
+   * so that the center of the bands is at the same time
+   * as the single resolution by len.
+   */
+  long pad = (waon->len_max - p->len) / 2;
+  if (pad > waon->len_max - p->hop) pad = waon->len_max - p->hop;
+  for (i = 0; i < pad; i ++)
+    {
+      waon->left  [i] = 0.0;
+      waon->right [i] = 0.0;
+    }
+  waon->nbuf = pad;
+
+  // init patch
+  init_patch (waon->an, p->file_patch, p->len, p->flag_window);
+  /*                                   ^^^ len could be given separately  */
+
+  waon->icnt = 0;
+  for (i = 0; i < 128; i ++)
+    {
+      waon->vel[i] = 0;
+    }
+  waon->notes = WAON_notes_init ();
+  waon->flag_finished = 0;
+  waon->stream = NULL;
+  waon->midi = NULL;
+  waon->stats = NULL;
+
+  return (waon);
+}
+
+void
+WAON_free (struct WAON *waon)
+{
+  if (waon == NULL) return;
+
+  int i;
+  for (i = 0; i < waon->nband; i ++)
+    {
+      WAON_band_free (waon->band[i]);
+    }
+  WAON_analyse_free (waon->an);
+  if (waon->left  != NULL) free (waon->left);
+  if (waon->right != NULL) free (waon->right);
+  WAON_notes_free (waon->notes);
+  WAON_notes_stream_free (waon->stream);
+  WAON_midi_close (waon->midi);
+  free (waon);
+}
+
+long
+WAON_get_hop (const struct WAON *waon)
+{
+  return (waon->hop);
+}
+
+long
+WAON_get_division (const struct WAON *waon)
+{
+  /* note: (hop / samplerate) = duration for 1 step (sec) */
+  return ((long)(0.5 * waon->samplerate / (double) waon->hop));
+}
+
+long
+WAON_get_samples_to_step (const struct WAON *waon)
+{
+  return (waon->len_max - waon->nbuf);
+}
+
+void
+WAON_set_stats (struct WAON *waon, struct WAON_stats *stats)
+{
+  waon->stats = stats;
+  int i;
+  for (i = 0; i < waon->nband; i ++)
+    {
+      waon->band[i]->stats = stats;
+    }
+}
+
+/* analyse one step on the full buffers
+ */
+static void
+WAON_step (struct WAON *waon)
+{
+  /**
+   * stages 1 and 2 for each band
+   * whose hop is reached at this step.
+   * the bands are aligned at the center of the buffer.
+   */
+  int ib;
+  for (ib = 0; ib < waon->nband; ib ++)
+    {
+      struct WAON_band *b = waon->band[ib];
+      if (waon->icnt % (b->hop / waon->hop) != 0) continue;
+
+      long offset = (waon->len_max - b->len) / 2;
+      WAON_band_analyse (b,
+			 waon->left + offset, waon->right + offset,
+			 waon->channels);
+    }
+
+  // merge vel[] of the bands
+  for (ib = 0; ib < waon->nband; ib ++)
+    {
+      int i;
+      for (i = waon->band_low[ib]; i <= waon->band_top[ib]; i ++)
+	{
+	  waon->vel[i] = waon->band[ib]->vel[i];
+	}
+    }
+
+  /**
+   * stage 3: check previous time for note-on/off
+   */
+  struct WAON_stats *stats = waon->stats;
+  double t = 0.0;
+  if (stats != NULL) t = WAON_stats_clock ();
+  WAON_notes_check (waon->notes, (int)waon->icnt, waon->vel,
+		    8, 0, waon->params.peak_threshold);
+  WAON_STATS_LAP (stats, WAON_STAT_CHECK, &t);
+  if (waon->stream != NULL)
+    {
+      WAON_notes_stream_flush (waon->notes, waon->stream, (int)waon->icnt);
+      WAON_STATS_LAP (stats, WAON_STAT_CLEANUP, &t);
+    }
+  if (stats != NULL) stats->nframes ++;
+  waon->icnt ++;
+}
+
+long
+WAON_process (struct WAON *waon,
+	      const double *left, const double *right, long n)
+{
+  if (waon->flag_finished != 0) return (0);
+
+  long nstep = 0;
+  while (n > 0)
+    {
+      long m = waon->len_max - waon->nbuf;
+      if (m > n) m = n;
+      memcpy (waon->left + waon->nbuf, left, sizeof (double) * m);
+      if (waon->channels == 2)
+	{
+	  memcpy (waon->right + waon->nbuf, right, sizeof (double) * m);
+	  right += m;
+	}
+      left += m;
+      n -= m;
+      waon->nbuf += m;
+
+      if (waon->nbuf < waon->len_max) break;
+
+      WAON_step (waon);
+      nstep ++;
+
+      // shift
+      long nkeep = waon->len_max - waon->hop;
+      memmove (waon->left, waon->left + waon->hop, sizeof (double) * nkeep);
+      if (waon->channels == 2)
+	{
+	  memmove (waon->right, waon->right + waon->hop,
+		   sizeof (double) * nkeep);
+	}
+      waon->nbuf = nkeep;
+    }
+
+  return (nstep);
+}
+
+void
+WAON_finish (struct WAON *waon)
+{
+  if (waon->flag_finished != 0) return;
+  waon->flag_finished = 1;
+
+  double t = 0.0;
+  if (waon->stats != NULL) t = WAON_stats_clock ();
+
+  if (waon->stream != NULL)
+    {
+      WAON_notes_stream_finish (waon->notes, waon->stream);
+      WAON_STATS_LAP (waon->stats, WAON_STAT_CLEANUP, &t);
+      if (waon->midi != NULL)
+	{
+	  WAON_midi_close (waon->midi);
+	  waon->midi = NULL;
+	  WAON_STATS_LAP (waon->stats, WAON_STAT_MIDI, &t);
+	}
+      return;
+    }
+
+  // clean notes
+  WAON_notes_regulate (waon->notes);
+
+  WAON_notes_remove_shortnotes (waon->notes, 1, 64);
+  WAON_notes_remove_shortnotes (waon->notes, 2, 28);
+
+  WAON_notes_remove_octaves (waon->notes);
+  WAON_STATS_LAP (waon->stats, WAON_STAT_CLEANUP, &t);
+}
+
+struct WAON_notes *
+WAON_get_notes (struct WAON *waon)
+{
+  return (waon->notes);
+}
+
+/* output of struct WAON_notes_stream */
+static void
+WAON_write_event (void *data, const struct WAON_note_event *ev)
+{
+  WAON_midi_write ((struct WAON_midi *)data, ev);
+}
+
+int
+WAON_stream_events (struct WAON *waon,
+		    void (*output) (void *data,
+				    const struct WAON_note_event *ev),
+		    void *data, int horizon)
+{
+  if (waon->icnt > 0 || waon->stream != NULL) return (-1);
+
+  waon->stream = WAON_notes_stream_init (horizon, output, data);
+  if (horizon <= 0)
+    {
+      // no short notes can be removed without waiting
+      waon->stream->nshort = 0;
+      waon->stream->horizon = 0;
+      return (0);
+    }
+  // the horizon should be larger than the short notes to remove
+  int k;
+  for (k = 0; k < waon->stream->nshort; k ++)
+    {
+      if (waon->stream->horizon <= waon->stream->short_duration[k])
+	{
+	  waon->stream->horizon = waon->stream->short_duration[k] + 1;
+	}
+    }
+  return (0);
+}
+
+int
+WAON_stream_midi (struct WAON *waon, const char *filename, int horizon)
+{
+  if (waon->icnt > 0 || waon->stream != NULL) return (-1);
+  // the track length is corrected at the end by seeking back
+  if (strcmp (filename, "-") == 0) return (-1);
+
+  waon->midi = WAON_midi_open (filename, WAON_get_division (waon), -1);
+  if (waon->midi == NULL) return (-1);
+
+  if (horizon < 1) horizon = 1;
+  return (WAON_stream_events (waon, WAON_write_event, waon->midi, horizon));
+}
+
+void
+WAON_write_midi (struct WAON *waon, const char *filename)
+{
+  if (waon->stream != NULL) return; // already written
+
+  double t = 0.0;
+  if (waon->stats != NULL) t = WAON_stats_clock ();
+  WAON_notes_output_midi (waon->notes, WAON_get_division (waon), filename);
+  WAON_STATS_LAP (waon->stats, WAON_STAT_MIDI, &t);
+}
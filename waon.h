@@ -0,0 +1,191 @@
+/* header file for waon.c --
+ * C API of the transcription engine (libwaon)
+ * Copyright (C) 1998-2013 Kengo Ichiki <kengoichiki@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef	_WAON_H_
+#define	_WAON_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "notes.h" // struct WAON_notes
+#include "stats.h" // struct WAON_stats
+
+
+/* parameters of the transcription,
+ * whose defaults (those of waon) are set by WAON_params_default()
+ */
+struct WAON_params {
+  long len;        // FFT length (of the mid band for the multi resolution)
+  long hop;        // hop size (0 == len/4, or len/8 for the multi resolution)
+  int flag_window; // window type (0 to 6)
+  int notelow;     // lowest note to analyse
+  int notetop;     // highest note to analyse
+
+  int flag_phase;      // 1 = use the phase correction
+  int flag_fast_phase; // 1 = approximate atan2() for the phase
+
+  int flag_multi; // 1 = multi resolution
+  int multi_l;    // lowest note of the mid band
+  int multi_h;    // lowest note of the treble band
+
+  int abs_flg;          // 1 = absolute cutoff, 0 = relative to the average
+  double cut_ratio;     // log10 of cutoff ratio to scale velocity
+  double rel_cut_ratio; // log10 of cutoff ratio relative to the average
+  int peak_threshold;   // for the note-on again on the peak (128 == none)
+  double adj_pitch;     // pitch adjustment in half-notes
+
+  int psub_n;     // drum-removal (number of averaging bins in one side)
+  double psub_f;  // drum-removal (factor to the average)
+  double oct_f;   // factor for the octave removal
+  double harm3_f; // factor for the 3rd harmonic removal
+  double harm5_f; // factor for the 5th harmonic removal
+  double flux_th; // threshold of the spectral flux (0 == no skip)
+  double silence; // peak amplitude at or below which the step is silent
+
+  char *file_patch; // patch file (NULL == no patch)
+};
+
+/* transcription engine (opaque) */
+struct WAON;
+
+
+/* set the default parameters of waon */
+void
+WAON_params_default (struct WAON_params *params);
+
+/* initialize the transcription engine
+ * INPUT
+ *  params     : parameters (copied, so that they can be discarded)
+ *  samplerate : of the input given to WAON_process()
+ *  channels   : 1 (mono) or 2 (stereo)
+ * OUTPUT
+ *  returned value : struct WAON, or NULL for the invalid channels
+ *                   or the empty range of the notes
+ * NOTE
+ *  the engines share no state, so that WAON_process() of different
+ *  engines can run in parallel threads. however, the FFTW planner is
+ *  not thread-safe, so that WAON_init() and WAON_free() should not be
+ *  called at the same time in different threads.
+ */
+struct WAON *
+WAON_init (const struct WAON_params *params,
+	   double samplerate, int channels);
+
+void
+WAON_free (struct WAON *waon);
+
+/* hop size of the engine, that is, the number of samples of one step */
+long
+WAON_get_hop (const struct WAON *waon);
+
+/* divisions for one beat (quater-note) for the MIDI output,
+ * where we assume 120 BPM (1 beat = 0.5 sec).
+ */
+long
+WAON_get_division (const struct WAON *waon);
+
+/* number of samples to give WAON_process() to complete the next step,
+ * so that the caller can tell the sample where each step is done
+ */
+long
+WAON_get_samples_to_step (const struct WAON *waon);
+
+/* measure the time of the stages into stats during the analysis
+ * INPUT
+ *  stats : made by WAON_stats_init() (not owned), or NULL to stop it
+ * NOTE
+ *  the reading of the input (WAON_STAT_READ) is up to the caller.
+ */
+void
+WAON_set_stats (struct WAON *waon, struct WAON_stats *stats);
+
+/* feed the samples and analyse all the steps completed by them
+ * INPUT
+ *  left [n], right [n] : wave data (right[] is not referred for mono)
+ *  n                   : any number of samples
+ * OUTPUT
+ *  returned value : number of steps analysed by this call
+ */
+long
+WAON_process (struct WAON *waon,
+	      const double *left, const double *right, long n);
+
+/* close the notes at the end of the input and clean them up
+ * (no more WAON_process() after this)
+ */
+void
+WAON_finish (struct WAON *waon);
+
+/* events transcribed so far (owned by the engine) */
+struct WAON_notes *
+WAON_get_notes (struct WAON *waon);
+
+/* write the events into the standard MIDI file
+ * INPUT
+ *  filename : "-" for stdout
+ * (nothing is done if WAON_stream_midi() is used)
+ */
+void
+WAON_write_midi (struct WAON *waon, const char *filename);
+
+/* give the events to output() during the analysis, in the order,
+ * instead of keeping all of them until the end.
+ * the notes are cleaned up on the fly (see struct WAON_notes_stream)
+ * and the rest is given by WAON_finish().
+ * INPUT
+ *  output  : function called for each event
+ *  data    : passed to output()
+ *  horizon : age in steps after which the note sounding is given
+ *            with the velocity at that time.
+ *            0 gives the events at the step they are found
+ *            by WAON_notes_check() for the real-time use,
+ *            where the short notes are not removed.
+ * OUTPUT
+ *  returned value : 0 on success, -1 on error
+ *                   (or if it is called after WAON_process())
+ */
+int
+WAON_stream_events (struct WAON *waon,
+		    void (*output) (void *data,
+				    const struct WAON_note_event *ev),
+		    void *data, int horizon);
+
+/* write the events into the standard MIDI file during the analysis,
+ * instead of keeping all of them until the end,
+ * so that the memory is bounded for the long input.
+ * the notes are cleaned up on the fly (see struct WAON_notes_stream)
+ * and the file is closed by WAON_finish().
+ * INPUT
+ *  filename : file name to write (stdout "-" is not accepted, because
+ *             the track length is written at the end by seeking back)
+ *  horizon  : age in steps after which the note sounding is written
+ *             with the velocity at that time
+ * OUTPUT
+ *  returned value : 0 on success, -1 on error
+ *                   (or if it is called after WAON_process())
+ */
+int
+WAON_stream_midi (struct WAON *waon, const char *filename, int horizon);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !_WAON_H_ */